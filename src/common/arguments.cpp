@@ -14,9 +14,15 @@ void Usage(ProgramType programType)
         Log("    -clipeconomy     : turn clipnode economy mode on\n");
         Log("    -cliptype value  : set to smallest, normalized, simple, precise, or legacy (default)\n");
         Log("    -lightdata #     : Alter maximum lighting memory limit (in kb)\n");
+        Log("    -cache           : reuse the output of unchanged brushes from <map>.csgcache\n");
+        Log("    -nocache         : csg every brush again (default)\n");
         Log("    -noskyclip       : disable automatic clipping of SKY brushes\n");
         Log("    -texdata #       : Alter maximum texture memory limit (in kb)\n");
+        Log("    -wadcache dir    : keep the sorted lump directory of every wad in dir\n");
         Log("    -worldextent #   : Extend map geometry limits beyond +/-32768.\n");
+        Log("    -threads #       : manually specify the number of threads to run\n");
+        Log("    -pin             : pin each thread to one cpu\n");
+        Log("    -trace           : write a per-thread trace of all work items (.trace.json)\n");
         break;
 
     case ProgramType::PROGRAM_BSP:
@@ -27,6 +33,10 @@ void Usage(ProgramType programType)
         Log("    -texdata #     : Alter maximum texture memory limit (in kb)\n");
         Log("    -lightdata #   : Alter maximum lighting memory limit (in kb)\n");
         Log("    -nohull2       : Don't generate hull 2 (the clipping hull for large monsters and pushables)\n");
+        Log("    -leakonly      : Stop at the first leak, after writing its pointfile\n");
+        Log("    -threads #     : manually specify the number of threads to run\n");
+        Log("    -pin           : pin each thread to one cpu\n");
+        Log("    -trace         : write a per-thread trace of all work items (.trace.json)\n");
         break;
 
     case ProgramType::PROGRAM_VIS:
@@ -39,6 +49,8 @@ void Usage(ProgramType programType)
         Log("    -low | -high    : run program an altered priority level\n");
         Log("    -maxdistance #  : Alter the maximum distance for visibility\n");
         Log("    -threads #      : manually specify the number of threads to run\n");
+        Log("    -pin            : pin each thread to one cpu\n");
+        Log("    -trace          : write a per-thread trace of all work items (.trace.json)\n");
         break;
 
     case ProgramType::PROGRAM_RAD:
@@ -51,9 +63,22 @@ void Usage(ProgramType programType)
         Log("    -texchop #      : Set radiosity patch size for texture light faces\n\n");
         Log("    -fade #         : Set global fade (larger values = shorter lights)\n");
         Log("    -texdata #      : Alter maximum texture memory limit (in kb)\n");
+        Log("    -wadcache dir   : keep the sorted lump directory of every wad in dir\n");
         Log("    -low | -high    : run program an altered priority level\n");
         Log("    -lightdata #    : Alter maximum lighting memory limit (in kb)\n");
         Log("    -threads #      : manually specify the number of threads to run\n");
+        Log("    -pin            : pin each thread to one cpu and place patch data on its NUMA node\n");
+        Log("    -trace          : write a per-thread trace of all work items (.trace.json)\n");
+        break;
+
+    case ProgramType::PROGRAM_COMPILE:
+        Log(" %s.exe [options] [-csg options] [-bsp options] [-vis options] [-rad options] <mapname.map>", g_Program.c_str());
+        Log("\n %s Arguments :\n\n", g_Program.c_str());
+        Log("    -csg|-bsp|-vis|-rad : the following options are passed to that tool only\n");
+        Log("    -novis          : Skip the vis stage\n");
+        Log("    -norad          : Skip the rad stage\n");
+        Log("    Options before the first stage switch are passed to every tool that accepts them.\n");
+        Log("    Each tool runs as its own process and keeps its intermediate files.\n");
         break;
 
     default:
@@ -5,7 +5,8 @@ enum class ProgramType
     PROGRAM_CSG,
     PROGRAM_BSP,
     PROGRAM_VIS,
-    PROGRAM_RAD
+    PROGRAM_RAD,
+    PROGRAM_COMPILE
 };
 
 void Usage(ProgramType programType);
@@ -1,7 +1,15 @@
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "cmdlib.h"
 #include "messages.h"
 #include "log.h"
+#include "threads.h"
+#include "blockmem.h"
+#include "hlassert.h"
 
 // =====================================================================================
 //  AllocBlock
@@ -43,4 +51,371 @@ auto Alloc(const unsigned long size) -> void *
 auto Free(void *pointer) -> bool
 {
     return FreeBlock(pointer);
-}
\ No newline at end of file
+}
+// =====================================================================================
+//  Free lists
+//      a thread keeps up to FREELIST_MAX freed blocks of a size class on its own list; past
+//      that it moves FREELIST_BATCH of them to the shared list of the class, and it refills
+//      from there before asking for new memory. So blocks freed on another thread than the
+//      one that allocated them go back into use instead of piling up on the freeing thread.
+// =====================================================================================
+constexpr int FREELIST_MAX = 256;
+constexpr int FREELIST_BATCH = FREELIST_MAX / 2;
+
+struct PoolBlock
+{
+    PoolBlock *next;
+};
+
+struct FreeList
+{
+    PoolBlock *head;
+    int count;
+};
+
+struct SharedFreeList
+{
+    std::mutex lock;
+    std::atomic<PoolBlock *> head; // only changed under lock
+};
+
+static void PushFree(FreeList &list, SharedFreeList &shared, void *pointer)
+{
+    auto *block = (PoolBlock *)pointer;
+    block->next = list.head;
+    list.head = block;
+    if (++list.count <= FREELIST_MAX)
+    {
+        return;
+    }
+    PoolBlock *first = list.head;
+    PoolBlock *last = first;
+    for (int i = 1; i < FREELIST_BATCH; i++)
+    {
+        last = last->next;
+    }
+    list.head = last->next;
+    list.count -= FREELIST_BATCH;
+
+    std::lock_guard<std::mutex> guard(shared.lock);
+    last->next = shared.head.load(std::memory_order_relaxed);
+    shared.head.store(first, std::memory_order_relaxed);
+}
+
+static auto PopFree(FreeList &list, SharedFreeList &shared) -> void *
+{
+    if (!list.head)
+    {
+        if (!shared.head.load(std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> guard(shared.lock);
+        PoolBlock *first = shared.head.load(std::memory_order_relaxed);
+        if (!first)
+        {
+            return nullptr;
+        }
+        PoolBlock *last = first;
+        int count = 1;
+        while (count < FREELIST_BATCH && last->next)
+        {
+            last = last->next;
+            count++;
+        }
+        shared.head.store(last->next, std::memory_order_relaxed);
+        last->next = nullptr;
+        list.head = first;
+        list.count = count;
+    }
+    PoolBlock *block = list.head;
+    list.head = block->next;
+    list.count--;
+    return block;
+}
+
+// =====================================================================================
+//  Pools
+//      power of two size classes from 32 bytes to 4 KB, larger blocks go to malloc
+// =====================================================================================
+constexpr int POOL_MIN_SHIFT = 5;
+constexpr int POOL_NUM_CLASSES = 8;
+
+struct ThreadPool
+{
+    FreeList free[POOL_NUM_CLASSES];
+    ThreadPool *nextpool;
+};
+
+static thread_local ThreadPool *t_pool = nullptr;
+static ThreadPool *g_pools = nullptr; // every thread's pool, for FreePools
+static SharedFreeList g_poolshared[POOL_NUM_CLASSES];
+
+static auto PoolClass(const unsigned long size) -> int
+{
+    int poolclass = 0;
+    while ((1ul << (poolclass + POOL_MIN_SHIFT)) < size)
+    {
+        poolclass++;
+    }
+    return poolclass < POOL_NUM_CLASSES ? poolclass : -1;
+}
+
+static auto GetThreadPool() -> ThreadPool *
+{
+    if (!t_pool)
+    {
+        t_pool = new ThreadPool();
+        ThreadLock();
+        t_pool->nextpool = g_pools;
+        g_pools = t_pool;
+        ThreadUnlock();
+    }
+    return t_pool;
+}
+
+// =====================================================================================
+//  PoolAlloc
+// =====================================================================================
+auto PoolAlloc(const unsigned long size) -> void *
+{
+    int poolclass = PoolClass(size);
+    if (poolclass < 0)
+    {
+        void *pointer = malloc(size);
+        hlassume(pointer != nullptr, assume_NoMemory);
+        return pointer;
+    }
+    ThreadPool *pool = GetThreadPool();
+    if (void *block = PopFree(pool->free[poolclass], g_poolshared[poolclass]))
+    {
+        return block;
+    }
+    void *pointer = malloc(1ul << (poolclass + POOL_MIN_SHIFT));
+    hlassume(pointer != nullptr, assume_NoMemory);
+    return pointer;
+}
+
+// =====================================================================================
+//  PoolFree
+// =====================================================================================
+void PoolFree(void *pointer, const unsigned long size)
+{
+    if (!pointer)
+    {
+        return;
+    }
+    int poolclass = PoolClass(size);
+    if (poolclass < 0)
+    {
+        free(pointer);
+        return;
+    }
+    ThreadPool *pool = GetThreadPool();
+    PushFree(pool->free[poolclass], g_poolshared[poolclass], pointer);
+}
+
+// =====================================================================================
+//  FreePools
+//      returns every thread's cached blocks and the shared ones to the system
+// =====================================================================================
+static void FreeBlockList(PoolBlock *block)
+{
+    while (block)
+    {
+        PoolBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+void FreePools()
+{
+    for (ThreadPool *pool = g_pools; pool; pool = pool->nextpool)
+    {
+        for (FreeList &list : pool->free)
+        {
+            FreeBlockList(list.head);
+            list.head = nullptr;
+            list.count = 0;
+        }
+    }
+    for (SharedFreeList &shared : g_poolshared)
+    {
+        FreeBlockList(shared.head.load(std::memory_order_relaxed));
+        shared.head.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+// =====================================================================================
+//  Slabs
+//      16 byte size classes up to 2 KB; each thread carves its blocks out of its own
+//      SLAB_CHUNK_SIZE chunks and recycles freed blocks through the free lists above.
+//      The chunks are remembered so FreeSlabs can drop them all at once.
+// =====================================================================================
+constexpr int SLAB_SHIFT = 4;
+constexpr int SLAB_NUM_CLASSES = 128;
+constexpr unsigned long SLAB_CHUNK_SIZE = 64 * 1024;
+
+struct SlabClass
+{
+    FreeList free;
+    char *position; // rest of the current chunk
+    char *end;
+};
+
+struct ThreadSlabs
+{
+    SlabClass classes[SLAB_NUM_CLASSES];
+    ThreadSlabs *nextslabs;
+};
+
+static thread_local ThreadSlabs *t_slabs = nullptr;
+static ThreadSlabs *g_slabs = nullptr; // every thread's slabs, for FreeSlabs
+static SharedFreeList g_slabshared[SLAB_NUM_CLASSES];
+static std::vector<void *> g_slabchunks; // under ThreadLock
+
+static auto GetThreadSlabs() -> ThreadSlabs *
+{
+    if (!t_slabs)
+    {
+        t_slabs = new ThreadSlabs();
+        ThreadLock();
+        t_slabs->nextslabs = g_slabs;
+        g_slabs = t_slabs;
+        ThreadUnlock();
+    }
+    return t_slabs;
+}
+
+// =====================================================================================
+//  SlabAlloc
+// =====================================================================================
+auto SlabAlloc(const unsigned long size) -> void *
+{
+    unsigned long blocksize = (size + (1ul << SLAB_SHIFT) - 1) & ~((1ul << SLAB_SHIFT) - 1);
+    unsigned long slabclass = (blocksize >> SLAB_SHIFT) - 1;
+    hlassert(size > 0 && slabclass < SLAB_NUM_CLASSES);
+    ThreadSlabs *slabs = GetThreadSlabs();
+    SlabClass *slab = &slabs->classes[slabclass];
+    if (void *block = PopFree(slab->free, g_slabshared[slabclass]))
+    {
+        return block;
+    }
+    if (slab->end - slab->position < (long)blocksize)
+    {
+        slab->position = (char *)malloc(SLAB_CHUNK_SIZE);
+        hlassume(slab->position != nullptr, assume_NoMemory);
+        slab->end = slab->position + SLAB_CHUNK_SIZE;
+        ThreadLock();
+        g_slabchunks.push_back(slab->position);
+        ThreadUnlock();
+    }
+    void *pointer = slab->position;
+    slab->position += blocksize;
+    return pointer;
+}
+
+// =====================================================================================
+//  SlabFree
+// =====================================================================================
+void SlabFree(void *pointer, const unsigned long size)
+{
+    if (!pointer)
+    {
+        return;
+    }
+    unsigned long slabclass = ((size + (1ul << SLAB_SHIFT) - 1) >> SLAB_SHIFT) - 1;
+    ThreadSlabs *slabs = GetThreadSlabs();
+    PushFree(slabs->classes[slabclass].free, g_slabshared[slabclass], pointer);
+}
+
+// =====================================================================================
+//  FreeSlabs
+//      returns every chunk to the system, whether its blocks were freed or not; nothing
+//      allocated from the slabs may be used afterwards
+// =====================================================================================
+void FreeSlabs()
+{
+    for (ThreadSlabs *slabs = g_slabs; slabs; slabs = slabs->nextslabs)
+    {
+        for (SlabClass &slab : slabs->classes)
+        {
+            slab = SlabClass();
+        }
+    }
+    for (SharedFreeList &shared : g_slabshared)
+    {
+        shared.head.store(nullptr, std::memory_order_relaxed);
+    }
+    for (void *chunk : g_slabchunks)
+    {
+        free(chunk);
+    }
+    g_slabchunks.clear();
+    g_slabchunks.shrink_to_fit();
+}
+
+// =====================================================================================
+//  Arenas
+//      blocks of ARENA_BLOCK_SIZE, a larger request gets a block of its own
+// =====================================================================================
+constexpr unsigned long ARENA_BLOCK_SIZE = 64 * 1024;
+constexpr unsigned long ARENA_ALIGN = alignof(std::max_align_t);
+
+struct alignas(ARENA_ALIGN) ArenaBlock // followed by the data
+{
+    ArenaBlock *next;
+};
+
+// =====================================================================================
+//  ArenaAlloc
+// =====================================================================================
+auto ArenaAlloc(Arena &arena, const unsigned long size) -> void *
+{
+    unsigned long aligned = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if ((unsigned long)(arena.end - arena.position) < aligned)
+    {
+        unsigned long blocksize = aligned > ARENA_BLOCK_SIZE ? aligned : ARENA_BLOCK_SIZE;
+        auto *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + blocksize);
+        hlassume(block != nullptr, assume_NoMemory);
+        block->next = arena.blocks;
+        arena.blocks = block;
+        auto *data = (char *)(block + 1);
+        if (blocksize > ARENA_BLOCK_SIZE)
+        {
+            return data; // keep filling the current block
+        }
+        arena.position = data;
+        arena.end = data + blocksize;
+    }
+    void *pointer = arena.position;
+    arena.position += aligned;
+    return pointer;
+}
+
+// =====================================================================================
+//  ArenaStrdup
+//      copies length characters and terminates them
+// =====================================================================================
+auto ArenaStrdup(Arena &arena, const char *const string, const unsigned long length) -> char *
+{
+    auto *copy = (char *)ArenaAlloc(arena, length + 1);
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// =====================================================================================
+//  ArenaRelease
+// =====================================================================================
+void ArenaRelease(Arena &arena)
+{
+    while (ArenaBlock *block = arena.blocks)
+    {
+        arena.blocks = block->next;
+        free(block);
+    }
+    arena.position = nullptr;
+    arena.end = nullptr;
+}
@@ -6,6 +6,40 @@ extern auto FreeBlock(void *pointer) -> bool;
 extern auto Alloc(unsigned long size) -> void *;
 extern auto Free(void *pointer) -> bool;
 
+// Per-thread pools for blocks that are allocated and freed in large numbers within a
+// threaded phase. PoolAlloc does not clear the block and PoolFree must be given the
+// size it was allocated with. A thread caches a bounded number of freed blocks and
+// hands the rest to the other threads, so a block may be freed on any thread. Freed
+// blocks stay cached until FreePools, which must only be called between threaded phases.
+extern auto PoolAlloc(unsigned long size) -> void *;
+extern void PoolFree(void *pointer, unsigned long size);
+extern void FreePools();
+
+// Slabs for the many small records of one size that a tool allocates and frees over and
+// over, up to 2 KB each, in 16 byte size classes. The blocks are carved out of 64 KB
+// chunks and come back through the same bounded per-thread free lists as the pools, so
+// they are reused from one phase to the next. SlabAlloc does not clear the block and
+// SlabFree must be given the size it was allocated with; a block may be freed on any
+// thread. FreeSlabs releases all the chunks, so it must only be called between threaded
+// phases once no slab record is reachable any more.
+extern auto SlabAlloc(unsigned long size) -> void *;
+extern void SlabFree(void *pointer, unsigned long size);
+extern void FreeSlabs();
+
+// Bump allocator for data that is released all at once. ArenaAlloc does not clear
+// the memory and returns it aligned for any type; ArenaRelease frees every block.
+// A zeroed Arena is empty and ready to use. Not thread safe.
+struct ArenaBlock;
+struct Arena
+{
+    ArenaBlock *blocks;
+    char *position;
+    char *end;
+};
+extern auto ArenaAlloc(Arena &arena, unsigned long size) -> void *;
+extern auto ArenaStrdup(Arena &arena, const char *const string, unsigned long length) -> char *;
+extern void ArenaRelease(Arena &arena);
+
 #if defined(CHECK_HEAP)
 extern void HeapCheck();
 #else
@@ -1,5 +1,8 @@
 #include <cstring>
 #include <cerrno>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include "filelib.h"
 #include "messages.h"
@@ -937,27 +940,99 @@ void DeleteEmbeddedLightmaps()
 }
 
 // =====================================================================================
-//  ParseEpair
-//      entity key/value pairs
+//  Entity storage
+//      the epairs, their values and the keys all live in s_entityarena, which
+//      FreeEntities releases in one go. A replaced or deleted value stays where it
+//      is until then, so pointers from ValueForKey never dangle.
+//
+//      Every key is stored once and shared by the epairs of all entities, so the
+//      lookups below compare pointers, and a key that no entity has is rejected
+//      with a single hash lookup instead of a walk over the entity's epairs.
+// =====================================================================================
+static Arena s_entityarena;
+static std::unordered_map<std::string_view, const char *> s_keys;
+static const char *s_targetnamekey = InternKey("targetname");
+
+// targetname -> first entity with it, rebuilt by FindTargetEntity after changes
+static std::unordered_map<std::string, int> s_targetnames;
+static int s_targetnamesentities = -1;
+static bool s_targetnameschanged = true;
+
 // =====================================================================================
-auto ParseEpair() -> EntityProperty *
+//  InternKey
+//      the shared copy of key, made on first use
+// =====================================================================================
+auto InternKey(std::string_view key) -> const char *
 {
-	EntityProperty *e;
+	auto it = s_keys.find(key);
+	if (it != s_keys.end())
+	{
+		return it->second;
+	}
+	const char *atom = ArenaStrdup(s_entityarena, key.data(), key.size());
+	s_keys.emplace(std::string_view(atom, key.size()), atom);
+	return atom;
+}
 
-	e = (EntityProperty *)Alloc(sizeof(EntityProperty));
+// =====================================================================================
+//  FindKey
+//      the shared copy of key, or nullptr if no entity has ever had it
+// =====================================================================================
+auto FindKey(std::string_view key) -> const char *
+{
+	auto it = s_keys.find(key);
+	return it != s_keys.end() ? it->second : nullptr;
+}
 
-	if (strlen(g_token) >= MAX_KEY - 1)
-		Error("ParseEpair: Key token too long (%i > MAX_KEY)", (int)strlen(g_token));
+// =====================================================================================
+//  AddEpair
+//      a new key/value pair at the head of the entity's list, no check for duplicates
+// =====================================================================================
+static void AddEpair(Entity *ent, const char *const atom, std::string_view value)
+{
+	auto *ep = (EntityProperty *)ArenaAlloc(s_entityarena, sizeof(EntityProperty));
+	ep->next = ent->epairs;
+	ep->key = atom;
+	ep->value = ArenaStrdup(s_entityarena, value.data(), value.size());
+	ent->epairs = ep;
+	if (atom == s_targetnamekey)
+	{
+		s_targetnameschanged = true;
+	}
+}
 
-	e->key = strdup(g_token);
-	GetToken(false);
+// =====================================================================================
+//  FreeEntities
+//      clears g_entities and releases all entity data
+// =====================================================================================
+void FreeEntities()
+{
+	memset(g_entities, 0, sizeof(g_entities));
+	g_numentities = 0;
+	s_keys.clear();
+	s_targetnames.clear();
+	s_targetnamesentities = -1;
+	s_targetnameschanged = true;
+	ArenaRelease(s_entityarena);
+	s_targetnamekey = InternKey("targetname");
+}
+
+// =====================================================================================
+//  ParseEpair
+//      entity key/value pairs, the key is the current token
+// =====================================================================================
+void ParseEpair(ScriptReader &reader, std::string_view &key, std::string_view &value)
+{
+	if (reader.tokenlength >= MAX_KEY - 1)
+		Error("ParseEpair: Key token too long (%i > MAX_KEY)", reader.tokenlength);
 
-	if (strlen(g_token) >= MAX_VAL - 1) // MAX_VALUE //vluzacn
-		Error("ParseEpar: Value token too long (%i > MAX_VALUE)", (int)strlen(g_token));
+	key = std::string_view(reader.token, reader.tokenlength);
+	ReadToken(reader, false);
 
-	e->value = strdup(g_token);
+	if (reader.tokenlength >= MAX_VAL - 1) // MAX_VALUE //vluzacn
+		Error("ParseEpar: Value token too long (%i > MAX_VALUE)", reader.tokenlength);
 
-	return e;
+	value = std::string_view(reader.token, reader.tokenlength);
 }
 
 /*
@@ -966,17 +1041,16 @@ auto ParseEpair() -> EntityProperty *
  * ================
  */
 
-auto ParseEntity() -> bool
+static auto ParseEntity(ScriptReader &reader) -> bool
 {
-	EntityProperty *e;
 	Entity *mapent;
 
-	if (!GetToken(true))
+	if (!ReadToken(reader, true))
 	{
 		return false;
 	}
 
-	if (strcmp(g_token, "{"))
+	if (!TokenIs(reader, "{"))
 	{
 		Error("ParseEntity: { not found");
 	}
@@ -991,17 +1065,17 @@ auto ParseEntity() -> bool
 
 	while (true)
 	{
-		if (!GetToken(true))
+		if (!ReadToken(reader, true))
 		{
 			Error("ParseEntity: EOF without closing brace");
 		}
-		if (!strcmp(g_token, "}"))
+		if (TokenIs(reader, "}"))
 		{
 			break;
 		}
-		e = ParseEpair();
-		e->next = mapent->epairs;
-		mapent->epairs = e;
+		std::string_view key, value;
+		ParseEpair(reader, key, value);
+		AddEpair(mapent, InternKey(key), value);
 	}
 
 	// ugly code
@@ -1019,11 +1093,8 @@ auto ParseEntity() -> bool
 	if (!strcmp(ValueForKey(mapent, "classname"), "light_environment") &&
 		!strcmp(ValueForKey(mapent, "convertfrom"), "info_sunlight"))
 	{
-		while (mapent->epairs)
-		{
-			DeleteKey(mapent, mapent->epairs->key);
-		}
 		memset(mapent, 0, sizeof(Entity));
+		s_targetnameschanged = true;
 		g_numentities--;
 		return true;
 	}
@@ -1042,10 +1113,12 @@ auto ParseEntity() -> bool
 // =====================================================================================
 void ParseEntities()
 {
-	g_numentities = 0;
-	ParseFromMemory(g_bspentdata, g_bspentdatasize);
+	ScriptReader reader;
+
+	FreeEntities();
+	InitScriptReader(reader, g_bspentdata, g_bspentdatasize, 1);
 
-	while (ParseEntity())
+	while (ParseEntity(reader))
 	{
 	}
 }
@@ -1103,12 +1176,21 @@ auto anglesforvector(float angles[3], const float vector[3]) -> int
 	angles[2] = 0;
 	return 0;
 }
+static inline void AppendEntityText(char *&end, const char *const buf, const char *const text, size_t length)
+{
+	if (end + length >= buf + MAX_MAP_ENTSTRING)
+	{
+		Error("Entity text too long");
+	}
+	memcpy(end, text, length);
+	end += length;
+}
+
 void UnparseEntities()
 {
 	char *buf;
 	char *end;
 	EntityProperty *ep;
-	char line[MAXTOKEN];
 	int i;
 
 	buf = g_bspentdata;
@@ -1247,23 +1329,18 @@ void UnparseEntities()
 			continue; // ent got removed
 		}
 
-		strcat(end, "{\n");
-		end += 2;
-
-		for (ep = g_entities[i].epairs; ep; ep = ep->next)
+		AppendEntityText(end, buf, "{\n", 2);
+		for (; ep; ep = ep->next)
 		{
-			sprintf(line, "\"%s\" \"%s\"\n", ep->key, ep->value);
-			strcat(end, line);
-			end += strlen(line);
-		}
-		strcat(end, "}\n");
-		end += 2;
-
-		if (end > buf + MAX_MAP_ENTSTRING)
-		{
-			Error("Entity text too long");
+			AppendEntityText(end, buf, "\"", 1);
+			AppendEntityText(end, buf, ep->key, strlen(ep->key));
+			AppendEntityText(end, buf, "\" \"", 3);
+			AppendEntityText(end, buf, ep->value, strlen(ep->value));
+			AppendEntityText(end, buf, "\"\n", 2);
 		}
+		AppendEntityText(end, buf, "}\n", 2);
 	}
+	*end = '\0';
 	g_bspentdatasize = end - buf + 1;
 }
 
@@ -1271,46 +1348,58 @@ void UnparseEntities()
 //  SetKeyValue
 //      makes a keyvalue
 // =====================================================================================
-void DeleteKey(Entity *ent, const char *const key)
+static void DeleteEpair(Entity *ent, const char *const atom)
 {
-	EntityProperty **pep;
-	for (pep = &ent->epairs; *pep; pep = &(*pep)->next)
+	for (EntityProperty **pep = &ent->epairs; *pep; pep = &(*pep)->next)
 	{
-		if (!strcmp((*pep)->key, key))
+		if ((*pep)->key == atom)
 		{
-			EntityProperty *ep = *pep;
-			*pep = ep->next;
-			delete ep->key;
-			delete ep->value;
-			delete ep;
+			*pep = (*pep)->next;
+			if (atom == s_targetnamekey)
+			{
+				s_targetnameschanged = true;
+			}
 			return;
 		}
 	}
 }
+void DeleteKey(Entity *ent, const char *const key)
+{
+	const char *atom = FindKey(key);
+	if (atom)
+	{
+		DeleteEpair(ent, atom);
+	}
+}
 void SetKeyValue(Entity *ent, const char *const key, const char *const value)
 {
-	EntityProperty *ep;
-
-	if (!value[0])
+	SetKeyValue(ent, std::string_view(key), std::string_view(value));
+}
+void SetKeyValue(Entity *ent, std::string_view key, std::string_view value)
+{
+	if (value.empty())
 	{
-		DeleteKey(ent, key);
+		const char *atom = FindKey(key);
+		if (atom)
+		{
+			DeleteEpair(ent, atom);
+		}
 		return;
 	}
-	for (ep = ent->epairs; ep; ep = ep->next)
+	const char *atom = InternKey(key);
+	for (EntityProperty *ep = ent->epairs; ep; ep = ep->next)
 	{
-		if (!strcmp(ep->key, key))
+		if (ep->key == atom)
 		{
-			char *value2 = strdup(value);
-			delete ep->value;
-			ep->value = value2;
+			ep->value = ArenaStrdup(s_entityarena, value.data(), value.size());
+			if (atom == s_targetnamekey)
+			{
+				s_targetnameschanged = true;
+			}
 			return;
 		}
 	}
-	ep = (EntityProperty *)Alloc(sizeof(*ep));
-	ep->next = ent->epairs;
-	ent->epairs = ep;
-	ep->key = strdup(key);
-	ep->value = strdup(value);
+	AddEpair(ent, atom, value);
 }
 
 // =====================================================================================
@@ -1319,11 +1408,18 @@ void SetKeyValue(Entity *ent, const char *const key, const char *const value)
 // =====================================================================================
 auto ValueForKey(const Entity *const ent, const char *const key) -> const char *
 {
-	EntityProperty *ep;
-
-	for (ep = ent->epairs; ep; ep = ep->next)
+	if (!ent->epairs)
 	{
-		if (!strcmp(ep->key, key))
+		return "";
+	}
+	const char *atom = FindKey(key);
+	if (!atom)
+	{
+		return "";
+	}
+	for (EntityProperty *ep = ent->epairs; ep; ep = ep->next)
+	{
+		if (ep->key == atom)
 		{
 			return ep->value;
 		}
@@ -1371,19 +1467,22 @@ void GetVectorForKey(const Entity *const ent, const char *const key, vec3_t vec)
 // =====================================================================================
 auto FindTargetEntity(const char *const target) -> Entity *
 {
-	int i;
-	const char *n;
-
-	for (i = 0; i < g_numentities; i++)
+	auto it = s_targetnames.find(target);
+	if (s_targetnameschanged || s_targetnamesentities != g_numentities ||
+		(it != s_targetnames.end() && strcmp(ValueForKey(&g_entities[it->second], "targetname"), target)))
 	{
-		n = ValueForKey(&g_entities[i], "targetname");
-		if (!strcmp(n, target))
+		// entities were added, removed or renamed since the last lookup
+		s_targetnames.clear();
+		for (int i = 0; i < g_numentities; i++)
 		{
-			return &g_entities[i];
+			const char *n = ValueForKey(&g_entities[i], "targetname");
+			s_targetnames.emplace(n, i);
 		}
+		s_targetnamesentities = g_numentities;
+		s_targetnameschanged = false;
+		it = s_targetnames.find(target);
 	}
-
-	return nullptr;
+	return it != s_targetnames.end() ? &g_entities[it->second] : nullptr;
 }
 
 void dtexdata_init()
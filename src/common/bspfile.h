@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string_view>
+
 // upper design bounds
 
 constexpr int MAX_MAP_HULLS = 4;
@@ -342,10 +344,12 @@ extern void DeleteEmbeddedLightmaps();
 //
 // Entity Related Stuff
 //
+struct ScriptReader;
+
 struct EntityProperty
 {
     struct EntityProperty *next;
-    char *key;
+    const char *key; // interned by InternKey, compare with == against other interned keys
     char *value;
 };
 
@@ -363,15 +367,20 @@ extern Entity g_entities[MAX_MAP_ENTITIES];
 extern void ParseEntities();
 extern void UnparseEntities();
 
+extern auto InternKey(std::string_view key) -> const char *;
+extern auto FindKey(std::string_view key) -> const char *;
+extern void FreeEntities();
+
 extern void DeleteKey(Entity *ent, const char *const key);
 extern void SetKeyValue(Entity *ent, const char *const key, const char *const value);
+extern void SetKeyValue(Entity *ent, std::string_view key, std::string_view value);
 extern auto ValueForKey(const Entity *const ent, const char *const key) -> const char *;
 extern auto IntForKey(const Entity *const ent, const char *const key) -> int;
 extern auto FloatForKey(const Entity *const ent, const char *const key) -> vec_t;
 extern void GetVectorForKey(const Entity *const ent, const char *const key, vec3_t vec);
 
 extern auto FindTargetEntity(const char *const target) -> Entity *;
-extern auto ParseEpair() -> EntityProperty *;
+extern void ParseEpair(ScriptReader &reader, std::string_view &key, std::string_view &value);
 extern auto EntityForModel(int modnum) -> Entity *;
 
 //
@@ -22,7 +22,7 @@
 
 #define SDHLT_VERSIONSTRING "v1.2.0"
 
-#if !defined(SCSG) && !defined(SBSP) && !defined(SVIS) && !defined(SRAD) // seedee
+#if !defined(SCSG) && !defined(SBSP) && !defined(SVIS) && !defined(SRAD) && !defined(SCOMPILE) // seedee
 #error "You must define one of these in the settings of each project: SDHLCSG, SDHLBSP, SDHLVIS, SDHLRAD. The most likely cause is that you didn't load the project from the .sln file."
 #endif
 
@@ -0,0 +1,115 @@
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "hullio.h"
+#include "cmdlib.h"
+#include "filelib.h"
+#include "log.h"
+
+// =====================================================================================
+//  WriteHullFileHeader
+// =====================================================================================
+void WriteHullFileHeader(FILE *f)
+{
+    HullFileHeader header;
+    header.magic = HULLFILE_MAGIC;
+    header.version = HULLFILE_VERSION;
+    SafeWrite(f, &header, sizeof(header));
+}
+
+// =====================================================================================
+//  OpenHullFile
+//      maps the whole file read-only and checks the header
+// =====================================================================================
+void OpenHullFile(HullFile &file, const char *const name)
+{
+    safe_strncpy(file.name, name, _MAX_PATH);
+    file.data = nullptr;
+    file.size = 0;
+    file.pos = 0;
+
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+    {
+        Error("Can't open %s", name);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        Error("Can't stat %s", name);
+    }
+    file.size = st.st_size;
+    if (file.size < sizeof(HullFileHeader))
+    {
+        close(fd);
+        Error("%s is not a hull file", name);
+    }
+    void *data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        Error("Can't map %s", name);
+    }
+    madvise(data, file.size, MADV_SEQUENTIAL);
+    file.data = (const byte *)data;
+
+    HullFileHeader header;
+    HullFileRead(file, &header, sizeof(header));
+    if (header.magic != HULLFILE_MAGIC)
+    {
+        Error("%s is not a hull file (written by an older sCSG?)", name);
+    }
+    if (header.version != HULLFILE_VERSION)
+    {
+        Error("%s has hull file version %u, expected %u", name, header.version, HULLFILE_VERSION);
+    }
+}
+
+// =====================================================================================
+//  CloseHullFile
+// =====================================================================================
+void CloseHullFile(HullFile &file)
+{
+    if (file.data)
+    {
+        munmap((void *)file.data, file.size);
+    }
+    file.data = nullptr;
+    file.size = 0;
+    file.pos = 0;
+}
+
+// =====================================================================================
+//  HullFileRead
+//      returns false at a clean end of file, a truncated record is an error
+// =====================================================================================
+auto HullFileRead(HullFile &file, void *dest, size_t size) -> bool
+{
+    if (file.pos == file.size)
+    {
+        return false;
+    }
+    if (size > file.size - file.pos)
+    {
+        Error("%s: unexpected end of file at offset %zu", file.name, file.pos);
+    }
+    memcpy(dest, file.data + file.pos, size);
+    file.pos += size;
+    return true;
+}
+
+// =====================================================================================
+//  HullFileReadPoints
+// =====================================================================================
+void HullFileReadPoints(HullFile &file, double (*points)[3], int numpoints)
+{
+    if (numpoints > 0 && !HullFileRead(file, points, numpoints * sizeof(double[3])))
+    {
+        Error("%s: unexpected end of file at offset %zu", file.name, file.pos);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include "mathtypes.h"
+#include "win32fix.h"
+
+// Binary layout of the .p0-.p3 (faces) and .b0-.b3 (detail brushes) files
+// that sCSG hands to sBSP. Every file starts with a HullFileHeader.
+//
+// .pN: per model, a list of HullFaceRecord, each followed by numpoints
+//      double[3]; a record with planenum == -1 ends the model.
+// .bN: per model, a list of brushes, each an int32 0 followed by
+//      HullSideRecord + numpoints double[3] per side and a side with
+//      planenum == -1; an int32 -1 ends the model.
+
+constexpr uint32_t HULLFILE_MAGIC = ('H' | ('U' << 8) | ('L' << 16) | ('L' << 24));
+constexpr uint32_t HULLFILE_VERSION = 1;
+
+struct HullFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct HullFaceRecord
+{
+    int32_t detaillevel;
+    int32_t planenum;
+    int32_t texinfo;
+    int32_t contents;
+    int32_t numpoints;
+};
+
+struct HullSideRecord
+{
+    int32_t planenum;
+    int32_t numpoints;
+};
+
+struct HullFile
+{
+    const byte *data; // whole file, memory mapped
+    size_t size;
+    size_t pos;
+    char name[_MAX_PATH];
+};
+
+extern void WriteHullFileHeader(FILE *f);
+
+extern void OpenHullFile(HullFile &file, const char *const name);
+extern void CloseHullFile(HullFile &file);
+extern auto HullFileRead(HullFile &file, void *dest, size_t size) -> bool;
+extern void HullFileReadPoints(HullFile &file, double (*points)[3], int numpoints);
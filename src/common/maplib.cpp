@@ -1,3 +1,7 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <cstring>
 #include <cstdlib>
 
@@ -7,171 +11,194 @@
 #include "log.h"
 #include "maplib.h"
 
-char g_token[MAXTOKEN];
-
-struct FileData
+// =====================================================================================
+//  OpenScriptFile
+// =====================================================================================
+void OpenScriptFile(ScriptFile &file, const char *const name)
 {
-    char fileName[_MAX_PATH];
-    char *fileBuffer;
-    char *currentPosition;
-    char *bufferEnd;
-    int currentLine;
-};
+    safe_strncpy(file.name, name, _MAX_PATH);
+    file.data = "";
+    file.size = 0;
 
-static FileData currentFile;
-int currentLine;
-bool isEndOfFile;
-bool isTokenReady; // only true if UnGetToken was just called
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+    {
+        Error("Can't open %s", name);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        Error("Can't stat %s", name);
+    }
+    file.size = st.st_size;
+    if (file.size == 0)
+    {
+        close(fd);
+        return;
+    }
+    void *data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        Error("Can't map %s", name);
+    }
+    madvise(data, file.size, MADV_SEQUENTIAL);
+    file.data = (const char *)data;
+}
 
-void LoadMapFileData(const char *const fileName)
+// =====================================================================================
+//  CloseScriptFile
+// =====================================================================================
+void CloseScriptFile(ScriptFile &file)
 {
-    int size;
-
-    strcpy(currentFile.fileName, fileName);
-
-    size = LoadFile(currentFile.fileName, (char **)&currentFile.fileBuffer);
-
-    Log("Loading %s\n", currentFile.fileName);
-
-    currentFile.currentLine = 1;
-    currentFile.currentPosition = currentFile.fileBuffer;
-    currentFile.bufferEnd = currentFile.fileBuffer + size;
-
-    isEndOfFile = false;
-    isTokenReady = false;
+    if (file.size)
+    {
+        munmap((void *)file.data, file.size);
+    }
+    file.data = "";
+    file.size = 0;
 }
 
-void ParseFromMemory(char *buffer, const int size)
+// =====================================================================================
+//  InitScriptReader
+//      line is the line number of data[0]
+// =====================================================================================
+void InitScriptReader(ScriptReader &reader, const char *const data, size_t size, int line)
 {
-    strcpy(currentFile.fileName, "memory buffer");
-
-    currentFile.fileBuffer = buffer;
-    currentFile.currentLine = 1;
-    currentFile.currentPosition = currentFile.fileBuffer;
-    currentFile.bufferEnd = currentFile.fileBuffer + size;
-
-    isEndOfFile = false;
-    isTokenReady = false;
+    reader.position = data;
+    reader.end = data + size;
+    reader.line = line;
+    reader.tokenready = false;
+    reader.token = data;
+    reader.tokenlength = 0;
+    reader.tokenquoted = false;
 }
 
-void UnGetToken()
+static inline auto IsScriptSpace(char c) -> bool
 {
-    isTokenReady = true;
+    return (unsigned char)c <= 32;
 }
 
-auto EndOfFile(const bool crossline) -> bool
+static auto EndOfScript(const ScriptReader &reader, bool crossline) -> bool
 {
     if (!crossline)
-        Error("Line %i is incomplete (did you place a \" inside an entity string?) \n", currentLine);
-
-    if (!strcmp(currentFile.fileName, "memory buffer"))
     {
-        isEndOfFile = true;
-        return false;
+        Error("Line %i is incomplete (did you place a \" inside an entity string?) \n", reader.line);
     }
-
-    delete currentFile.fileBuffer;
-
-    isEndOfFile = true;
     return false;
 }
 
-auto GetToken(const bool crossline) -> bool
+// =====================================================================================
+//  ReadToken
+//      whitespace and // comments separate tokens, a token in quotes runs to the
+//      closing quote. Without crossline the token has to be on the current line.
+// =====================================================================================
+auto ReadToken(ScriptReader &reader, bool crossline) -> bool
 {
-    char *token_p;
-
-    if (isTokenReady)
+    if (reader.tokenready)
     {
-        isTokenReady = false;
+        reader.tokenready = false;
         return true;
     }
 
-    if (currentFile.currentPosition >= currentFile.bufferEnd)
-        return EndOfFile(crossline);
+    const char *p = reader.position;
+    const char *const end = reader.end;
 
-skipspace:
-    while (*currentFile.currentPosition <= 32 && *currentFile.currentPosition >= 0)
+    while (true)
     {
-        if (currentFile.currentPosition >= currentFile.bufferEnd)
-            return EndOfFile(crossline);
-
-        if (*currentFile.currentPosition++ == '\n')
+        while (p < end && IsScriptSpace(*p))
         {
-            if (!crossline)
-                Error("Line %i is incomplete (did you place a \" inside an entity string?) \n", currentLine);
-            currentLine = currentFile.currentLine++;
+            if (*p++ == '\n')
+            {
+                if (!crossline)
+                {
+                    Error("Line %i is incomplete (did you place a \" inside an entity string?) \n", reader.line);
+                }
+                reader.line++;
+            }
+        }
+        if (p >= end)
+        {
+            reader.position = p;
+            return EndOfScript(reader, crossline);
+        }
+        if (p[0] != '/' || p + 1 >= end || p[1] != '/')
+        {
+            break;
         }
-    }
-
-    if (currentFile.currentPosition >= currentFile.bufferEnd)
-        return EndOfFile(crossline);
-
-    if (*currentFile.currentPosition == '/' && *((currentFile.currentPosition) + 1) == '/')
-    {
         if (!crossline)
-            Error("Line %i is incomplete (did you place a \" inside an entity string?) \n", currentLine);
-
-        currentFile.currentPosition++;
-        while (*currentFile.currentPosition++ != '\n')
         {
-            if (currentFile.currentPosition >= currentFile.bufferEnd)
-                return EndOfFile(crossline);
+            Error("Line %i is incomplete (did you place a \" inside an entity string?) \n", reader.line);
+        }
+        p = (const char *)memchr(p, '\n', end - p);
+        if (!p)
+        {
+            reader.position = end;
+            return false;
         }
-        currentLine = currentFile.currentLine++;
-        goto skipspace;
     }
 
-    token_p = g_token;
-
-    if (*currentFile.currentPosition == '"')
+    const char *start;
+    if (*p == '"')
     {
-        currentFile.currentPosition++;
-        while (*currentFile.currentPosition != '"')
+        start = ++p;
+        const char *close = (const char *)memchr(p, '"', end - p);
+        p = close ? close : end;
+        reader.tokenquoted = true;
+        reader.token = start;
+        reader.tokenlength = p - start;
+        for (const char *c = start; (c = (const char *)memchr(c, '\n', p - c)) != nullptr; c++)
         {
-            *token_p++ = *currentFile.currentPosition++;
-
-            if (currentFile.currentPosition == currentFile.bufferEnd)
-                break;
-
-            if (token_p == &g_token[MAXTOKEN])
-                Error("Token too large on line %i\n", currentLine);
+            reader.line++;
+        }
+        if (p < end)
+        {
+            p++;
         }
-        currentFile.currentPosition++;
     }
     else
     {
-        while ((*currentFile.currentPosition > 32 || *currentFile.currentPosition < 0))
+        start = p;
+        while (p < end && !IsScriptSpace(*p))
         {
-            *token_p++ = *currentFile.currentPosition++;
-
-            if (currentFile.currentPosition == currentFile.bufferEnd)
-                break;
-
-            if (token_p == &g_token[MAXTOKEN])
-                Error("Token too large on line %i\n", currentLine);
+            p++;
         }
+        reader.tokenquoted = false;
+        reader.token = start;
+        reader.tokenlength = p - start;
+    }
+    if (reader.tokenlength >= MAXTOKEN)
+    {
+        Error("Token too large on line %i\n", reader.line);
     }
 
-    *token_p = 0;
+    reader.position = p;
     return true;
 }
 
-auto TokenAvailable() -> bool
+// =====================================================================================
+//  UnreadToken
+//      the next ReadToken returns the current token again
+// =====================================================================================
+void UnreadToken(ScriptReader &reader)
 {
-    char *search_p = currentFile.currentPosition;
-
-    if (search_p >= currentFile.bufferEnd)
-        return false;
-
-    while (*search_p <= 32)
-    {
-        if (*search_p == '\n')
-            return false;
+    reader.tokenready = true;
+}
 
-        search_p++;
+// =====================================================================================
+//  TokenIs
+// =====================================================================================
+auto TokenIs(const ScriptReader &reader, const char *const text) -> bool
+{
+    return strlen(text) == (size_t)reader.tokenlength && !memcmp(reader.token, text, reader.tokenlength);
+}
 
-        if (search_p == currentFile.bufferEnd)
-            return false;
-    }
-    return true;
-}
\ No newline at end of file
+// =====================================================================================
+//  CopyToken
+// =====================================================================================
+void CopyToken(const ScriptReader &reader, char *dest)
+{
+    memcpy(dest, reader.token, reader.tokenlength);
+    dest[reader.tokenlength] = '\0';
+}
@@ -3,15 +3,38 @@
 #include "cmdlib.h"
 
 constexpr int MAXTOKEN = 4096;
-extern char g_token[MAXTOKEN];
 
 constexpr int MAX_WAD_PATHS = 42;
 extern char g_szWadPaths[MAX_WAD_PATHS][_MAX_PATH];
 extern int g_iNumWadPaths;
 
-extern void LoadMapFileData(const char *const filename);
-extern void ParseFromMemory(char *buffer, int size);
+// A script file, memory mapped read-only
+struct ScriptFile
+{
+    char name[_MAX_PATH];
+    const char *data;
+    size_t size;
+};
 
-extern auto GetToken(bool crossline) -> bool;
-extern void UnGetToken();
-extern auto TokenAvailable() -> bool;
\ No newline at end of file
+// Tokenizer over a part of a script in memory. The current token is a view
+// into the script, token[0..tokenlength), so any number of readers can work
+// on different parts of one mapped file at the same time.
+struct ScriptReader
+{
+    const char *position;
+    const char *end;
+    int line;
+    bool tokenready; // UnreadToken was just called
+    const char *token;
+    int tokenlength;
+    bool tokenquoted;
+};
+
+extern void OpenScriptFile(ScriptFile &file, const char *const name);
+extern void CloseScriptFile(ScriptFile &file);
+
+extern void InitScriptReader(ScriptReader &reader, const char *const data, size_t size, int line);
+extern auto ReadToken(ScriptReader &reader, bool crossline) -> bool;
+extern void UnreadToken(ScriptReader &reader);
+extern auto TokenIs(const ScriptReader &reader, const char *const text) -> bool;
+extern void CopyToken(const ScriptReader &reader, char *dest); // dest holds MAXTOKEN chars
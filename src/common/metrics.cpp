@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <vector>
+#include <string>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "cmdlib.h"
+#include "log.h"
+#include "threads.h"
+#include "metrics.h"
+
+struct PhaseMetrics
+{
+    std::string name;
+    int items;
+    double wall;       // seconds
+    double cpu;        // user + system seconds of all threads
+    double lockwait;   // seconds spent blocked in ThreadLock, summed over threads
+    long peak_rss_kb;  // process high-water mark when the phase ended
+};
+
+static std::vector<PhaseMetrics> phases;
+static PhaseMetrics current;
+static double phase_start_wall = 0;
+static double phase_start_cpu = 0;
+static double start_wall = 0;
+static double start_cpu = 0;
+static bool started = false;
+
+static auto CPUTime(long *peak_rss_kb = nullptr) -> double
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    if (peak_rss_kb)
+    {
+        *peak_rss_kb = usage.ru_maxrss;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+// =====================================================================================
+//  MetricsStart
+//      Call once g_Mapname is known
+// =====================================================================================
+void MetricsStart()
+{
+    start_wall = I_FloatTime();
+    start_cpu = CPUTime();
+    started = true;
+}
+
+// =====================================================================================
+//  MetricsBeginPhase / MetricsEndPhase
+//      Bracket one RunThreadsOn or RunTasks call
+// =====================================================================================
+void MetricsBeginPhase(const char *const name, int items)
+{
+    current.name = name;
+    current.items = items;
+    phase_start_wall = I_FloatTime();
+    phase_start_cpu = CPUTime();
+}
+
+void MetricsEndPhase(double lockwait, int items)
+{
+    if (items >= 0)
+    {
+        current.items = items;
+    }
+    current.wall = I_FloatTime() - phase_start_wall;
+    current.cpu = CPUTime(&current.peak_rss_kb) - phase_start_cpu;
+    current.lockwait = lockwait;
+    phases.push_back(current);
+}
+
+static void WriteJSONString(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        auto c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            fprintf(f, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(f, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// =====================================================================================
+//  MetricsWriteReport
+//      Meant for atexit(), so an aborted compile still reports the phases it finished
+// =====================================================================================
+void MetricsWriteReport()
+{
+    char filename[_MAX_PATH];
+    long peak_rss_kb;
+
+    if (!started)
+    {
+        return;
+    }
+    started = false;
+
+    auto wall = I_FloatTime() - start_wall;
+    auto cpu = CPUTime(&peak_rss_kb) - start_cpu;
+
+    safe_snprintf(filename, _MAX_PATH, "%s.%s.json", g_Mapname, g_Program.c_str());
+    auto *f = fopen(filename, "w");
+    if (!f)
+    {
+        Warning("Could not write metrics report %s", filename);
+        return;
+    }
+
+    fprintf(f, "{\n  \"program\": ");
+    WriteJSONString(f, g_Program.c_str());
+    fprintf(f, ",\n  \"map\": ");
+    WriteJSONString(f, g_Mapname);
+    fprintf(f, ",\n  \"version\": \"" SDHLT_VERSIONSTRING "\",\n");
+    fprintf(f, "  \"threads\": %d,\n", g_numthreads);
+    fprintf(f, "  \"wall_seconds\": %.6f,\n", wall);
+    fprintf(f, "  \"cpu_seconds\": %.6f,\n", cpu);
+    fprintf(f, "  \"peak_rss_kb\": %ld,\n", peak_rss_kb);
+    fprintf(f, "  \"phases\": [");
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        const auto &p = phases[i];
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        WriteJSONString(f, p.name.c_str());
+        fprintf(f, ", \"items\": %d, \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"lock_wait_seconds\": %.6f, \"peak_rss_kb\": %ld}",
+                p.items, p.wall, p.cpu, p.lockwait, p.peak_rss_kb);
+    }
+    fprintf(f, "%s]\n}\n", phases.empty() ? "" : "\n  ");
+    fclose(f);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+//
+// metrics.cpp: per-phase timing and counters, written as <mapname>.<program>.json at exit
+//
+
+extern void MetricsStart();
+extern void MetricsBeginPhase(const char *const name, int items);
+extern void MetricsEndPhase(double lockwait, int items = -1); // items >= 0 replaces the count given at the beginning
+extern void MetricsWriteReport();
@@ -0,0 +1,326 @@
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "planeside.h"
+#include "mathlib.h"
+
+constexpr vec_t RANGE_START = 1e30f; // DistanceRanges: any point is closer
+
+// =====================================================================================
+//  ClassifyPointsScalar
+//      also finishes the points left over by the vector loops
+// =====================================================================================
+static void ClassifyPointsScalar(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t epsilon, vec_t *dists, int *sides, int counts[3])
+{
+    for (int i = 0; i < numpoints; i++)
+    {
+        vec_t dot = DotProduct(points[i], normal);
+        dot -= dist;
+        dists[i] = dot;
+        if (dot > epsilon)
+        {
+            sides[i] = 0;
+        }
+        else if (dot < -epsilon)
+        {
+            sides[i] = 1;
+        }
+        else
+        {
+            sides[i] = 2;
+        }
+        counts[sides[i]]++;
+    }
+}
+
+// =====================================================================================
+//  DistanceRangeScalar
+//      low and high are already set, the points are added to them
+// =====================================================================================
+static void DistanceRangeScalar(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t &low, vec_t &high)
+{
+    for (int i = 0; i < numpoints; i++)
+    {
+        vec_t dot = DotProduct(points[i], normal);
+        dot -= dist;
+        low = qmin(low, dot);
+        high = qmax(high, dot);
+    }
+}
+
+#if !defined(__SSE2__) || !defined(DOUBLEVEC_T)
+static void DistanceRangesScalar(const vec3_t *const *points, const int *numpoints, int count, const vec3_t normal, vec_t dist, vec_t *lows, vec_t *highs)
+{
+    for (int i = 0; i < count; i++)
+    {
+        lows[i] = RANGE_START;
+        highs[i] = -RANGE_START;
+        DistanceRangeScalar(points[i], numpoints[i], normal, dist, lows[i], highs[i]);
+    }
+}
+#endif
+
+#if defined(__SSE2__)
+// =====================================================================================
+//  StoreSides
+//      front and back are comparison bit masks, one bit per point
+// =====================================================================================
+static inline void StoreSides(int front, int back, int numpoints, int *sides, int counts[3])
+{
+    back &= ~front;
+    for (int j = 0; j < numpoints; j++)
+    {
+        sides[j] = 2 - 2 * ((front >> j) & 1) - ((back >> j) & 1);
+    }
+    counts[0] += __builtin_popcount(front);
+    counts[1] += __builtin_popcount(back);
+    counts[2] += numpoints - __builtin_popcount(front | back);
+}
+
+#ifdef DOUBLEVEC_T
+// =====================================================================================
+//  ClassifyPointsSSE2
+//      two points at a time: [x0 y0] [z0 x1] [y1 z1] -> [x0 x1] [y0 y1] [z0 z1]
+// =====================================================================================
+static void ClassifyPointsSSE2(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t epsilon, vec_t *dists, int *sides, int counts[3])
+{
+    const __m128d nx = _mm_set1_pd(normal[0]);
+    const __m128d ny = _mm_set1_pd(normal[1]);
+    const __m128d nz = _mm_set1_pd(normal[2]);
+    const __m128d d = _mm_set1_pd(dist);
+    const __m128d front = _mm_set1_pd(epsilon);
+    const __m128d back = _mm_set1_pd(-epsilon);
+
+    int i = 0;
+    for (; i + 2 <= numpoints; i += 2)
+    {
+        const double *p = points[i];
+        __m128d a = _mm_loadu_pd(p);
+        __m128d b = _mm_loadu_pd(p + 2);
+        __m128d c = _mm_loadu_pd(p + 4);
+        __m128d x = _mm_shuffle_pd(a, b, 2);
+        __m128d y = _mm_shuffle_pd(a, c, 1);
+        __m128d z = _mm_shuffle_pd(b, c, 2);
+        __m128d dot = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x, nx), _mm_mul_pd(y, ny)), _mm_mul_pd(z, nz)), d);
+        _mm_storeu_pd(dists + i, dot);
+        StoreSides(_mm_movemask_pd(_mm_cmpgt_pd(dot, front)), _mm_movemask_pd(_mm_cmplt_pd(dot, back)), 2, sides + i, counts);
+    }
+    ClassifyPointsScalar(points + i, numpoints - i, normal, dist, epsilon, dists + i, sides + i, counts);
+}
+
+// =====================================================================================
+//  ClassifyPointsAVX
+//      four points at a time, two per 128 bit lane, transposed like the SSE2 version
+// =====================================================================================
+__attribute__((target("avx"))) static void ClassifyPointsAVX(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t epsilon, vec_t *dists, int *sides, int counts[3])
+{
+    const __m256d nx = _mm256_set1_pd(normal[0]);
+    const __m256d ny = _mm256_set1_pd(normal[1]);
+    const __m256d nz = _mm256_set1_pd(normal[2]);
+    const __m256d d = _mm256_set1_pd(dist);
+    const __m256d front = _mm256_set1_pd(epsilon);
+    const __m256d back = _mm256_set1_pd(-epsilon);
+
+    int i = 0;
+    for (; i + 4 <= numpoints; i += 4)
+    {
+        const double *p = points[i];
+        __m256d a = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p)), _mm_loadu_pd(p + 6), 1);
+        __m256d b = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p + 2)), _mm_loadu_pd(p + 8), 1);
+        __m256d c = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p + 4)), _mm_loadu_pd(p + 10), 1);
+        __m256d x = _mm256_shuffle_pd(a, b, 0xA);
+        __m256d y = _mm256_shuffle_pd(a, c, 0x5);
+        __m256d z = _mm256_shuffle_pd(b, c, 0xA);
+        __m256d dot = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, nx), _mm256_mul_pd(y, ny)), _mm256_mul_pd(z, nz)), d);
+        _mm256_storeu_pd(dists + i, dot);
+        StoreSides(_mm256_movemask_pd(_mm256_cmp_pd(dot, front, _CMP_GT_OQ)), _mm256_movemask_pd(_mm256_cmp_pd(dot, back, _CMP_LT_OQ)), 4, sides + i, counts);
+    }
+    ClassifyPointsSSE2(points + i, numpoints - i, normal, dist, epsilon, dists + i, sides + i, counts);
+}
+
+// =====================================================================================
+//  DistanceRangesSSE2
+//      two points at a time, transposed like ClassifyPointsSSE2
+// =====================================================================================
+static void DistanceRangesSSE2(const vec3_t *const *points, const int *numpoints, int count, const vec3_t normal, vec_t dist, vec_t *lows, vec_t *highs)
+{
+    const __m128d nx = _mm_set1_pd(normal[0]);
+    const __m128d ny = _mm_set1_pd(normal[1]);
+    const __m128d nz = _mm_set1_pd(normal[2]);
+    const __m128d d = _mm_set1_pd(dist);
+
+    for (int f = 0; f < count; f++)
+    {
+        __m128d low = _mm_set1_pd(RANGE_START);
+        __m128d high = _mm_set1_pd(-RANGE_START);
+        int i = 0;
+        for (; i + 2 <= numpoints[f]; i += 2)
+        {
+            const double *p = points[f][i];
+            __m128d a = _mm_loadu_pd(p);
+            __m128d b = _mm_loadu_pd(p + 2);
+            __m128d c = _mm_loadu_pd(p + 4);
+            __m128d x = _mm_shuffle_pd(a, b, 2);
+            __m128d y = _mm_shuffle_pd(a, c, 1);
+            __m128d z = _mm_shuffle_pd(b, c, 2);
+            __m128d dot = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x, nx), _mm_mul_pd(y, ny)), _mm_mul_pd(z, nz)), d);
+            low = _mm_min_pd(low, dot);
+            high = _mm_max_pd(high, dot);
+        }
+        lows[f] = qmin(_mm_cvtsd_f64(low), _mm_cvtsd_f64(_mm_unpackhi_pd(low, low)));
+        highs[f] = qmax(_mm_cvtsd_f64(high), _mm_cvtsd_f64(_mm_unpackhi_pd(high, high)));
+        DistanceRangeScalar(points[f] + i, numpoints[f] - i, normal, dist, lows[f], highs[f]);
+    }
+}
+
+// =====================================================================================
+//  DistanceRangesAVX
+//      four points at a time, transposed like ClassifyPointsAVX
+// =====================================================================================
+__attribute__((target("avx"))) static void DistanceRangesAVX(const vec3_t *const *points, const int *numpoints, int count, const vec3_t normal, vec_t dist, vec_t *lows, vec_t *highs)
+{
+    const __m256d nx = _mm256_set1_pd(normal[0]);
+    const __m256d ny = _mm256_set1_pd(normal[1]);
+    const __m256d nz = _mm256_set1_pd(normal[2]);
+    const __m256d d = _mm256_set1_pd(dist);
+
+    for (int f = 0; f < count; f++)
+    {
+        __m256d low = _mm256_set1_pd(RANGE_START);
+        __m256d high = _mm256_set1_pd(-RANGE_START);
+        int i = 0;
+        for (; i + 4 <= numpoints[f]; i += 4)
+        {
+            const double *p = points[f][i];
+            __m256d a = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p)), _mm_loadu_pd(p + 6), 1);
+            __m256d b = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p + 2)), _mm_loadu_pd(p + 8), 1);
+            __m256d c = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p + 4)), _mm_loadu_pd(p + 10), 1);
+            __m256d x = _mm256_shuffle_pd(a, b, 0xA);
+            __m256d y = _mm256_shuffle_pd(a, c, 0x5);
+            __m256d z = _mm256_shuffle_pd(b, c, 0xA);
+            __m256d dot = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, nx), _mm256_mul_pd(y, ny)), _mm256_mul_pd(z, nz)), d);
+            low = _mm256_min_pd(low, dot);
+            high = _mm256_max_pd(high, dot);
+        }
+        __m128d low2 = _mm_min_pd(_mm256_castpd256_pd128(low), _mm256_extractf128_pd(low, 1));
+        __m128d high2 = _mm_max_pd(_mm256_castpd256_pd128(high), _mm256_extractf128_pd(high, 1));
+        lows[f] = qmin(_mm_cvtsd_f64(low2), _mm_cvtsd_f64(_mm_unpackhi_pd(low2, low2)));
+        highs[f] = qmax(_mm_cvtsd_f64(high2), _mm_cvtsd_f64(_mm_unpackhi_pd(high2, high2)));
+        DistanceRangeScalar(points[f] + i, numpoints[f] - i, normal, dist, lows[f], highs[f]);
+    }
+}
+
+#define ClassifyPointsSSE ClassifyPointsSSE2
+#define DistanceRangesSSE DistanceRangesSSE2
+#else
+// =====================================================================================
+//  ClassifyPointsSSE
+//      four points at a time: [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] -> [x0 x1 x2 x3] ...
+// =====================================================================================
+static void ClassifyPointsSSE(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t epsilon, vec_t *dists, int *sides, int counts[3])
+{
+    const __m128 nx = _mm_set1_ps(normal[0]);
+    const __m128 ny = _mm_set1_ps(normal[1]);
+    const __m128 nz = _mm_set1_ps(normal[2]);
+    const __m128 d = _mm_set1_ps(dist);
+    const __m128 front = _mm_set1_ps(epsilon);
+    const __m128 back = _mm_set1_ps(-epsilon);
+
+    int i = 0;
+    for (; i + 4 <= numpoints; i += 4)
+    {
+        const float *p = points[i];
+        __m128 a = _mm_loadu_ps(p);
+        __m128 b = _mm_loadu_ps(p + 4);
+        __m128 c = _mm_loadu_ps(p + 8);
+        __m128 x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 dot = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, nx), _mm_mul_ps(y, ny)), _mm_mul_ps(z, nz)), d);
+        _mm_storeu_ps(dists + i, dot);
+        StoreSides(_mm_movemask_ps(_mm_cmpgt_ps(dot, front)), _mm_movemask_ps(_mm_cmplt_ps(dot, back)), 4, sides + i, counts);
+    }
+    ClassifyPointsScalar(points + i, numpoints - i, normal, dist, epsilon, dists + i, sides + i, counts);
+}
+
+// =====================================================================================
+//  ClassifyPointsAVX
+//      eight points at a time, four per 128 bit lane, transposed like the SSE version
+// =====================================================================================
+__attribute__((target("avx"))) static void ClassifyPointsAVX(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t epsilon, vec_t *dists, int *sides, int counts[3])
+{
+    const __m256 nx = _mm256_set1_ps(normal[0]);
+    const __m256 ny = _mm256_set1_ps(normal[1]);
+    const __m256 nz = _mm256_set1_ps(normal[2]);
+    const __m256 d = _mm256_set1_ps(dist);
+    const __m256 front = _mm256_set1_ps(epsilon);
+    const __m256 back = _mm256_set1_ps(-epsilon);
+
+    int i = 0;
+    for (; i + 8 <= numpoints; i += 8)
+    {
+        const float *p = points[i];
+        __m256 a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
+        __m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+        __m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+        __m256 x = _mm256_shuffle_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 dot = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, nx), _mm256_mul_ps(y, ny)), _mm256_mul_ps(z, nz)), d);
+        _mm256_storeu_ps(dists + i, dot);
+        StoreSides(_mm256_movemask_ps(_mm256_cmp_ps(dot, front, _CMP_GT_OQ)), _mm256_movemask_ps(_mm256_cmp_ps(dot, back, _CMP_LT_OQ)), 8, sides + i, counts);
+    }
+    ClassifyPointsSSE(points + i, numpoints - i, normal, dist, epsilon, dists + i, sides + i, counts);
+}
+
+// only the double versions are vectorized, sBSP is the one that uses them
+#define DistanceRangesSSE DistanceRangesScalar
+#define DistanceRangesAVX DistanceRangesScalar
+#endif
+
+using ClassifyPointsFunc = void (*)(const vec3_t *, int, const vec3_t, vec_t, vec_t, vec_t *, int *, int[3]);
+
+static auto SelectClassifyPoints() -> ClassifyPointsFunc
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx") ? ClassifyPointsAVX : ClassifyPointsSSE;
+}
+
+static const ClassifyPointsFunc s_classifypoints = SelectClassifyPoints();
+
+using DistanceRangesFunc = void (*)(const vec3_t *const *, const int *, int, const vec3_t, vec_t, vec_t *, vec_t *);
+
+static auto SelectDistanceRanges() -> DistanceRangesFunc
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx") ? DistanceRangesAVX : DistanceRangesSSE;
+}
+
+static const DistanceRangesFunc s_distanceranges = SelectDistanceRanges();
+#endif
+
+// =====================================================================================
+//  ClassifyPoints
+// =====================================================================================
+void ClassifyPoints(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t epsilon, vec_t *dists, int *sides, int counts[3])
+{
+    counts[0] = counts[1] = counts[2] = 0;
+#if defined(__SSE2__)
+    s_classifypoints(points, numpoints, normal, dist, epsilon, dists, sides, counts);
+#else
+    ClassifyPointsScalar(points, numpoints, normal, dist, epsilon, dists, sides, counts);
+#endif
+}
+
+// =====================================================================================
+//  DistanceRanges
+// =====================================================================================
+void DistanceRanges(const vec3_t *const *points, const int *numpoints, int count, const vec3_t normal, vec_t dist, vec_t *lows, vec_t *highs)
+{
+#if defined(__SSE2__)
+    s_distanceranges(points, numpoints, count, normal, dist, lows, highs);
+#else
+    DistanceRangesScalar(points, numpoints, count, normal, dist, lows, highs);
+#endif
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "mathtypes.h"
+
+// Point/plane classification shared by Winding (CSG, BSP, RAD) and the VIS
+// fixed windings. Points are classified four (double) or eight (float) at a
+// time with AVX when the cpu has it, two or four at a time with SSE2
+// otherwise. Every distance is computed as DotProduct(point, normal) - dist in
+// that exact order and without fused multiply-adds, so the results match the
+// scalar code bit for bit.
+
+// dists[i] gets the signed distance of points[i], sides[i] 0 (front), 1 (back)
+// or 2 (on, within epsilon) - the SIDE_* values of winding.h and hlvis.h - and
+// counts[] how many points fell on each side.
+extern void ClassifyPoints(const vec3_t *points, int numpoints, const vec3_t normal, vec_t dist, vec_t epsilon, vec_t *dists, int *sides, int counts[3]);
+
+// For count point sets at once, lows[i] and highs[i] get the smallest and largest
+// signed distance of the numpoints[i] (at least one) points at points[i].
+// Vectorized for double vec_t only.
+extern void DistanceRanges(const vec3_t *const *points, const int *numpoints, int count, const vec3_t normal, vec_t dist, vec_t *lows, vec_t *highs);
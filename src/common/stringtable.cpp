@@ -0,0 +1,109 @@
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include "stringtable.h"
+#include "threads.h"
+
+StringTable::StringTable(int maxstrings, assume_msgs overflow, int hashsize)
+    : m_MaxStrings(maxstrings), m_Overflow(overflow), m_Count(0)
+{
+    int size = 1;
+    while (size < hashsize)
+    {
+        size <<= 1;
+    }
+    m_HashMask = size - 1;
+    m_Strings = new char *[maxstrings];
+    m_Next = new int[maxstrings];
+    m_Hash = new std::atomic<int>[size];
+    for (int i = 0; i < size; i++)
+    {
+        m_Hash[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+StringTable::~StringTable()
+{
+    Clear();
+    delete[] m_Strings;
+    delete[] m_Next;
+    delete[] m_Hash;
+}
+
+auto StringTable::Bucket(const char *const name) const -> int
+{
+    unsigned hash = 2166136261u; // FNV-1a over the lowercased name
+    for (const char *c = name; *c; c++)
+    {
+        hash = (hash ^ (unsigned char)tolower((unsigned char)*c)) * 16777619u;
+    }
+    return hash & m_HashMask;
+}
+
+auto StringTable::Find(const char *const name) const -> int
+{
+    int found = -1; // chains run newest first, Add may have been given a duplicate
+    for (int i = m_Hash[Bucket(name)].load(std::memory_order_acquire) - 1; i >= 0; i = m_Next[i] - 1)
+    {
+        if (!strcasecmp(m_Strings[i], name))
+        {
+            found = i;
+        }
+    }
+    return found;
+}
+
+auto StringTable::Add(const char *const name) -> int
+{
+    int index = m_Count.load(std::memory_order_relaxed);
+    hlassume(index < m_MaxStrings, m_Overflow);
+    int bucket = Bucket(name);
+    m_Strings[index] = strdup(name);
+    m_Next[index] = m_Hash[bucket].load(std::memory_order_relaxed);
+    m_Count.store(index + 1, std::memory_order_release);
+    m_Hash[bucket].store(index + 1, std::memory_order_release);
+    return index;
+}
+
+auto StringTable::Intern(const char *const name) -> int
+{
+    int index = Find(name);
+    if (index != -1)
+    {
+        return index;
+    }
+    ThreadLock();
+    index = Find(name); // another thread may have added it meanwhile
+    if (index == -1)
+    {
+        index = Add(name);
+    }
+    ThreadUnlock();
+    return index;
+}
+
+auto StringTable::Get(int index) const -> const char *
+{
+    hlassume(0 <= index && index < m_Count.load(std::memory_order_acquire), m_Overflow);
+    return m_Strings[index];
+}
+
+auto StringTable::Count() const -> int
+{
+    return m_Count.load(std::memory_order_acquire);
+}
+
+void StringTable::Clear()
+{
+    int count = m_Count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+    {
+        free(m_Strings[i]);
+    }
+    for (int i = 0; i <= m_HashMask; i++)
+    {
+        m_Hash[i].store(0, std::memory_order_relaxed);
+    }
+    m_Count.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+
+#include "messages.h"
+
+// Case-insensitive string interning: each distinct name (ignoring case) gets the next
+// index, and Get returns the spelling it was first added with.
+// Running out of room, or a bad index, stops with the assume message given at construction.
+// Find never blocks; Intern and Add must not race with each other, Intern takes
+// ThreadLock itself, Add expects the caller to hold it. Clear is not thread safe.
+class StringTable
+{
+public:
+    StringTable(int maxstrings, assume_msgs overflow, int hashsize = 4096);
+    ~StringTable();
+
+    auto Find(const char *const name) const -> int; // -1 if the name is not in the table
+    auto Intern(const char *const name) -> int;
+    auto Add(const char *const name) -> int;
+    auto Get(int index) const -> const char *;
+    auto Count() const -> int;
+    void Clear();
+
+private:
+    auto Bucket(const char *const name) const -> int;
+
+    int m_MaxStrings;
+    assume_msgs m_Overflow;
+    int m_HashMask;
+    char **m_Strings;
+    int *m_Next;              // next index + 1 in the same bucket
+    std::atomic<int> *m_Hash; // first index + 1 in each bucket, 0 = empty
+    std::atomic<int> m_Count;
+};
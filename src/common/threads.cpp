@@ -1,14 +1,21 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #include "cmdlib.h"
 #include "messages.h"
 #include "log.h"
 #include "threads.h"
 #include "blockmem.h"
+#include "metrics.h"
+#include "threadtrace.h"
 
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sched.h>
 #include <pthread.h>
+#include <atomic>
+#include <deque>
 
 #include "hlassert.h"
 
@@ -17,54 +24,87 @@ q_threadpriority g_threadpriority = DEFAULT_THREAD_PRIORITY;
 constexpr int THREADTIMES_SIZE = 100;
 constexpr float THREADTIMES_SIZEf = static_cast<float>(THREADTIMES_SIZE);
 
-static int dispatch = 0;
+// Target run time of one dispatched chunk. Short enough that the phase tail stays balanced,
+// long enough that the atomic hand-out is noise next to the work itself.
+constexpr double THREAD_CHUNK_SECONDS = 0.0002;
+constexpr int THREAD_CHUNK_MAX = 4096;
+// A chunk never takes more than 1/THREAD_CHUNK_SHARE of what is left per worker. Items may
+// get dearer along the work order (VIS portals do), and a chunk once taken can't be stolen.
+constexpr int THREAD_CHUNK_SHARE = 4;
+constexpr long REPORT_INTERVAL_NSEC = 100000000; // 0.1 sec
+
 static int workcount = 0;
 static int oldf = 0;
 static bool pacifier = false;
 static bool threaded = false;
 static double threadstart = 0;
 static double threadtimes[THREADTIMES_SIZE];
+static std::atomic<int> dispatch{0};
+static bool inorder = false;              // RunThreadsOnIndividualInOrder
+static std::atomic<int> nextinorder{0};
+
+// Per-worker deque of undispatched work: a half-open index range packed as (begin << 32 | end)
+// so both ends can be moved with a single compare-and-swap. The owning worker pops chunks from
+// the front, idle workers steal the back half.
+struct alignas(64) WorkRange
+{
+    std::atomic<uint64_t> bounds;
+};
 
-auto GetThreadWork() -> int
+static WorkRange workranges[MAX_THREADS];
+static int numworkers = 0;
+
+static thread_local int t_threadnum = 0;
+static thread_local int t_chunkbegin = 0;
+static thread_local int t_chunkend = 0;
+static thread_local int t_chunksize = 0;
+static thread_local double t_chunkstart = 0;
+static thread_local double t_itemcost = 0; // running estimate of seconds per work item
+
+static inline auto PackRange(int begin, int end) -> uint64_t
+{
+    return ((uint64_t)(uint32_t)begin << 32) | (uint32_t)end;
+}
+
+static inline void UnpackRange(uint64_t bounds, int &begin, int &end)
+{
+    begin = (int)(uint32_t)(bounds >> 32);
+    end = (int)(uint32_t)bounds;
+}
+
+// =====================================================================================
+//  ReportProgress
+//      Prints progress for the given number of dispatched items.
+//      Only ever called by the reporter thread or with it stopped.
+// =====================================================================================
+static void ReportProgress(int dispatched)
 {
-    int r, f, i;
+    int f, i;
     double ct, finish, finish2, finish3;
     static const char *s1 = nullptr; // avoid frequent call of Localize() in PrintConsole
     static const char *s2 = nullptr;
 
-    ThreadLock();
+    if (workcount <= 0)
+    {
+        return;
+    }
+
     if (s1 == nullptr)
         s1 = Localize("  (%d%%: est. time to completion %ld/%ld/%ld secs)   ");
     if (s2 == nullptr)
         s2 = Localize("  (%d%%: est. time to completion <1 sec)   ");
 
-    if (dispatch == 0)
+    f = THREADTIMES_SIZE * dispatched / workcount;
+    if (f > THREADTIMES_SIZE - 1)
     {
-        oldf = 0;
+        f = THREADTIMES_SIZE - 1;
     }
 
-    if (dispatch > workcount)
-    {
-        ThreadUnlock();
-        return -1;
-    }
-    if (dispatch == workcount)
-    {
-        ThreadUnlock();
-        return -1;
-    }
-    if (dispatch < 0)
-    {
-        ThreadUnlock();
-        return -1;
-    }
-
-    f = THREADTIMES_SIZE * dispatch / workcount;
     if (pacifier)
     {
-        PrintConsole("\r%6d /%6d", dispatch, workcount);
+        PrintConsole("\r%6d /%6d", dispatched, workcount);
 
-        if (f != oldf)
+        if (f > oldf)
         {
             ct = I_FloatTime();
             /* Fill in current time for threadtimes record */
@@ -95,47 +135,230 @@ auto GetThreadWork() -> int
             }
         }
     }
-    else
+    else if (f > oldf)
     {
-        if (f != oldf)
+        // Several percent may pass between two reports, so print every multiple of 10 passed
+        for (i = oldf + 1; i <= f; i++)
         {
-            oldf = f;
-            switch (f)
+            if (i % 10 == 0)
+            {
+                PrintConsole("%d%%...", i);
+            }
+        }
+        oldf = f;
+    }
+}
+
+// =====================================================================================
+//  Progress reporter
+//      Wakes up every REPORT_INTERVAL_NSEC while a phase runs and prints the dispatch counter,
+//      so the workers never format or print anything themselves.
+// =====================================================================================
+static pthread_mutex_t report_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t report_cond = PTHREAD_COND_INITIALIZER;
+static bool report_active = false;
+static bool report_started = false;
+
+static auto ProgressReporter(void *) -> void *
+{
+    pthread_mutex_lock(&report_mutex);
+    while (true)
+    {
+        while (!report_active)
+        {
+            pthread_cond_wait(&report_cond, &report_mutex);
+        }
+
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += REPORT_INTERVAL_NSEC;
+        if (wake.tv_nsec >= 1000000000)
+        {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&report_cond, &report_mutex, &wake);
+
+        if (report_active)
+        {
+            ReportProgress(dispatch.load(std::memory_order_relaxed));
+        }
+    }
+    return nullptr;
+}
+
+static void StartProgressReport()
+{
+    pthread_mutex_lock(&report_mutex);
+    if (!report_started)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, ProgressReporter, nullptr) != 0)
+        {
+            Error("pthread_create failed");
+        }
+        pthread_detach(thread);
+        report_started = true;
+    }
+    report_active = true;
+    pthread_cond_signal(&report_cond);
+    pthread_mutex_unlock(&report_mutex);
+}
+
+static void StopProgressReport()
+{
+    pthread_mutex_lock(&report_mutex);
+    report_active = false;
+    pthread_cond_signal(&report_cond);
+    pthread_mutex_unlock(&report_mutex);
+
+    // Flush the percentage marks a short phase finished before the reporter could print
+    if (!pacifier)
+    {
+        ReportProgress(workcount);
+    }
+}
+
+// =====================================================================================
+//  TakeWorkChunk
+//      Pops up to `wanted` items from the front of a worker's range, never more than half
+//      of what is left so there is always something for idle workers to steal.
+// =====================================================================================
+static auto TakeWorkChunk(WorkRange *range, int wanted, int &chunkbegin, int &chunkend) -> bool
+{
+    int begin, end;
+
+    auto bounds = range->bounds.load(std::memory_order_acquire);
+    while (true)
+    {
+        UnpackRange(bounds, begin, end);
+        auto remaining = end - begin;
+        if (remaining <= 0)
+        {
+            return false;
+        }
+        auto chunk = wanted;
+        if (chunk > (remaining + 1) / 2)
+        {
+            chunk = (remaining + 1) / 2;
+        }
+        if (range->bounds.compare_exchange_weak(bounds, PackRange(begin + chunk, end), std::memory_order_acq_rel))
+        {
+            chunkbegin = begin;
+            chunkend = begin + chunk;
+            return true;
+        }
+    }
+}
+
+// =====================================================================================
+//  StealWork
+//      Moves the back half of another worker's range into our own (empty) range.
+// =====================================================================================
+static auto StealWork(int self) -> bool
+{
+    int begin, end;
+
+    for (int i = 1; i < numworkers; i++)
+    {
+        auto *victim = &workranges[(self + i) % numworkers];
+
+        auto bounds = victim->bounds.load(std::memory_order_acquire);
+        while (true)
+        {
+            UnpackRange(bounds, begin, end);
+            auto remaining = end - begin;
+            if (remaining <= 0)
             {
-            case 10:
-            case 20:
-            case 30:
-            case 40:
-            case 50:
-            case 60:
-            case 70:
-            case 80:
-            case 90:
-            case 100:
-                /*
-                            case 5:
-                            case 15:
-                            case 25:
-                            case 35:
-                            case 45:
-                            case 55:
-                            case 65:
-                            case 75:
-                            case 85:
-                            case 95:
-                */
-                PrintConsole("%d%%...", f);
-            default:
                 break;
             }
+            auto stolenbegin = end - (remaining + 1) / 2;
+            if (victim->bounds.compare_exchange_weak(bounds, PackRange(begin, stolenbegin), std::memory_order_acq_rel))
+            {
+                // Nobody touches an empty range, so a plain store is enough here
+                workranges[self].bounds.store(PackRange(stolenbegin, end), std::memory_order_release);
+                return true;
+            }
         }
     }
+    return false;
+}
 
-    r = dispatch;
-    dispatch++;
+// =====================================================================================
+//  NextChunkSize
+//      Sizes the next chunk from the measured cost of the previous one, capped by the
+//      share of the undispatched work that falls to each worker.
+// =====================================================================================
+static auto NextChunkSize() -> int
+{
+    auto now = I_FloatTime();
+    if (t_chunksize > 0)
+    {
+        auto cost = (now - t_chunkstart) / t_chunksize;
+        t_itemcost = t_itemcost > 0 ? 0.75 * t_itemcost + 0.25 * cost : cost;
+    }
+    t_chunkstart = now;
 
-    ThreadUnlock();
-    return r;
+    if (t_chunksize == 0)
+    {
+        return 1; // nothing measured yet in this phase
+    }
+    auto wanted = THREAD_CHUNK_MAX;
+    if (t_itemcost * THREAD_CHUNK_MAX > THREAD_CHUNK_SECONDS)
+    {
+        wanted = (int)(THREAD_CHUNK_SECONDS / t_itemcost);
+    }
+    auto share = (workcount - dispatch.load(std::memory_order_relaxed)) / (numworkers * THREAD_CHUNK_SHARE);
+    if (wanted > share)
+    {
+        wanted = share;
+    }
+    return wanted < 1 ? 1 : wanted;
+}
+
+static auto NextWorkItem() -> int
+{
+    if (inorder)
+    {
+        // one at a time from a shared counter, so the items start in increasing order
+        auto work = nextinorder.fetch_add(1, std::memory_order_relaxed);
+        if (work >= workcount)
+        {
+            return -1;
+        }
+        dispatch.fetch_add(1, std::memory_order_relaxed);
+        return work;
+    }
+
+    if (t_chunkbegin < t_chunkend)
+    {
+        return t_chunkbegin++;
+    }
+
+    auto wanted = NextChunkSize();
+    auto *own = &workranges[t_threadnum];
+    while (!TakeWorkChunk(own, wanted, t_chunkbegin, t_chunkend))
+    {
+        if (!StealWork(t_threadnum))
+        {
+            t_chunksize = 0;
+            return -1;
+        }
+    }
+    t_chunksize = t_chunkend - t_chunkbegin;
+    dispatch.fetch_add(t_chunksize, std::memory_order_relaxed);
+
+    return t_chunkbegin++;
+}
+
+auto GetThreadWork() -> int
+{
+    auto work = NextWorkItem();
+    if (g_threadtrace)
+    {
+        ThreadTraceItem(t_threadnum, work);
+    }
+    return work;
 }
 
 q_threadfunction workfunction;
@@ -150,13 +373,26 @@ static void ThreadWorkerFunction(int unused)
     }
 }
 
-void RunThreadsOnIndividual(int workcnt, bool showpacifier, q_threadfunction func)
+void RunThreadsOnIndividual(int workcnt, bool showpacifier, q_threadfunction func, const char *name)
 {
     workfunction = func;
-    RunThreadsOn(workcnt, showpacifier, ThreadWorkerFunction);
+    RunThreadsOn(workcnt, showpacifier, ThreadWorkerFunction, name);
+}
+
+void RunThreadsOnIndividualInOrder(int workcnt, bool showpacifier, q_threadfunction func, const char *name)
+{
+    workfunction = func;
+    nextinorder = 0;
+    inorder = true;
+    RunThreadsOn(workcnt, showpacifier, ThreadWorkerFunction, name);
+    inorder = false;
 }
 
 int g_numthreads = DEFAULT_NUMTHREADS;
+bool g_threadpin = DEFAULT_THREADPIN;
+
+static int threadcpus[CPU_SETSIZE]; // CPUs in our affinity mask, workers are pinned round robin
+static int numthreadcpus = 0;
 
 void ThreadSetPriority(q_threadpriority type)
 {
@@ -184,63 +420,282 @@ void ThreadSetPriority(q_threadpriority type)
     setpriority(PRIO_PROCESS, 0, val);
 }
 
+// =====================================================================================
+//  GetCgroupCPULimit
+//      CPU quota of the container we run in (cgroup v2, then v1), 0 when unlimited.
+// =====================================================================================
+static auto GetCgroupCPULimit() -> int
+{
+    long long quota = -1, period = 0;
+    char buf[64];
+
+    auto *f = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (f)
+    {
+        if (fscanf(f, "%63s %lld", buf, &period) == 2 && strcmp(buf, "max"))
+        {
+            quota = atoll(buf);
+        }
+        fclose(f);
+    }
+    else
+    {
+        f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+        if (f)
+        {
+            if (fscanf(f, "%lld", &quota) != 1)
+            {
+                quota = -1;
+            }
+            fclose(f);
+        }
+        f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+        if (f)
+        {
+            if (fscanf(f, "%lld", &period) != 1)
+            {
+                period = 0;
+            }
+            fclose(f);
+        }
+    }
+
+    if (quota <= 0 || period <= 0)
+    {
+        return 0;
+    }
+    return (int)((quota + period - 1) / period);
+}
+
+// =====================================================================================
+//  GetAvailableCPUs
+//      Number of CPUs this process may use: the affinity mask, capped by the cgroup quota.
+// =====================================================================================
+static auto GetAvailableCPUs() -> int
+{
+    cpu_set_t mask;
+
+    numthreadcpus = 0;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+    {
+        for (int i = 0; i < CPU_SETSIZE; i++)
+        {
+            if (CPU_ISSET(i, &mask))
+            {
+                threadcpus[numthreadcpus++] = i;
+            }
+        }
+    }
+
+    auto cpus = numthreadcpus;
+    if (cpus < 1)
+    {
+        cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    auto limit = GetCgroupCPULimit();
+    if (limit > 0 && limit < cpus)
+    {
+        cpus = limit;
+    }
+    return cpus < 1 ? 1 : cpus;
+}
+
+// =====================================================================================
+//  ThreadPinToCPU
+//      Binds the calling thread to the CPU assigned to the given worker.
+// =====================================================================================
+static void ThreadPinToCPU(int threadnum)
+{
+    cpu_set_t mask;
+
+    if (!g_threadpin || numthreadcpus < 1)
+    {
+        return;
+    }
+    CPU_ZERO(&mask);
+    CPU_SET(threadcpus[threadnum % numthreadcpus], &mask);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0)
+    {
+        Warning("Could not pin thread %d to cpu %d", threadnum, threadcpus[threadnum % numthreadcpus]);
+    }
+}
+
 void ThreadSetDefault()
 {
+    auto cpus = GetAvailableCPUs();
     if (g_numthreads == -1)
     {
-        g_numthreads = 1;
+        g_numthreads = cpus;
+    }
+    if (g_numthreads > MAX_THREADS)
+    {
+        g_numthreads = MAX_THREADS;
     }
 }
 
-typedef void *pthread_addr_t;
-pthread_mutex_t *my_mutex;
+static pthread_mutex_t crit_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::atomic<long long> lockwait_usec{0}; // time spent blocked in ThreadLock, all threads
 
 void ThreadLock()
 {
-    if (my_mutex)
+    if (threaded)
     {
-        pthread_mutex_lock(my_mutex);
+        if (pthread_mutex_trylock(&crit_mutex) != 0)
+        {
+            auto start = I_FloatTime();
+            pthread_mutex_lock(&crit_mutex);
+            lockwait_usec.fetch_add((long long)((I_FloatTime() - start) * 1000000.0), std::memory_order_relaxed);
+        }
     }
 }
 
 void ThreadUnlock()
 {
-    if (my_mutex)
+    if (threaded)
     {
-        pthread_mutex_unlock(my_mutex);
+        pthread_mutex_unlock(&crit_mutex);
     }
 }
 
 q_threadfunction q_entry;
 
-static auto ThreadEntryStub(void *pParam) -> void *
+// =====================================================================================
+//  Thread pool
+//      Workers are spawned once and then parked on pool_wake between phases.
+//      The calling thread always takes part as worker 0.
+// =====================================================================================
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static int pool_size = 1; // including the calling thread
+static int pool_generation = 0;
+static int pool_active = 0;
+static int pool_startgeneration[MAX_THREADS];
+
+static void RunThreadEntry(int threadnum)
 {
-    q_entry((int)(intptr_t)pParam);
-    return nullptr;
+    t_threadnum = threadnum;
+    t_chunkbegin = 0;
+    t_chunkend = 0;
+    t_chunksize = 0;
+    t_itemcost = 0;
+    q_entry(threadnum);
 }
 
-void threads_InitCrit()
+static auto ThreadPoolWorker(void *pParam) -> void *
 {
-    pthread_mutexattr_t mattrib;
+    const int threadnum = (int)(intptr_t)pParam;
+
+    ThreadPinToCPU(threadnum);
 
-    if (!my_mutex)
+    pthread_mutex_lock(&pool_mutex);
+    auto generation = pool_startgeneration[threadnum];
+    while (true)
     {
-        my_mutex = (pthread_mutex_t *)Alloc(sizeof(*my_mutex));
-        if (pthread_mutexattr_init(&mattrib) == -1)
+        while (generation == pool_generation)
         {
-            Error("pthread_mutex_attr_init failed");
+            pthread_cond_wait(&pool_wake, &pool_mutex);
         }
-        if (pthread_mutex_init(my_mutex, &mattrib) == -1)
+        generation = pool_generation;
+        pthread_mutex_unlock(&pool_mutex);
+
+        if (threadnum < numworkers)
+        {
+            RunThreadEntry(threadnum);
+        }
+
+        pthread_mutex_lock(&pool_mutex);
+        if (--pool_active == 0)
+        {
+            pthread_cond_signal(&pool_done);
+        }
+    }
+    return nullptr;
+}
+
+// =====================================================================================
+//  ThreadPoolGrow
+//      Spawns workers until the pool can serve g_numthreads. Called with pool_mutex held.
+// =====================================================================================
+static void ThreadPoolGrow(int size)
+{
+    pthread_attr_t attrib;
+    pthread_t thread;
+
+    if (pthread_attr_init(&attrib) != 0)
+    {
+        Error("pthread_attr_init failed");
+    }
+#ifdef _POSIX_THREAD_ATTR_STACKSIZE
+    if (pthread_attr_setstacksize(&attrib, 0x400000) != 0)
+    {
+        Error("pthread_attr_setstacksize failed");
+    }
+#endif
+    pthread_attr_setdetachstate(&attrib, PTHREAD_CREATE_DETACHED);
+
+    for (; pool_size < size; pool_size++)
+    {
+        pool_startgeneration[pool_size] = pool_generation;
+        if (pthread_create(&thread, &attrib, ThreadPoolWorker, (void *)(intptr_t)pool_size) != 0)
         {
-            Error("pthread_mutex_init failed");
+            Error("pthread_create failed");
         }
     }
+    pthread_attr_destroy(&attrib);
 }
 
-void threads_UninitCrit()
+// =====================================================================================
+//  RunThreadsOnPool
+//      Splits [0, workcnt) into one range per worker and runs func on every worker.
+// =====================================================================================
+static void RunThreadsOnPool(int workcnt, q_threadfunction func)
 {
-    delete my_mutex;
-    my_mutex = nullptr;
+    static bool mainpinned = false;
+
+    q_entry = func;
+
+    // Hand every worker an equal slice up front; the rest is balanced by stealing
+    numworkers = g_numthreads;
+    for (int i = 0; i < numworkers; i++)
+    {
+        auto begin = (int)((long long)workcnt * i / numworkers);
+        auto end = (int)((long long)workcnt * (i + 1) / numworkers);
+        workranges[i].bounds.store(PackRange(begin, end > begin ? end : begin), std::memory_order_relaxed);
+    }
+
+    if (!mainpinned)
+    {
+        ThreadPinToCPU(0);
+        mainpinned = true;
+    }
+
+    if (numworkers > 1)
+    {
+        threaded = true;
+        pthread_mutex_lock(&pool_mutex);
+        ThreadPoolGrow(numworkers);
+        pool_active = pool_size - 1;
+        pool_generation++;
+        pthread_cond_broadcast(&pool_wake);
+        pthread_mutex_unlock(&pool_mutex);
+
+        RunThreadEntry(0);
+
+        pthread_mutex_lock(&pool_mutex);
+        while (pool_active > 0)
+        {
+            pthread_cond_wait(&pool_done, &pool_mutex);
+        }
+        pthread_mutex_unlock(&pool_mutex);
+        threaded = false;
+    }
+    else
+    {
+        RunThreadEntry(0);
+    }
+
+    q_entry = nullptr;
 }
 
 /*
@@ -248,12 +703,9 @@ void threads_UninitCrit()
  * RunThreadsOn
  * =============
  */
-void RunThreadsOn(int workcnt, bool showpacifier, q_threadfunction func)
+void RunThreadsOn(int workcnt, bool showpacifier, q_threadfunction func, const char *name)
 {
     int i;
-    pthread_t work_threads[MAX_THREADS];
-    pthread_addr_t status;
-    pthread_attr_t attrib;
     double start, end;
 
     threadstart = I_FloatTime();
@@ -265,55 +717,221 @@ void RunThreadsOn(int workcnt, bool showpacifier, q_threadfunction func)
 
     dispatch = 0;
     workcount = workcnt;
-    oldf = -1;
+    oldf = 0;
     pacifier = showpacifier;
-    threaded = true;
-    q_entry = func;
 
     if (pacifier)
     {
         setbuf(stdout, nullptr);
     }
 
-    threads_InitCrit();
+    MetricsBeginPhase(name, workcnt);
+    ThreadTraceBeginPhase(name, workcnt);
+    lockwait_usec = 0;
+    StartProgressReport();
+    RunThreadsOnPool(workcnt, func);
+    StopProgressReport();
+    ThreadTraceEndPhase();
+    MetricsEndPhase(lockwait_usec / 1000000.0);
 
-    if (pthread_attr_init(&attrib) == -1)
+    end = I_FloatTime();
+    if (pacifier)
     {
-        Error("pthread_attr_init failed");
+        PrintConsole("\r%60s\r", "");
     }
-#ifdef _POSIX_THREAD_ATTR_STACKSIZE
-    if (pthread_attr_setstacksize(&attrib, 0x400000) == -1)
+
+    Log(" (%.2f seconds)\n", end - start);
+}
+
+// =====================================================================================
+//  AllocBlockFirstTouch
+// =====================================================================================
+static byte *firsttouch_data;
+static int firsttouch_count;
+static size_t firsttouch_itemsize;
+
+static void FirstTouchSlice(int threadnum)
+{
+    // Same split as the initial work ranges in RunThreadsOnPool
+    auto begin = (long long)firsttouch_count * threadnum / numworkers;
+    auto end = (long long)firsttouch_count * (threadnum + 1) / numworkers;
+    memset(firsttouch_data + begin * firsttouch_itemsize, 0, (end - begin) * firsttouch_itemsize);
+}
+
+auto AllocBlockFirstTouch(int count, size_t itemsize) -> void *
+{
+    if (!g_threadpin || g_numthreads < 2 || count < 1)
     {
-        Error("pthread_attr_setstacksize failed");
+        return AllocBlock(count * itemsize);
     }
-#endif
 
-    for (i = 0; i < g_numthreads; i++)
+    // Large blocks come straight from mmap, so no page is touched before the workers zero them
+    auto *data = (byte *)malloc(count * itemsize);
+    hlassume(data != nullptr, assume_NoMemory);
+
+    firsttouch_data = data;
+    firsttouch_count = count;
+    firsttouch_itemsize = itemsize;
+    RunThreadsOnPool(count, FirstTouchSlice);
+    firsttouch_data = nullptr;
+
+    return data;
+}
+
+// =====================================================================================
+//  Tasks
+//      Every worker owns a deque of tasks. The owner pushes and pops at the back, so it
+//      goes depth first through what it forked itself, while thieves take from the front,
+//      where the oldest and usually biggest tasks are.
+// =====================================================================================
+struct QueuedTask
+{
+    q_taskfunction func;
+    void *data;
+    TaskGroup *group;
+    int item; // order in which the tasks of this RunTasks were added, for -trace
+};
+
+struct alignas(64) TaskQueue
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::deque<QueuedTask> tasks;
+};
+
+static TaskQueue taskqueues[MAX_THREADS];
+static std::atomic<int> pendingtasks{0}; // queued or running, in any group
+static std::atomic<int> addedtasks{0};   // since RunTasks began
+
+// Tasks run from WaitTasks nest on the waiter's stack; past this depth it only helps with its own group
+constexpr int MAX_TASK_NESTING = 8;
+static thread_local int t_tasknesting = 0;
+
+void AddTask(TaskGroup &group, q_taskfunction func, void *task)
+{
+    auto *queue = &taskqueues[t_threadnum];
+
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    pendingtasks.fetch_add(1, std::memory_order_relaxed);
+    auto item = addedtasks.fetch_add(1, std::memory_order_relaxed);
+    pthread_mutex_lock(&queue->mutex);
+    queue->tasks.push_back({func, task, &group, item});
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// =====================================================================================
+//  TakeTask
+//      any task, or with group only one of that group
+// =====================================================================================
+static auto TakeTask(QueuedTask &task, const TaskGroup *group) -> bool
+{
+    for (int i = 0; i < numworkers; i++)
     {
-        if (pthread_create(&work_threads[i], &attrib, ThreadEntryStub, (void *)(intptr_t)i) == -1)
+        auto *queue = &taskqueues[(t_threadnum + i) % numworkers];
+        auto &tasks = queue->tasks;
+
+        pthread_mutex_lock(&queue->mutex);
+        if (i == 0)
         {
-            Error("pthread_create failed");
+            auto it = tasks.rbegin();
+            while (group && it != tasks.rend() && it->group != group)
+            {
+                ++it;
+            }
+            if (it != tasks.rend())
+            {
+                task = *it;
+                tasks.erase(std::next(it).base());
+                pthread_mutex_unlock(&queue->mutex);
+                return true;
+            }
         }
+        else
+        {
+            auto it = tasks.begin();
+            while (group && it != tasks.end() && it->group != group)
+            {
+                ++it;
+            }
+            if (it != tasks.end())
+            {
+                task = *it;
+                tasks.erase(it);
+                pthread_mutex_unlock(&queue->mutex);
+                return true;
+            }
+        }
+        pthread_mutex_unlock(&queue->mutex);
     }
+    return false;
+}
+
+static void RunTask(const QueuedTask &task)
+{
+    if (g_threadtrace)
+    {
+        auto begin = ThreadTraceTime();
+        task.func(task.data);
+        ThreadTraceSpan(t_threadnum, task.item, begin);
+    }
+    else
+    {
+        task.func(task.data);
+    }
+    task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+    pendingtasks.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void WaitTasks(TaskGroup &group)
+{
+    QueuedTask task;
 
-    for (i = 0; i < g_numthreads; i++)
+    while (group.pending.load(std::memory_order_acquire) > 0)
     {
-        if (pthread_join(work_threads[i], &status) == -1)
+        if (TakeTask(task, t_tasknesting < MAX_TASK_NESTING ? nullptr : &group))
         {
-            Error("pthread_join failed");
+            t_tasknesting++;
+            RunTask(task);
+            t_tasknesting--;
+        }
+        else
+        {
+            sched_yield();
         }
     }
+}
 
-    threads_UninitCrit();
-
-    q_entry = nullptr;
-    threaded = false;
+static void TaskWorkerFunction(int)
+{
+    QueuedTask task;
 
-    end = I_FloatTime();
-    if (pacifier)
+    // A task that is still running may add more, so only stop once none is left anywhere
+    while (pendingtasks.load(std::memory_order_acquire) > 0)
     {
-        PrintConsole("\r%60s\r", "");
+        if (TakeTask(task, nullptr))
+        {
+            RunTask(task);
+        }
+        else
+        {
+            sched_yield();
+        }
     }
+}
 
-    Log(" (%.2f seconds)\n", end - start);
-}
\ No newline at end of file
+void RunTasks(q_taskfunction func, void *root, const char *name)
+{
+    TaskGroup group;
+
+    group.pending = 1;
+    pendingtasks = 1;
+    addedtasks = 1;
+    taskqueues[0].tasks.push_back({func, root, &group, 0});
+
+    // the number of tasks is only known at the end
+    MetricsBeginPhase(name, 0);
+    ThreadTraceBeginPhase(name, 0);
+    lockwait_usec = 0;
+    RunThreadsOnPool(0, TaskWorkerFunction);
+    ThreadTraceEndPhase(addedtasks);
+    MetricsEndPhase(lockwait_usec / 1000000.0, addedtasks);
+}
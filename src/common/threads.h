@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+
 #include "cmdlib.h" //--vluzacn
 #include "log.h"
 
@@ -12,12 +14,15 @@ typedef enum
 } q_threadpriority;
 
 typedef void (*q_threadfunction)(int);
+typedef void (*q_taskfunction)(void *);
 
-constexpr int DEFAULT_NUMTHREADS = 1;
+constexpr int DEFAULT_NUMTHREADS = -1; // -1 = use every CPU the process may run on
+constexpr bool DEFAULT_THREADPIN = false;
 
 #define DEFAULT_THREAD_PRIORITY eThreadPriorityNormal
 
 extern int g_numthreads;
+extern bool g_threadpin; // "-pin": bind each worker to one CPU and first-touch big arrays
 extern q_threadpriority g_threadpriority;
 
 extern void ThreadSetPriority(q_threadpriority type);
@@ -26,16 +31,44 @@ extern auto GetThreadWork() -> int;
 extern void ThreadLock();
 extern void ThreadUnlock();
 
-extern void RunThreadsOnIndividual(int workcnt, bool showpacifier, q_threadfunction);
-extern void RunThreadsOn(int workcnt, bool showpacifier, q_threadfunction);
+// name labels the phase in the metrics report
+extern void RunThreadsOnIndividual(int workcnt, bool showpacifier, q_threadfunction, const char *name = "RunThreadsOnIndividual");
+// Like RunThreadsOnIndividual, but the items are handed out one at a time in increasing order,
+// for phases whose results are consumed in order. Not balanced by stealing.
+extern void RunThreadsOnIndividualInOrder(int workcnt, bool showpacifier, q_threadfunction, const char *name = "RunThreadsOnIndividualInOrder");
+extern void RunThreadsOn(int workcnt, bool showpacifier, q_threadfunction, const char *name = "RunThreadsOn");
+
+// Zeroed allocation of count items. With -pin each worker zeroes the items of its initial work
+// slice, so the pages end up on the NUMA node of the worker that will process those items.
+// Release with FreeBlock.
+extern auto AllocBlockFirstTouch(int count, size_t itemsize) -> void *;
+
+// Tasks that are waited for together
+struct TaskGroup
+{
+    std::atomic<int> pending{0}; // queued or running
+};
+
+// Runs func on root, on all threads, until root and every task added while it runs are done.
+// A thread works through its own tasks newest first; idle threads steal the oldest ones.
+// Prints nothing; the metrics report and -trace get a phase called name with one item per task.
+extern void RunTasks(q_taskfunction func, void *root, const char *name = "RunTasks");
+// Only from inside RunTasks. WaitTasks runs queued tasks itself until the group is done.
+extern void AddTask(TaskGroup &group, q_taskfunction func, void *task);
+extern void WaitTasks(TaskGroup &group);
 
 #define NamedRunThreadsOn(n, p, f)     \
     {                                  \
         Log("%s\n", Localize(#f ":")); \
-        RunThreadsOn(n, p, f);         \
+        RunThreadsOn(n, p, f, #f);     \
     }
 #define NamedRunThreadsOnIndividual(n, p, f) \
     {                                        \
         Log("%s\n", Localize(#f ":"));       \
-        RunThreadsOnIndividual(n, p, f);     \
+        RunThreadsOnIndividual(n, p, f, #f); \
+    }
+#define NamedRunThreadsOnIndividualInOrder(n, p, f) \
+    {                                               \
+        Log("%s\n", Localize(#f ":"));              \
+        RunThreadsOnIndividualInOrder(n, p, f, #f); \
     }
@@ -0,0 +1,202 @@
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "cmdlib.h"
+#include "log.h"
+#include "threads.h"
+#include "threadtrace.h"
+
+bool g_threadtrace = DEFAULT_THREADTRACE;
+
+struct TraceEvent
+{
+    const char *phase;
+    int item;
+    double begin; // microseconds since the first traced phase
+    double end;
+};
+
+// Only ever appended to by the worker that owns it, so recording takes no lock
+struct alignas(64) TraceThread
+{
+    std::vector<TraceEvent> events;
+    bool open = false;
+};
+
+struct TracePhase
+{
+    const char *name;
+    int items;
+    double begin;
+    double end;
+};
+
+static TraceThread tracethreads[MAX_THREADS];
+static std::vector<TracePhase> tracephases;
+static const char *tracephase = nullptr;
+static int tracemaxthreads = 0;
+static struct timespec tracestart;
+static bool tracestarted = false;
+
+auto ThreadTraceTime() -> double
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - tracestart.tv_sec) * 1000000.0 + (now.tv_nsec - tracestart.tv_nsec) / 1000.0;
+}
+
+void ThreadTraceBeginPhase(const char *const name, int items)
+{
+    if (!g_threadtrace)
+    {
+        return;
+    }
+    if (!tracestarted)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &tracestart);
+        tracestarted = true;
+    }
+    if (g_numthreads > tracemaxthreads)
+    {
+        tracemaxthreads = g_numthreads;
+    }
+    tracephase = name;
+    tracephases.push_back({name, items, ThreadTraceTime(), 0});
+}
+
+void ThreadTraceEndPhase(int items)
+{
+    if (!g_threadtrace || tracephases.empty())
+    {
+        return;
+    }
+    auto now = ThreadTraceTime();
+
+    // Phase functions may stop asking for work without seeing -1 (e.g. VIS' GetNextPortal)
+    for (int i = 0; i < tracemaxthreads; i++)
+    {
+        if (tracethreads[i].open)
+        {
+            tracethreads[i].events.back().end = now;
+            tracethreads[i].open = false;
+        }
+    }
+    tracephases.back().end = now;
+    if (items >= 0)
+    {
+        tracephases.back().items = items;
+    }
+    tracephase = nullptr;
+}
+
+// =====================================================================================
+//  ThreadTraceItem
+//      Closes the item the worker was busy with and opens the next one (-1 = none)
+// =====================================================================================
+void ThreadTraceItem(int threadnum, int item)
+{
+    auto *thread = &tracethreads[threadnum];
+    auto now = ThreadTraceTime();
+
+    if (thread->open)
+    {
+        thread->events.back().end = now;
+        thread->open = false;
+    }
+    if (item >= 0)
+    {
+        thread->events.push_back({tracephase, item, now, now});
+        thread->open = true;
+    }
+}
+
+// =====================================================================================
+//  ThreadTraceSetItem
+//      Renumbers the item the worker just opened, for phases that pick their own work
+//      after GetThreadWork (-1 = it found none, drop the item)
+// =====================================================================================
+void ThreadTraceSetItem(int threadnum, int item)
+{
+    auto *thread = &tracethreads[threadnum];
+
+    if (!thread->open)
+    {
+        return;
+    }
+    if (item >= 0)
+    {
+        thread->events.back().item = item;
+    }
+    else
+    {
+        thread->events.pop_back();
+        thread->open = false;
+    }
+}
+
+// =====================================================================================
+//  ThreadTraceSpan
+//      Records an item that ran from begin (ThreadTraceTime) until now. Tasks that a
+//      worker runs while it waits for others nest inside the span of the waiting one.
+// =====================================================================================
+void ThreadTraceSpan(int threadnum, int item, double begin)
+{
+    tracethreads[threadnum].events.push_back({tracephase, item, begin, ThreadTraceTime()});
+}
+
+static void WriteTraceEvent(FILE *f, bool &first, const char *name, const char *cat, int tid, double begin, double end, const char *argname, int arg)
+{
+    fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"%s\":%d}}",
+            first ? "" : ",", name, cat, tid, begin, end - begin, argname, arg);
+    first = false;
+}
+
+// =====================================================================================
+//  ThreadTraceWrite
+//      Meant for atexit()
+// =====================================================================================
+void ThreadTraceWrite()
+{
+    char filename[_MAX_PATH];
+    bool first = true;
+
+    if (!g_threadtrace || tracephases.empty())
+    {
+        return;
+    }
+
+    safe_snprintf(filename, _MAX_PATH, "%s.%s.trace.json", g_Mapname, g_Program.c_str());
+    auto *f = fopen(filename, "w");
+    if (!f)
+    {
+        Warning("Could not write trace file %s", filename);
+        return;
+    }
+
+    // Phases get their own row below the workers
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    fprintf(f, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}", g_Program.c_str());
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"phases\"}}", MAX_THREADS);
+    for (int i = 0; i < tracemaxthreads; i++)
+    {
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", i, i);
+    }
+    first = false;
+
+    for (const auto &phase : tracephases)
+    {
+        WriteTraceEvent(f, first, phase.name, "phase", MAX_THREADS, phase.begin, phase.end, "items", phase.items);
+    }
+    for (int i = 0; i < tracemaxthreads; i++)
+    {
+        for (const auto &event : tracethreads[i].events)
+        {
+            WriteTraceEvent(f, first, event.phase, "item", i, event.begin, event.end, "item", event.item);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    Log("Wrote trace to %s\n", filename);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+//
+// threadtrace.cpp: "-trace", Chrome/Perfetto trace of every work item handed out by GetThreadWork
+// and every task run by RunTasks, written as <mapname>.<program>.trace.json at exit. Load it in
+// chrome://tracing or ui.perfetto.dev.
+//
+
+constexpr bool DEFAULT_THREADTRACE = false;
+
+extern bool g_threadtrace;
+
+extern void ThreadTraceBeginPhase(const char *const name, int items);
+extern void ThreadTraceEndPhase(int items = -1); // items >= 0 replaces the count given at the beginning
+extern void ThreadTraceItem(int threadnum, int item);
+extern void ThreadTraceSetItem(int threadnum, int item);
+extern auto ThreadTraceTime() -> double;
+extern void ThreadTraceSpan(int threadnum, int item, double begin);
+extern void ThreadTraceWrite();
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "wadfile.h"
+#include "cmdlib.h"
+#include "log.h"
+
+char g_wadcache[_MAX_PATH] = "";
+
+struct WadHeader
+{
+    char identification[4]; // should be WAD3
+    int numlumps;
+    int infotableofs;
+};
+
+// =====================================================================================
+//  WadLumpName
+//      the form lump names are stored and compared in
+// =====================================================================================
+void WadLumpName(const char *const in, char *out)
+{
+    int i;
+    for (i = 0; i < WADLUMP_NAME - 1 && in[i]; i++)
+    {
+        out[i] = toupper((unsigned char)in[i]);
+    }
+    for (; i < WADLUMP_NAME; i++)
+    {
+        out[i] = 0;
+    }
+}
+
+static auto WadLumpLess(const WadLump &a, const WadLump &b) -> bool
+{
+    int cmp = strcmp(a.name, b.name);
+    return cmp ? cmp < 0 : a.filepos < b.filepos;
+}
+
+// =====================================================================================
+//  WadIndexPath
+//      cache file for one wad: <wadcache>/<hash of the wad's full path>.wix
+// =====================================================================================
+static auto WadIndexPath(const char *const fullpath, char *indexpath) -> bool
+{
+    const char *dir = *g_wadcache ? g_wadcache : getenv("WADCACHE");
+    if (!dir || !*dir)
+    {
+        return false;
+    }
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    for (const char *c = fullpath; *c; c++)
+    {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+    }
+    safe_snprintf(indexpath, _MAX_PATH, "%s" SYSTEM_SLASH_STR "%016llx.wix", dir, (unsigned long long)hash);
+    return true;
+}
+
+// =====================================================================================
+//  ReadWadIndex
+//      loads the cached directory if it was written for this very file
+// =====================================================================================
+static auto ReadWadIndex(WadFile &wad, const char *const indexpath, const char *const fullpath, const struct stat &st) -> bool
+{
+    FILE *f = fopen(indexpath, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    WadIndexHeader header;
+    char path[_MAX_PATH];
+    bool valid = fread(&header, sizeof(header), 1, f) == 1 && header.magic == WADINDEX_MAGIC && header.version == WADINDEX_VERSION && header.filesize == (int64_t)st.st_size && header.mtime == (int64_t)st.st_mtim.tv_sec && header.mtimensec == (int64_t)st.st_mtim.tv_nsec && header.numlumps >= 0 && header.pathlen == (int32_t)strlen(fullpath) && header.pathlen < _MAX_PATH && fread(path, 1, header.pathlen, f) == (size_t)header.pathlen;
+    if (valid)
+    {
+        path[header.pathlen] = '\0';
+        valid = !strcmp(path, fullpath);
+    }
+    if (valid)
+    {
+        wad.numlumps = header.numlumps;
+        wad.lumps = new WadLump[wad.numlumps];
+        valid = fread(wad.lumps, sizeof(WadLump), wad.numlumps, f) == (size_t)wad.numlumps;
+        if (!valid)
+        {
+            delete[] wad.lumps;
+            wad.lumps = nullptr;
+            wad.numlumps = 0;
+        }
+    }
+    fclose(f);
+    return valid;
+}
+
+// =====================================================================================
+//  WriteWadIndex
+//      the cache is only an optimization, failing to write it is not an error;
+//      the index is renamed into place so concurrent compiles never see half of it
+// =====================================================================================
+static void WriteWadIndex(const WadFile &wad, const char *const indexpath, const char *const fullpath, const struct stat &st)
+{
+    char tmppath[_MAX_PATH];
+    safe_snprintf(tmppath, _MAX_PATH, "%s.%d", indexpath, (int)getpid());
+    FILE *f = fopen(tmppath, "wb");
+    if (!f)
+    {
+        return;
+    }
+    WadIndexHeader header;
+    header.magic = WADINDEX_MAGIC;
+    header.version = WADINDEX_VERSION;
+    header.filesize = st.st_size;
+    header.mtime = st.st_mtim.tv_sec;
+    header.mtimensec = st.st_mtim.tv_nsec;
+    header.numlumps = wad.numlumps;
+    header.pathlen = strlen(fullpath);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(fullpath, 1, header.pathlen, f) == (size_t)header.pathlen && fwrite(wad.lumps, sizeof(WadLump), wad.numlumps, f) == (size_t)wad.numlumps;
+    ok = !fclose(f) && ok;
+    if (!ok || rename(tmppath, indexpath))
+    {
+        unlink(tmppath);
+    }
+}
+
+// =====================================================================================
+//  ParseWadDirectory
+// =====================================================================================
+static void ParseWadDirectory(WadFile &wad)
+{
+    WadHeader header;
+    if (wad.size < sizeof(header))
+    {
+        Error("Invalid wad file '%s'.", wad.path);
+    }
+    memcpy(&header, wad.data, sizeof(header));
+    if (strncmp(header.identification, "WAD3", 4))
+    {
+        Error("%s isn't a Wadfile!", wad.path);
+    }
+    header.numlumps = LittleLong(header.numlumps);
+    header.infotableofs = LittleLong(header.infotableofs);
+    if (header.numlumps < 0 || header.infotableofs < 0 || (size_t)header.infotableofs + (size_t)header.numlumps * sizeof(WadLump) > wad.size)
+    {
+        Error("Invalid wad file '%s'.", wad.path);
+    }
+
+    wad.numlumps = header.numlumps;
+    wad.lumps = new WadLump[wad.numlumps];
+    memcpy(wad.lumps, wad.data + header.infotableofs, wad.numlumps * sizeof(WadLump));
+    for (int i = 0; i < wad.numlumps; i++)
+    {
+        WadLump &lump = wad.lumps[i];
+        if (!TerminatedString(lump.name, WADLUMP_NAME))
+        {
+            lump.name[WADLUMP_NAME - 1] = '\0';
+            Warning("Unterminated texture name : wad[%s] texture[%d] name[%s]\n", wad.path, i, lump.name);
+        }
+        WadLumpName(lump.name, lump.name);
+        lump.filepos = LittleLong(lump.filepos);
+        lump.disksize = LittleLong(lump.disksize);
+        lump.size = LittleLong(lump.size);
+    }
+    std::sort(wad.lumps, wad.lumps + wad.numlumps, WadLumpLess);
+}
+
+// =====================================================================================
+//  MapWadFile
+// =====================================================================================
+auto MapWadFile(WadFile &wad, const char *const path) -> bool
+{
+    safe_strncpy(wad.path, path, _MAX_PATH);
+    wad.data = nullptr;
+    wad.size = 0;
+    wad.numlumps = 0;
+    wad.lumps = nullptr;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        Error("Can't stat %s", path);
+    }
+    wad.size = st.st_size;
+    if (wad.size)
+    {
+        void *data = mmap(nullptr, wad.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            Error("Can't map %s", path);
+        }
+        wad.data = (const byte *)data;
+    }
+    close(fd);
+
+    char fullpath[PATH_MAX];
+    if (!realpath(path, fullpath))
+    {
+        safe_strncpy(fullpath, path, sizeof(fullpath));
+    }
+    char indexpath[_MAX_PATH];
+    bool cached = WadIndexPath(fullpath, indexpath);
+    if (!cached || !ReadWadIndex(wad, indexpath, fullpath, st))
+    {
+        ParseWadDirectory(wad);
+        if (cached)
+        {
+            WriteWadIndex(wad, indexpath, fullpath, st);
+        }
+    }
+    return true;
+}
+
+// =====================================================================================
+//  UnmapWadFile
+// =====================================================================================
+void UnmapWadFile(WadFile &wad)
+{
+    if (wad.data)
+    {
+        munmap((void *)wad.data, wad.size);
+    }
+    delete[] wad.lumps;
+    wad.data = nullptr;
+    wad.size = 0;
+    wad.numlumps = 0;
+    wad.lumps = nullptr;
+}
+
+// =====================================================================================
+//  FindWadLumps
+//      every lump with this name (any case), lowest filepos first
+// =====================================================================================
+auto FindWadLumps(const WadFile &wad, const char *const name, const WadLump *&first) -> int
+{
+    WadLump key;
+    WadLumpName(name, key.name);
+    key.filepos = INT_MIN;
+    const WadLump *end = wad.lumps + wad.numlumps;
+    first = std::lower_bound((const WadLump *)wad.lumps, end, key, WadLumpLess);
+    const WadLump *last = first;
+    while (last < end && !strcmp(last->name, key.name))
+    {
+        last++;
+    }
+    return last - first;
+}
+
+// =====================================================================================
+//  WadLumpData
+// =====================================================================================
+auto WadLumpData(const WadFile &wad, const WadLump *const lump) -> const byte *
+{
+    if (lump->filepos < 0 || lump->disksize < 0 || (size_t)lump->filepos + (size_t)lump->disksize > wad.size)
+    {
+        return nullptr;
+    }
+    return wad.data + lump->filepos;
+}
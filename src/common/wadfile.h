@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "mathtypes.h"
+#include "win32fix.h"
+
+// Read-only access to WAD3 files shared by sCSG and sRAD. The file is memory
+// mapped and lump data is handed out by pointer; the lump directory is kept
+// sorted by name so lookups are a binary search.
+//
+// When "-wadcache <dir>" (or, without it, the WADCACHE environment variable)
+// names a directory, the sorted directory of every wad is also stored there,
+// keyed by the wad's full path, size and modification time, and later runs
+// load it instead of parsing and sorting the wad's own directory.
+
+constexpr int WADLUMP_NAME = 16;
+
+constexpr uint32_t WADINDEX_MAGIC = ('W' | ('I' << 8) | ('D' << 16) | ('X' << 24));
+constexpr uint32_t WADINDEX_VERSION = 1;
+
+struct WadLump // dlumpinfo_t as stored in the wad
+{
+    int filepos;
+    int disksize;
+    int size; // uncompressed
+    char type;
+    char compression;
+    char pad1, pad2;
+    char name[WADLUMP_NAME]; // upper case, null terminated and padded
+};
+
+struct WadIndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t filesize;
+    int64_t mtime;
+    int64_t mtimensec;
+    int32_t numlumps;
+    int32_t pathlen; // the wad's full path follows the header, then numlumps WadLump
+};
+
+struct WadFile
+{
+    char path[_MAX_PATH];
+    const byte *data; // whole file, memory mapped
+    size_t size;
+    int numlumps;
+    WadLump *lumps; // sorted by name, then by filepos
+};
+
+extern char g_wadcache[_MAX_PATH]; // "-wadcache <dir>", empty = $WADCACHE or no cache
+
+extern void WadLumpName(const char *const in, char *out);
+
+extern auto MapWadFile(WadFile &wad, const char *const path) -> bool; // false if the file can't be opened
+extern void UnmapWadFile(WadFile &wad);
+extern auto FindWadLumps(const WadFile &wad, const char *const name, const WadLump *&first) -> int;
+extern auto WadLumpData(const WadFile &wad, const WadLump *const lump) -> const byte *; // nullptr if out of the file
@@ -5,6 +5,8 @@
 #include "log.h"
 #include "mathlib.h"
 #include "hlassert.h"
+#include "blockmem.h"
+#include "planeside.h"
 
 #undef ON_EPSILON
 
@@ -148,6 +150,31 @@ auto Winding::Copy() const -> Winding *
 // Construction
 //
 
+// Points live in m_InlinePoints when they fit, otherwise in a block from the thread's pool
+void Winding::allocPoints(uint32_t maxpoints)
+{
+    if (maxpoints <= WINDING_INLINE_POINTS)
+    {
+        m_Points = m_InlinePoints;
+        m_MaxPoints = WINDING_INLINE_POINTS;
+    }
+    else
+    {
+        m_Points = (vec3_t *)PoolAlloc(maxpoints * sizeof(vec3_t));
+        m_MaxPoints = maxpoints;
+    }
+}
+
+void Winding::freePoints()
+{
+    if (m_Points != m_InlinePoints)
+    {
+        PoolFree(m_Points, m_MaxPoints * sizeof(vec3_t));
+    }
+    m_Points = nullptr;
+    m_MaxPoints = 0;
+}
+
 Winding::Winding()
 {
     m_Points = nullptr;
@@ -158,19 +185,22 @@ Winding::Winding(vec3_t *points, uint32_t numpoints)
 {
     hlassert(numpoints >= 3);
     m_NumPoints = numpoints;
-    m_MaxPoints = (m_NumPoints + 3) & ~3; // groups of 4
-
-    m_Points = new vec3_t[m_MaxPoints];
+    allocPoints((m_NumPoints + 3) & ~3); // groups of 4
     memcpy(m_Points, points, sizeof(vec3_t) * m_NumPoints);
 }
 
 auto Winding::operator=(const Winding &other) -> Winding &
 {
-    delete[] m_Points;
+    if (this == &other)
+    {
+        return *this;
+    }
+    if (!m_Points || m_MaxPoints < other.m_NumPoints)
+    {
+        freePoints();
+        allocPoints((other.m_NumPoints + 3) & ~3); // groups of 4
+    }
     m_NumPoints = other.m_NumPoints;
-    m_MaxPoints = (m_NumPoints + 3) & ~3; // groups of 4
-
-    m_Points = new vec3_t[m_MaxPoints];
     memcpy(m_Points, other.m_Points, sizeof(vec3_t) * m_NumPoints);
     return *this;
 }
@@ -179,24 +209,20 @@ Winding::Winding(uint32_t numpoints)
 {
     hlassert(numpoints >= 3);
     m_NumPoints = numpoints;
-    m_MaxPoints = (m_NumPoints + 3) & ~3; // groups of 4
-
-    m_Points = new vec3_t[m_MaxPoints];
+    allocPoints((m_NumPoints + 3) & ~3); // groups of 4
     memset(m_Points, 0, sizeof(vec3_t) * m_NumPoints);
 }
 
 Winding::Winding(const Winding &other)
 {
     m_NumPoints = other.m_NumPoints;
-    m_MaxPoints = (m_NumPoints + 3) & ~3; // groups of 4
-
-    m_Points = new vec3_t[m_MaxPoints];
+    allocPoints((m_NumPoints + 3) & ~3); // groups of 4
     memcpy(m_Points, other.m_Points, sizeof(vec3_t) * m_NumPoints);
 }
 
 Winding::~Winding()
 {
-    delete[] m_Points;
+    freePoints();
 }
 
 void Winding::initFromPlane(const vec3_t normal, const vec_t dist)
@@ -248,7 +274,7 @@ void Winding::initFromPlane(const vec3_t normal, const vec_t dist)
 
     // project a really big     axis aligned box onto the plane
     m_NumPoints = 4;
-    m_Points = new vec3_t[m_NumPoints];
+    allocPoints(m_NumPoints);
 
     VectorSubtract(org, vright, m_Points[0]);
     VectorAdd(m_Points[0], vup, m_Points[0]);
@@ -275,7 +301,7 @@ Winding::Winding(const BSPLumpFace &face, vec_t epsilon)
     int v;
 
     m_NumPoints = face.numedges;
-    m_Points = new vec3_t[m_NumPoints];
+    allocPoints(m_NumPoints);
 
     unsigned i;
     for (i = 0; i < face.numedges; i++)
@@ -350,28 +376,9 @@ void Winding::Clip(const vec3_t normal, const vec_t dist, Winding **front, Windi
     unsigned int i, j;
     unsigned int maxpts;
 
-    counts[0] = counts[1] = counts[2] = 0;
-
     // determine sides for each point
-    for (i = 0; i < m_NumPoints; i++)
-    {
-        dot = DotProduct(m_Points[i], normal);
-        dot -= dist;
-        dists[i] = dot;
-        if (dot > ON_EPSILON)
-        {
-            sides[i] = SIDE_FRONT;
-        }
-        else if (dot < -ON_EPSILON)
-        {
-            sides[i] = SIDE_BACK;
-        }
-        else
-        {
-            sides[i] = SIDE_ON;
-        }
-        counts[sides[i]]++;
-    }
+    ClassifyPoints(m_Points, m_NumPoints, normal, dist, epsilon, dists, sides, counts);
+    i = m_NumPoints;
     sides[i] = sides[0];
     dists[i] = dists[0];
 
@@ -490,50 +497,35 @@ auto Winding::Chop(const vec3_t normal, const vec_t dist, vec_t epsilon) -> bool
 
     if (f)
     {
-        delete[] m_Points;
-        m_NumPoints = f->m_NumPoints;
-        m_Points = f->m_Points;
-        f->m_Points = nullptr;
+        *this = *f;
         delete f;
         return true;
     }
     else
     {
         m_NumPoints = 0;
-        delete[] m_Points;
-        m_Points = nullptr;
+        freePoints();
         return false;
     }
 }
 
 auto Winding::WindingOnPlaneSide(const vec3_t normal, const vec_t dist, vec_t epsilon) -> int
 {
+    vec_t dists[MAX_POINTS_ON_WINDING];
+    int sides[MAX_POINTS_ON_WINDING];
+    int counts[3];
     bool front, back;
-    unsigned int i;
-    vec_t d;
 
     front = false;
     back = false;
-    for (i = 0; i < m_NumPoints; i++)
+    for (unsigned int i = 0; i < m_NumPoints; i += MAX_POINTS_ON_WINDING)
     {
-        d = DotProduct(m_Points[i], normal) - dist;
-        if (d < -ON_EPSILON)
+        ClassifyPoints(m_Points + i, qmin(m_NumPoints - i, (unsigned int)MAX_POINTS_ON_WINDING), normal, dist, epsilon, dists, sides, counts);
+        front |= counts[SIDE_FRONT] != 0;
+        back |= counts[SIDE_BACK] != 0;
+        if (front && back)
         {
-            if (front)
-            {
-                return SIDE_CROSS;
-            }
-            back = true;
-            continue;
-        }
-        if (d > ON_EPSILON)
-        {
-            if (back)
-            {
-                return SIDE_CROSS;
-            }
-            front = true;
-            continue;
+            return SIDE_CROSS;
         }
     }
 
@@ -556,29 +548,12 @@ auto Winding::Clip(const dplane_t &split, bool keepon, vec_t epsilon) -> bool
     vec_t dot;
     int i, j;
 
-    counts[0] = counts[1] = counts[2] = 0;
-
     // determine sides for each point
     // do this exactly, with no epsilon so tiny portals still work
-    for (i = 0; i < m_NumPoints; i++)
-    {
-        dot = DotProduct(m_Points[i], split.normal);
-        dot -= split.dist;
-        dists[i] = dot;
-        if (dot > ON_EPSILON)
-        {
-            sides[i] = SIDE_FRONT;
-        }
-        else if (dot < -ON_EPSILON)
-        {
-            sides[i] = SIDE_BACK;
-        }
-        else
-        {
-            sides[i] = SIDE_ON;
-        }
-        counts[sides[i]]++;
-    }
+    vec3_t normal; // dplane_t may hold floats
+    VectorCopy(split.normal, normal);
+    ClassifyPoints(m_Points, m_NumPoints, normal, split.dist, epsilon, dists, sides, counts);
+    i = m_NumPoints;
     sides[i] = sides[0];
     dists[i] = dists[0];
 
@@ -589,8 +564,7 @@ auto Winding::Clip(const dplane_t &split, bool keepon, vec_t epsilon) -> bool
 
     if (!counts[0])
     {
-        delete[] m_Points;
-        m_Points = nullptr;
+        freePoints();
         m_NumPoints = 0;
         return false;
     }
@@ -602,8 +576,7 @@ auto Winding::Clip(const dplane_t &split, bool keepon, vec_t epsilon) -> bool
 
     unsigned maxpts = m_NumPoints + 4; // can't use counts[0]+2 because of fp grouping errors
     unsigned newNumPoints = 0;
-    auto *newPoints = new vec3_t[maxpts];
-    memset(newPoints, 0, sizeof(vec3_t) * maxpts);
+    vec3_t newPoints[MAX_POINTS_ON_WINDING + 4];
 
     for (i = 0; i < m_NumPoints; i++)
     {
@@ -654,16 +627,19 @@ auto Winding::Clip(const dplane_t &split, bool keepon, vec_t epsilon) -> bool
         Error("Winding::Clip : points exceeded estimate");
     }
 
-    delete[] m_Points;
-    m_Points = newPoints;
+    if (m_MaxPoints < newNumPoints)
+    {
+        freePoints();
+        allocPoints(maxpts);
+    }
+    memcpy(m_Points, newPoints, sizeof(vec3_t) * newNumPoints);
     m_NumPoints = newNumPoints;
 
     RemoveColinearPoints(
         epsilon);
     if (m_NumPoints == 0)
     {
-        delete[] m_Points;
-        m_Points = nullptr;
+        freePoints();
         m_NumPoints = 0;
         return false;
     }
@@ -690,28 +666,11 @@ void Winding::Divide(const dplane_t &split, Winding **front, Winding **back, vec
     int i, j;
     int maxpts;
 
-    counts[0] = counts[1] = counts[2] = 0;
-
     // determine sides for each point
-    for (i = 0; i < m_NumPoints; i++)
-    {
-        dot = DotProduct(m_Points[i], split.normal);
-        dot -= split.dist;
-        dists[i] = dot;
-        if (dot > ON_EPSILON)
-        {
-            sides[i] = SIDE_FRONT;
-        }
-        else if (dot < -ON_EPSILON)
-        {
-            sides[i] = SIDE_BACK;
-        }
-        else
-        {
-            sides[i] = SIDE_ON;
-        }
-        counts[sides[i]]++;
-    }
+    vec3_t normal; // dplane_t may hold floats
+    VectorCopy(split.normal, normal);
+    ClassifyPoints(m_Points, m_NumPoints, normal, split.dist, epsilon, dists, sides, counts);
+    i = m_NumPoints;
     sides[i] = sides[0];
     dists[i] = dists[0];
 
@@ -722,9 +681,7 @@ void Winding::Divide(const dplane_t &split, Winding **front, Winding **back, vec
         vec_t sum = 0.0;
         for (i = 0; i < m_NumPoints; i++)
         {
-            dot = DotProduct(m_Points[i], split.normal);
-            dot -= split.dist;
-            sum += dot;
+            sum += dists[i];
         }
         if (sum > NORMAL_EPSILON)
         {
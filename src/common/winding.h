@@ -10,6 +10,7 @@
 
 constexpr int MAX_POINTS_ON_WINDING = 128;
 // TODO: FIX THIS STUPID SHIT (MAX_POINTS_ON_WINDING)
+constexpr int WINDING_INLINE_POINTS = 8; // windings up to this size keep their points inside the object
 
 constexpr int SIDE_FRONT = 0;
 constexpr int SIDE_ON = 2;
@@ -67,6 +68,8 @@ public:
   // Misc
 private:
   void initFromPlane(const vec3_t normal, const vec_t dist);
+  void allocPoints(uint32_t maxpoints);
+  void freePoints();
 
 public:
   // Data
@@ -75,4 +78,5 @@ public:
 
 protected:
   uint32_t m_MaxPoints;
+  vec3_t m_InlinePoints[WINDING_INLINE_POINTS];
 };
\ No newline at end of file
@@ -15,7 +15,12 @@
 #include "hlbsp.h"
 #include "arguments.h"
 #include "filelib.h"
+#include "hullio.h"
 #include "threads.h"
+#include "metrics.h"
+#include "threadtrace.h"
+#include "blockmem.h"
+#include "hlassert.h"
 
 vec3_t g_hull_size[NUM_HULLS][2] =
 	{
@@ -31,9 +36,8 @@ vec3_t g_hull_size[NUM_HULLS][2] =
 		{// 32x32x36
 		 {-16, -16, -18},
 		 {16, 16, 18}}};
-static FILE *polyfiles[NUM_HULLS];
-static FILE *brushfiles[NUM_HULLS];
-int g_hullnum = 0;
+static HullFile polyfiles[NUM_HULLS];
+static HullFile brushfiles[NUM_HULLS];
 
 static FaceBSP *validfaces[MAX_INTERNAL_MAP_PLANES];
 
@@ -67,12 +71,13 @@ dplane_t g_mapplanes[MAX_INTERNAL_MAP_PLANES];
 // =====================================================================================
 //  NewFaceFromFace
 //      Duplicates the non point information of a face, used by SplitFace and MergeFace.
+//      The new face has room for maxpoints points.
 // =====================================================================================
-auto NewFaceFromFace(const FaceBSP *const in) -> FaceBSP *
+auto NewFaceFromFace(const FaceBSP *const in, int maxpoints) -> FaceBSP *
 {
 	FaceBSP *newf;
 
-	newf = AllocFace();
+	newf = AllocFace(maxpoints);
 
 	newf->planenum = in->planenum;
 	newf->texturenum = in->texturenum;
@@ -184,17 +189,31 @@ static void SplitFaceTmp(FaceBSP *in, const dplane_t *const split, FaceBSP **fro
 		return;
 	}
 
-	*back = newf = NewFaceFromFace(in);
-	*front = new2 = NewFaceFromFace(in);
+	// count the points of either side, every split point goes to both
+	int numback = 0;
+	int numfront = 0;
+	for (i = 0; i < in->numpoints; i++)
+	{
+		numback += sides[i] != SIDE_FRONT;
+		numfront += sides[i] != SIDE_BACK;
+		if (sides[i] != SIDE_ON && sides[i + 1] != SIDE_ON && sides[i + 1] != sides[i])
+		{
+			numback++;
+			numfront++;
+		}
+	}
+	if (numback > MAXEDGES || numfront > MAXEDGES)
+	{
+		Error("SplitFace: numpoints > MAXEDGES");
+	}
+
+	*back = newf = NewFaceFromFace(in, numback);
+	*front = new2 = NewFaceFromFace(in, numfront);
 
 	// distribute the points and generate splits
 
 	for (i = 0; i < in->numpoints; i++)
 	{
-		if (newf->numpoints > MAXEDGES || new2->numpoints > MAXEDGES)
-		{
-			Error("SplitFace: numpoints > MAXEDGES");
-		}
 
 		p1 = in->pts[i];
 
@@ -249,10 +268,6 @@ static void SplitFaceTmp(FaceBSP *in, const dplane_t *const split, FaceBSP **fro
 		new2->numpoints++;
 	}
 
-	if (newf->numpoints > MAXEDGES || new2->numpoints > MAXEDGES)
-	{
-		Error("SplitFace: numpoints > MAXEDGES");
-	}
 	{
 		auto *wd = new Winding(newf->numpoints);
 		int x;
@@ -304,25 +319,51 @@ void SplitFace(FaceBSP *in, const dplane_t *const split, FaceBSP **front, FaceBS
 	// free the original face now that is is represented by the fragments
 	if (*front && *back)
 	{
-		delete in;
+		FreeFace(in);
 	}
 }
 
 // =====================================================================================
 //  AllocFace
+//      the face only has room for maxpoints points
 // =====================================================================================
-auto AllocFace() -> FaceBSP *
+auto AllocFace(int maxpoints) -> FaceBSP *
 {
 	FaceBSP *f;
 
-	f = new FaceBSP;
-	memset(f, 0, sizeof(FaceBSP));
+	hlassert(maxpoints >= 0 && maxpoints <= MAXEDGES);
+	f = (FaceBSP *)SlabAlloc(FaceSize(maxpoints));
+	memset(f, 0, FaceSize(maxpoints));
 
 	f->planenum = -1;
+	f->maxpoints = maxpoints;
 
 	return f;
 }
 
+// =====================================================================================
+//  FreeFace
+// =====================================================================================
+void FreeFace(FaceBSP *f)
+{
+	SlabFree(f, FaceSize(f->maxpoints));
+}
+
+// =====================================================================================
+//  CopyFace
+//      everything but the room for points, dest needs enough for those of src
+// =====================================================================================
+void CopyFace(FaceBSP *dest, const FaceBSP *src)
+{
+	int maxpoints = dest->maxpoints;
+	if (src->numpoints > maxpoints)
+	{
+		Error("CopyFace: %i points, room for %i", src->numpoints, maxpoints);
+	}
+	memcpy(dest, src, FaceSize(qmax(src->numpoints, 0)));
+	dest->maxpoints = maxpoints;
+}
+
 // =====================================================================================
 //  AllocSurface
 // =====================================================================================
@@ -330,7 +371,7 @@ auto AllocSurface() -> SurfaceBSP *
 {
 	SurfaceBSP *s;
 
-	s = new SurfaceBSP;
+	s = (SurfaceBSP *)SlabAlloc(sizeof(SurfaceBSP));
 	memset(s, 0, sizeof(SurfaceBSP));
 
 	return s;
@@ -341,7 +382,7 @@ auto AllocSurface() -> SurfaceBSP *
 // =====================================================================================
 void FreeSurface(SurfaceBSP *s)
 {
-	delete s;
+	SlabFree(s, sizeof(SurfaceBSP));
 }
 
 // =====================================================================================
@@ -351,7 +392,7 @@ auto AllocPortal() -> PortalBSP *
 {
 	PortalBSP *p;
 
-	p = new PortalBSP;
+	p = (PortalBSP *)SlabAlloc(sizeof(PortalBSP));
 	memset(p, 0, sizeof(PortalBSP));
 
 	return p;
@@ -362,13 +403,13 @@ auto AllocPortal() -> PortalBSP *
 // =====================================================================================
 void FreePortal(PortalBSP *p) // consider: inline
 {
-	delete p;
+	SlabFree(p, sizeof(PortalBSP));
 }
 
 auto AllocSide() -> SideBSP *
 {
 	SideBSP *s;
-	s = new SideBSP;
+	s = (SideBSP *)SlabAlloc(sizeof(SideBSP));
 	memset(s, 0, sizeof(SideBSP));
 	return s;
 }
@@ -379,7 +420,7 @@ void FreeSide(SideBSP *s)
 	{
 		delete s->w;
 	}
-	delete s;
+	SlabFree(s, sizeof(SideBSP));
 	return;
 }
 
@@ -395,7 +436,7 @@ auto NewSideFromSide(const SideBSP *s) -> SideBSP *
 auto AllocBrush() -> BrushBSP *
 {
 	BrushBSP *b;
-	b = new BrushBSP;
+	b = (BrushBSP *)SlabAlloc(sizeof(BrushBSP));
 	memset(b, 0, sizeof(BrushBSP));
 	return b;
 }
@@ -411,7 +452,7 @@ void FreeBrush(BrushBSP *b)
 			FreeSide(s);
 		}
 	}
-	delete b;
+	SlabFree(b, sizeof(BrushBSP));
 	return;
 }
 
@@ -579,12 +620,20 @@ auto AllocNode() -> NodeBSP *
 {
 	NodeBSP *n;
 
-	n = new NodeBSP;
+	n = (NodeBSP *)SlabAlloc(sizeof(NodeBSP));
 	memset(n, 0, sizeof(NodeBSP));
 
 	return n;
 }
 
+// =====================================================================================
+//  FreeNode
+// =====================================================================================
+void FreeNode(NodeBSP *n)
+{
+	SlabFree(n, sizeof(NodeBSP));
+}
+
 // =====================================================================================
 //  AddPointToBounds
 // =====================================================================================
@@ -801,105 +850,79 @@ static auto SetFaceType(FaceBSP *f) -> facestyle_e
 // =====================================================================================
 //  ReadSurfs
 // =====================================================================================
-static auto ReadSurfs(FILE *file) -> SurfchainBSP *
+static auto ReadSurfs(HullFile &file) -> SurfchainBSP *
 {
-	int r;
-	int detaillevel;
-	int planenum, texinfo, contents, numpoints;
+	HullFaceRecord record;
 	FaceBSP *f;
-	int i;
-	double v[3];
-	int line = 0;
-	double inaccuracy, inaccuracy_count = 0.0, inaccuracy_total = 0.0, inaccuracy_max = 0.0;
+	size_t offset;
 
 	// read in the polygons
 	while (true)
 	{
-		if (file == polyfiles[2] && g_nohull2)
+		if (&file == &polyfiles[2] && g_nohull2)
 			break;
-		line++;
-		r = fscanf(file, "%i %i %i %i %i\n", &detaillevel, &planenum, &texinfo, &contents, &numpoints);
-		if (r == 0 || r == -1)
+		offset = file.pos;
+		if (!HullFileRead(file, &record, sizeof(record)))
 		{
 			return nullptr;
 		}
-		if (planenum == -1) // end of model
+		if (record.planenum == -1) // end of model
 		{
 			break;
 		}
-		if (r != 5)
+		if (record.numpoints < 0)
 		{
-			Error("ReadSurfs (line %i): scanf failure", line);
+			Error("ReadSurfs (offset %zu): numpoints %i < 0", offset, record.numpoints);
 		}
-		if (numpoints > MAXPOINTS)
+		if (record.numpoints > MAXPOINTS)
 		{
-			Error("ReadSurfs (line %i): %i > MAXPOINTS\nThis is caused by a face with too many verticies (typically found on end-caps of high-poly cylinders)\n", line, numpoints);
+			Error("ReadSurfs (offset %zu): %i > MAXPOINTS\nThis is caused by a face with too many verticies (typically found on end-caps of high-poly cylinders)\n", offset, record.numpoints);
 		}
-		if (planenum > g_bspnumplanes)
+		if (record.planenum < 0 || record.planenum >= g_bspnumplanes)
 		{
-			Error("ReadSurfs (line %i): %i > g_bspnumplanes\n", line, planenum);
+			Error("ReadSurfs (offset %zu): planenum %i not in 0..%i\n", offset, record.planenum, g_bspnumplanes - 1);
 		}
-		if (texinfo > g_bspnumtexinfo)
+		if (record.texinfo < -1 || record.texinfo >= g_bspnumtexinfo)
 		{
-			Error("ReadSurfs (line %i): %i > g_bspnumtexinfo", line, texinfo);
+			Error("ReadSurfs (offset %zu): texinfo %i not in -1..%i", offset, record.texinfo, g_bspnumtexinfo - 1);
 		}
-		if (detaillevel < 0)
+		if (record.detaillevel < 0)
 		{
-			Error("ReadSurfs (line %i): detaillevel %i < 0", line, detaillevel);
+			Error("ReadSurfs (offset %zu): detaillevel %i < 0", offset, record.detaillevel);
 		}
 
-		if (!strcasecmp(GetTextureByNumber(texinfo), "skip"))
+		if (!strcasecmp(GetTextureByNumber(record.texinfo), "skip"))
 		{
-			for (i = 0; i < numpoints; i++)
-			{
-				line++;
-				r = fscanf(file, "%lf %lf %lf\n", &v[0], &v[1], &v[2]);
-				if (r != 3)
-				{
-					Error("::ReadSurfs (face_skip), fscanf of points failed at line %i", line);
-				}
-			}
-			fscanf(file, "\n");
+			double skipped[MAXPOINTS][3];
+			HullFileReadPoints(file, skipped, record.numpoints);
 			continue;
 		}
 
-		f = AllocFace();
-		f->detaillevel = detaillevel;
-		f->planenum = planenum;
-		f->texturenum = texinfo;
-		f->contents = contents;
-		f->numpoints = numpoints;
-		f->next = validfaces[planenum];
-		validfaces[planenum] = f;
+		f = AllocFace(record.numpoints);
+		f->detaillevel = record.detaillevel;
+		f->planenum = record.planenum;
+		f->texturenum = record.texinfo;
+		f->contents = record.contents;
+		f->numpoints = record.numpoints;
+		f->next = validfaces[record.planenum];
+		validfaces[record.planenum] = f;
 
 		SetFaceType(f);
 
-		for (i = 0; i < f->numpoints; i++)
-		{
-			line++;
-			r = fscanf(file, "%lf %lf %lf\n", &v[0], &v[1], &v[2]);
-			if (r != 3)
-			{
-				Error("::ReadSurfs (face_normal), fscanf of points failed at line %i", line);
-			}
-			VectorCopy(v, f->pts[i]);
-		}
-		fscanf(file, "\n");
+		HullFileReadPoints(file, f->pts, f->numpoints);
 	}
 
 	return SurflistFromValidFaces();
 }
-static auto ReadBrushes(FILE *file) -> BrushBSP *
+static auto ReadBrushes(HullFile &file) -> BrushBSP *
 {
 	BrushBSP *brushes = nullptr;
 	while (true)
 	{
-		if (file == brushfiles[2] && g_nohull2)
+		if (&file == &brushfiles[2] && g_nohull2)
 			break;
-		int r;
-		int brushinfo;
-		r = fscanf(file, "%i\n", &brushinfo);
-		if (r == 0 || r == -1)
+		int32_t brushinfo;
+		if (!HullFileRead(file, &brushinfo, sizeof(brushinfo)))
 		{
 			if (brushes == nullptr)
 			{
@@ -922,31 +945,26 @@ static auto ReadBrushes(FILE *file) -> BrushBSP *
 		psn = &b->sides;
 		while (true)
 		{
-			int planenum;
-			int numpoints;
-			r = fscanf(file, "%i %u\n", &planenum, &numpoints);
-			if (r != 2)
+			HullSideRecord side;
+			if (!HullFileRead(file, &side, sizeof(side)))
 			{
 				Error("ReadBrushes: get side failed");
 			}
-			if (planenum == -1)
+			if (side.planenum == -1)
 			{
 				break;
 			}
+			if (side.planenum < 0 || side.planenum >= g_bspnumplanes || side.numpoints < 0)
+			{
+				Error("ReadBrushes: bad side (offset %zu)", file.pos - sizeof(side));
+			}
 			SideBSP *s;
 			s = AllocSide();
-			s->plane = g_mapplanes[planenum ^ 1];
-			s->w = new Winding(numpoints);
-			int x;
-			for (x = 0; x < numpoints; x++)
+			s->plane = g_mapplanes[side.planenum ^ 1];
+			s->w = new Winding(side.numpoints);
+			for (int x = 0; x < side.numpoints; x++)
 			{
-				double v[3];
-				r = fscanf(file, "%lf %lf %lf\n", &v[0], &v[1], &v[2]);
-				if (r != 3)
-				{
-					Error("ReadBrushes: get point failed");
-				}
-				VectorCopy(v, s->w->m_Points[numpoints - 1 - x]);
+				HullFileReadPoints(file, &s->w->m_Points[side.numpoints - 1 - x], 1);
 			}
 			s->next = nullptr;
 			*psn = s;
@@ -957,21 +975,82 @@ static auto ReadBrushes(FILE *file) -> BrushBSP *
 }
 
 // =====================================================================================
-//  ProcessModel (model a.k.a brush entities)
+//  BuildHullTask
+//      The hulls of a model share nothing until they are written out, so each is a task
+//      of its own, which also forks its tree build into more tasks.
+//      The world's hull 0 is built and leak checked on the calling task while the clipping
+//      hulls build; with -leakonly they are only started once hull 0 has passed, so a
+//      leaking map stops without building them.
 // =====================================================================================
-static auto ProcessModel() -> bool
+struct HullBuild
 {
+	int hullnum;
+	bool report_progress;
 	SurfchainBSP *surfs;
 	BrushBSP *detailbrushes;
 	NodeBSP *nodes;
+};
+
+static void BuildHullTask(void *data)
+{
+	auto *hull = (HullBuild *)data;
+
+	// SolidBSP generates a node tree
+	hull->nodes = SolidBSP(hull->surfs, hull->detailbrushes, hull->hullnum, hull->report_progress);
+}
+
+static void BuildHullsTask(void *data)
+{
+	auto *hulls = (HullBuild *)data;
+	TaskGroup group;
+
+	if (!g_bLeakOnly)
+	{
+		for (int hullnum = 1; hullnum < NUM_HULLS; hullnum++)
+		{
+			AddTask(group, BuildHullTask, &hulls[hullnum]);
+		}
+	}
+
+	BuildHullTask(&hulls[0]);
+	// build all the portals in the bsp tree
+	// some portals are solid polygons, and some are paths to other leafs
+	if (g_bspnummodels == 1) // assume non-world bmodels are simple
+	{
+		FillInside(hulls[0].nodes, 0);
+		hulls[0].nodes = FillOutside(hulls[0].nodes, (g_bLeaked != true), 0); // make a leakfile if bad
+	}
+
+	if (g_bLeakOnly)
+	{
+		for (int hullnum = 1; hullnum < NUM_HULLS; hullnum++)
+		{
+			AddTask(group, BuildHullTask, &hulls[hullnum]);
+		}
+	}
+	WaitTasks(group);
+}
+
+// =====================================================================================
+//  ProcessModel (model a.k.a brush entities)
+// =====================================================================================
+static auto ProcessModel() -> bool
+{
+	HullBuild hulls[NUM_HULLS];
+	NodeBSP *nodes;
 	BSPLumpModel *model;
 	int startleafs;
 
-	surfs = ReadSurfs(polyfiles[0]);
+	hulls[0].surfs = ReadSurfs(polyfiles[0]);
 
-	if (!surfs)
+	if (!hulls[0].surfs)
 		return false; // all models are done
-	detailbrushes = ReadBrushes(brushfiles[0]);
+	hulls[0].detailbrushes = ReadBrushes(brushfiles[0]);
+	for (int hullnum = 1; hullnum < NUM_HULLS; hullnum++)
+	{
+		hulls[hullnum].surfs = ReadSurfs(polyfiles[hullnum]);
+		hulls[hullnum].detailbrushes = ReadBrushes(brushfiles[hullnum]);
+	}
 
 	hlassume(g_bspnummodels < MAX_MAP_MODELS, assume_MAX_MAP_MODELS);
 
@@ -980,14 +1059,15 @@ static auto ProcessModel() -> bool
 	model = &g_bspmodels[modnum];
 	g_bspnummodels++;
 
-	g_hullnum = 0; // vluzacn
 	VectorFill(model->mins, 99999);
 	VectorFill(model->maxs, -99999);
+	for (int hullnum = 0; hullnum < NUM_HULLS; hullnum++)
 	{
+		SurfchainBSP *surfs = hulls[hullnum].surfs;
 		vec3_t mins, maxs;
 		int i;
-		VectorSubtract(surfs->mins, g_hull_size[g_hullnum][0], mins);
-		VectorSubtract(surfs->maxs, g_hull_size[g_hullnum][1], maxs);
+		VectorSubtract(surfs->mins, g_hull_size[hullnum][0], mins);
+		VectorSubtract(surfs->maxs, g_hull_size[hullnum][1], maxs);
 		for (i = 0; i < 3; i++)
 		{
 			if (mins[i] > maxs[i])
@@ -1003,21 +1083,15 @@ static auto ProcessModel() -> bool
 			model->maxs[i] = qmax(model->maxs[i], maxs[i]);
 			model->mins[i] = qmin(model->mins[i], mins[i]);
 		}
-	}
-
-	// SolidBSP generates a node tree
-	nodes = SolidBSP(surfs,
-					 detailbrushes,
-					 modnum == 0);
 
-	// build all the portals in the bsp tree
-	// some portals are solid polygons, and some are paths to other leafs
-	if (g_bspnummodels == 1) // assume non-world bmodels are simple
-	{
-		FillInside(nodes);
-		nodes = FillOutside(nodes, (g_bLeaked != true), 0); // make a leakfile if bad
+		hulls[hullnum].hullnum = hullnum;
+		hulls[hullnum].report_progress = modnum == 0;
 	}
 
+	// build the trees of all hulls at once, then write them out in hull order
+	RunTasks(BuildHullsTask, hulls, "BuildHullsTask");
+	nodes = hulls[0].nodes;
+
 	FreePortals(nodes);
 
 	// fix tjunctions
@@ -1071,38 +1145,12 @@ static auto ProcessModel() -> bool
 	model->visleafs = g_bspnumleafs - startleafs;
 
 	// the clipping hulls are simpler
-	for (g_hullnum = 1; g_hullnum < NUM_HULLS; g_hullnum++)
+	for (int hullnum = 1; hullnum < NUM_HULLS; hullnum++)
 	{
-		surfs = ReadSurfs(polyfiles[g_hullnum]);
-		detailbrushes = ReadBrushes(brushfiles[g_hullnum]);
-		{
-			int hullnum = g_hullnum;
-			vec3_t mins, maxs;
-			int i;
-			VectorSubtract(surfs->mins, g_hull_size[hullnum][0], mins);
-			VectorSubtract(surfs->maxs, g_hull_size[hullnum][1], maxs);
-			for (i = 0; i < 3; i++)
-			{
-				if (mins[i] > maxs[i])
-				{
-					vec_t tmp;
-					tmp = (mins[i] + maxs[i]) / 2;
-					mins[i] = tmp;
-					maxs[i] = tmp;
-				}
-			}
-			for (i = 0; i < 3; i++)
-			{
-				model->maxs[i] = qmax(model->maxs[i], maxs[i]);
-				model->mins[i] = qmin(model->mins[i], mins[i]);
-			}
-		}
-		nodes = SolidBSP(surfs,
-						 detailbrushes,
-						 modnum == 0);
+		nodes = hulls[hullnum].nodes;
 		if (g_bspnummodels == 1) // assume non-world bmodels are simple
 		{
-			nodes = FillOutside(nodes, (g_bLeaked != true), g_hullnum);
+			nodes = FillOutside(nodes, (g_bLeaked != true), hullnum);
 		}
 		FreePortals(nodes);
 		/*
@@ -1113,11 +1161,11 @@ static auto ProcessModel() -> bool
 		*/
 		if (nodes->planenum == -1) // empty!
 		{
-			model->headnode[g_hullnum] = nodes->contents;
+			model->headnode[hullnum] = nodes->contents;
 		}
 		else
 		{
-			model->headnode[g_hullnum] = g_bspnumclipnodes;
+			model->headnode[hullnum] = g_bspnumclipnodes;
 			WriteClipNodes(nodes);
 		}
 	}
@@ -1192,14 +1240,9 @@ static void ProcessFile(const char *const filename)
 	{
 		// mapname.p[0-3]
 		snprintf(name, sizeof(name), "%s.p%i", filename, i);
-		polyfiles[i] = fopen(name, "r");
-
-		if (!polyfiles[i])
-			Error("Can't open %s", name);
+		OpenHullFile(polyfiles[i], name);
 		snprintf(name, sizeof(name), "%s.b%i", filename, i);
-		brushfiles[i] = fopen(name, "r");
-		if (!brushfiles[i])
-			Error("Can't open %s", name);
+		OpenHullFile(brushfiles[i], name);
 	}
 	{
 		FILE *f;
@@ -1270,7 +1313,10 @@ static void ProcessFile(const char *const filename)
 
 	// process each model individually
 	while (ProcessModel())
-		;
+	{
+		FreePools(); // the windings of one model are all freed by now
+		FreeSlabs(); // and nothing of its trees is looked at again
+	}
 
 	// write the updated bsp file out
 	FinishBSPFile();
@@ -1279,12 +1325,10 @@ static void ProcessFile(const char *const filename)
 	for (i = 0; i < NUM_HULLS; i++)
 	{
 		snprintf(name, sizeof(name), "%s.p%i", filename, i);
-		fclose(polyfiles[i]);
-		polyfiles[i] = nullptr;
+		CloseHullFile(polyfiles[i]);
 		unlink(name);
 		snprintf(name, sizeof(name), "%s.b%i", filename, i);
-		fclose(brushfiles[i]);
-		brushfiles[i] = nullptr;
+		CloseHullFile(brushfiles[i]);
 		unlink(name);
 	}
 	safe_snprintf(name, _MAX_PATH, "%s.hsz", filename);
@@ -1302,6 +1346,10 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
 		{
 			g_nohull2 = true;
 		}
+		else if (!strcasecmp(argv[i], "-leakonly"))
+		{
+			g_bLeakOnly = true;
+		}
 		else if (!strcasecmp(argv[i], "-subdivide"))
 		{
 			if (i + 1 < argc) // added "1" .--vluzacn
@@ -1380,6 +1428,30 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
 				Usage(ProgramType::PROGRAM_BSP);
 			}
 		}
+		else if (!strcasecmp(argv[i], "-threads"))
+		{
+			if (i + 1 < argc)
+			{
+				g_numthreads = atoi(argv[++i]);
+				if (g_numthreads < 1)
+				{
+					Log("Expected value of at least 1 for '-threads'\n");
+					Usage(ProgramType::PROGRAM_BSP);
+				}
+			}
+			else
+			{
+				Usage(ProgramType::PROGRAM_BSP);
+			}
+		}
+		else if (!strcasecmp(argv[i], "-pin"))
+		{
+			g_threadpin = true;
+		}
+		else if (!strcasecmp(argv[i], "-trace"))
+		{
+			g_threadtrace = true;
+		}
 		else if (!mapname_from_arg)
 		{
 			mapname_from_arg = argv[i];
@@ -1420,6 +1492,9 @@ auto main(const int argc, char **argv) -> int
 	StripExtension(g_Mapname);
 
 	atexit(CloseLog);
+	MetricsStart();
+	atexit(MetricsWriteReport);
+	atexit(ThreadTraceWrite);
 	ThreadSetDefault();
 	ThreadSetPriority(g_threadpriority);
 	LogArguments(argc, argv);
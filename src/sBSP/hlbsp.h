@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 #include "messages.h"
 #include "win32fix.h"
 #include "mathlib.h"
@@ -52,11 +54,19 @@ struct FaceBSP // This structure is layed out so 'pts' is on a quad-word boundar
     int numpoints;
     facestyle_e facestyle;
     int referenced; // only valid for original faces
+    bool intree;    // in the surface tree of its node, while the bsp is built
+    int maxpoints;  // room allocated for pts, never more than MAXEDGES
 
     // vector quad word aligned
-    vec3_t pts[MAXEDGES]; // FIXME: change to use winding_t
+    vec3_t pts[]; // FIXME: change to use winding_t
 };
 
+// bytes of a face with room for maxpoints points
+constexpr auto FaceSize(int maxpoints) -> size_t
+{
+    return offsetof(FaceBSP, pts) + maxpoints * sizeof(vec3_t);
+}
+
 struct SurfaceBSP
 {
     struct SurfaceBSP *next;
@@ -99,6 +109,9 @@ struct NodeBSP
     BrushBSP *detailbrushes;
     BrushBSP *boundsbrush;
     vec3_t loosemins, loosemaxs; // all leafs and nodes have this, while 'mins' and 'maxs' are only valid for nondetail leafs and nodes.
+    BrushBSP *cell;              // nondetail nodes while the tree is built: the volume their portals will enclose
+    struct surfacetreenode_t *surfacetree; // while the tree is built: its faces not on a node, for choosing the split
+    struct planecounts_t *planecounts;     // while the tree is built: split counts handed down by the parent, see ChoosePlaneFromList
 
     bool isdetail;         // is under a diskleaf
     bool isportalleaf;     // not detail and children are detail; only visleafs have contents, portals, mins, maxs
@@ -127,6 +140,7 @@ constexpr int NUM_HULLS = 4;
 extern void SubdivideFace(FaceBSP *f, FaceBSP **prevptr);
 extern auto SolidBSP(const SurfchainBSP *const surfhead,
                      BrushBSP *detailbrushes,
+                     int hullnum,
                      bool report_progress) -> NodeBSP *;
 
 //=============================================================================
@@ -150,11 +164,11 @@ struct PortalBSP
     Winding *winding;
 };
 
-extern NodeBSP g_outside_node; // portals outside the world face this
+extern NodeBSP g_outside_nodes[NUM_HULLS]; // portals outside the world of each hull face these
 
 extern void AddPortalToNodes(PortalBSP *p, NodeBSP *front, NodeBSP *back);
 extern void RemovePortalFromNode(PortalBSP *portal, NodeBSP *l);
-extern void MakeHeadnodePortals(NodeBSP *node, const vec3_t mins, const vec3_t maxs);
+extern void MakeHeadnodePortals(NodeBSP *node, NodeBSP *outside, const vec3_t mins, const vec3_t maxs);
 
 extern void FreePortals(NodeBSP *node);
 extern void WritePortalfile(NodeBSP *headnode);
@@ -176,12 +190,14 @@ extern void FinishBSPFile();
 extern auto FillOutside(NodeBSP *node, bool leakfile, unsigned hullnum) -> NodeBSP *;
 extern void LoadAllowableOutsideList(const char *const filename);
 extern void FreeAllowableOutsideList();
-extern void FillInside(NodeBSP *node);
+extern void FillInside(NodeBSP *node, unsigned hullnum);
 
 //=============================================================================
 // misc functions
 
-extern auto AllocFace() -> FaceBSP *;
+extern auto AllocFace(int maxpoints) -> FaceBSP *;
+extern void FreeFace(FaceBSP *f);
+extern void CopyFace(FaceBSP *dest, const FaceBSP *src);
 
 extern auto AllocPortal() -> struct PortalBSP *;
 extern void FreePortal(struct PortalBSP *p);
@@ -200,6 +216,7 @@ extern auto BrushFromBox(const vec3_t mins, const vec3_t maxs) -> BrushBSP *;
 extern void CalcBrushBounds(const BrushBSP *b, vec3_t &mins, vec3_t &maxs);
 
 extern auto AllocNode() -> NodeBSP *;
+extern void FreeNode(NodeBSP *n);
 
 extern auto CheckFaceForHint(const FaceBSP *const f) -> bool;
 extern auto CheckFaceForSkip(const FaceBSP *const f) -> bool;
@@ -235,7 +252,6 @@ extern bool g_watervis;
 extern bool g_estimate;
 extern int g_maxnode_size;
 extern int g_subdivide_size;
-extern int g_hullnum;
 extern bool g_bLeakOnly;
 extern bool g_bLeaked;
 extern char g_portfilename[_MAX_PATH];
@@ -246,7 +262,7 @@ extern char g_extentfilename[_MAX_PATH];
 
 extern bool g_nohull2;
 
-extern auto NewFaceFromFace(const FaceBSP *const in) -> FaceBSP *;
+extern auto NewFaceFromFace(const FaceBSP *const in, int maxpoints) -> FaceBSP *;
 extern void SplitFace(FaceBSP *in, const dplane_t *const split, FaceBSP **front, FaceBSP **back);
 
 void HandleArgs(int argc, char **argv, const char *&mapname_from_arg);
\ No newline at end of file
@@ -145,7 +145,7 @@ static auto TryMerge(FaceBSP *f1, FaceBSP *f2) -> FaceBSP *
         return nullptr;
     }
 
-    newf = NewFaceFromFace(f1);
+    newf = NewFaceFromFace(f1, f1->numpoints + f2->numpoints);
 
     // copy first polygon
     for (k = (i + 1) % f1->numpoints; k != i; k = (k + 1) % f1->numpoints)
@@ -189,7 +189,7 @@ static auto MergeFaceToList(FaceBSP *face, FaceBSP *list) -> FaceBSP *
         {
             continue;
         }
-        delete face;
+        FreeFace(face);
         f->numpoints = -1; // merged out
         return MergeFaceToList(newf, list);
     }
@@ -213,7 +213,7 @@ static auto FreeMergeListScraps(FaceBSP *merged) -> FaceBSP *
         next = merged->next;
         if (merged->numpoints == -1)
         {
-            delete merged;
+            FreeFace(merged);
         }
         else
         {
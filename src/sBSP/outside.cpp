@@ -114,14 +114,14 @@ static void FreeDetailNode_r(NodeBSP *n)
     for (i = 0; i < 2; i++)
     {
         FreeDetailNode_r(n->children[i]);
-        delete n->children[i];
+        FreeNode(n->children[i]);
         n->children[i] = nullptr;
     }
     FaceBSP *f, *next;
     for (f = n->faces; f; f = next)
     {
         next = f->next;
-        delete f;
+        FreeFace(f);
     }
     n->faces = nullptr;
 }
@@ -249,7 +249,7 @@ static auto ClearOutFaces_r(NodeBSP *node) -> NodeBSP *
             if (f->outputnumber == -1)
             { // never referenced, so free it
                 c_free_faces++;
-                delete f;
+                FreeFace(f);
             }
             else
             {
@@ -486,13 +486,14 @@ auto FillOutside(NodeBSP *node, const bool leakfile, const unsigned hullnum) ->
         return node;
     }
 
-    if (!g_outside_node.portals)
+    NodeBSP *outside = &g_outside_nodes[hullnum];
+    if (!outside->portals)
     {
         Warning("No outside node portal found in hull %i, no filling performed for this hull", hullnum);
         return node;
     }
 
-    s = !(g_outside_node.portals->nodes[1] == &g_outside_node);
+    s = !(outside->portals->nodes[1] == outside);
 
     // first check to see if an occupied leaf is hit
     outleafs = 0;
@@ -515,7 +516,7 @@ auto FillOutside(NodeBSP *node, const bool leakfile, const unsigned hullnum) ->
         }
     }
 
-    ret = RecursiveFillOutside(g_outside_node.portals->nodes[s], false);
+    ret = RecursiveFillOutside(outside->portals->nodes[s], false);
 
     if (leakfile)
     {
@@ -564,7 +565,7 @@ auto FillOutside(NodeBSP *node, const bool leakfile, const unsigned hullnum) ->
 
     // now go back and fill things in
     valid++;
-    RecursiveFillOutside(g_outside_node.portals->nodes[s], true);
+    RecursiveFillOutside(outside->portals->nodes[s], true);
 
     // remove faces and nodes from filled in leafs
     c_falsenodes = 0;
@@ -629,10 +630,10 @@ void RemoveUnused_r(NodeBSP *node)
         RemoveUnused_r(node->children[1]);
     }
 }
-void FillInside(NodeBSP *node)
+void FillInside(NodeBSP *node, unsigned hullnum)
 {
     int i;
-    g_outside_node.empty = 0;
+    g_outside_nodes[hullnum].empty = 0;
     ResetMark_r(node);
     for (i = 1; i < g_numentities; i++)
     {
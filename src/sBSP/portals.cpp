@@ -4,7 +4,7 @@
 #include "hlbsp.h"
 #include "log.h"
 
-NodeBSP g_outside_node; // portals outside the world face this
+NodeBSP g_outside_nodes[NUM_HULLS]; // portals outside the world of each hull face these
 
 //=============================================================================
 
@@ -86,10 +86,10 @@ void RemovePortalFromNode(PortalBSP *portal, NodeBSP *l)
  * ================
  * MakeHeadnodePortals
  *
- * The created portals will face the global g_outside_node
+ * The created portals will face outside, the outside node of the hull
  * ================
  */
-void MakeHeadnodePortals(NodeBSP *node, const vec3_t mins, const vec3_t maxs)
+void MakeHeadnodePortals(NodeBSP *node, NodeBSP *outside, const vec3_t mins, const vec3_t maxs)
 {
     vec3_t bounds[2];
     int i, j, n;
@@ -105,8 +105,8 @@ void MakeHeadnodePortals(NodeBSP *node, const vec3_t mins, const vec3_t maxs)
         bounds[1][i] = maxs[i] + SIDESPACE;
     }
 
-    g_outside_node.contents = contents_t::CONTENTS_SOLID;
-    g_outside_node.portals = nullptr;
+    outside->contents = contents_t::CONTENTS_SOLID;
+    outside->portals = nullptr;
 
     for (i = 0; i < 3; i++)
     {
@@ -131,7 +131,7 @@ void MakeHeadnodePortals(NodeBSP *node, const vec3_t mins, const vec3_t maxs)
             }
             p->plane = *pl;
             p->winding = new Winding(*pl);
-            AddPortalToNodes(p, node, &g_outside_node);
+            AddPortalToNodes(p, node, outside);
         }
     }
 
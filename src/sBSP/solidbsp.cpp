@@ -1,77 +1,52 @@
 #include <vector>
+#include <algorithm>
 #include <cstring>
+#include <atomic>
 
 #include "hlbsp.h"
 #include "log.h"
+#include "threads.h"
 #include "hlassert.h"
+#include "planeside.h"
 
 //  Each node or leaf will have a set of portals that completely enclose
 //  the volume of the node and pass into an adjacent node.
 
 int g_maxnode_size = DEFAULT_MAXNODE_SIZE;
 
-static bool g_reportProgress = false;
-static int g_numProcessed = 0;
-static int g_numReported = 0;
+// Children with fewer surfaces than this are built by the thread that split their parent
+constexpr int BSP_TASK_MIN_SURFACES = 64;
 
-static void ResetStatus(bool report_progress)
+// State of one SolidBSP call, shared by the tasks that build its tree
+struct BspBuild
 {
-	g_reportProgress = report_progress;
-	g_numProcessed = g_numReported = 0;
-}
+	int hullnum;
+	TaskGroup tasks;
+	std::atomic<int> numnodes{0};
+};
 
-static void UpdateStatus()
+struct BspBuildTask
 {
-	if (g_reportProgress)
-	{
-		++g_numProcessed;
-		if ((g_numProcessed / 500) > g_numReported)
-		{
-			g_numReported = (g_numProcessed / 500);
-			Log("%d...", g_numProcessed);
-		}
-	}
-}
+	BspBuild *build;
+	NodeBSP *node;
+};
+
+// FaceSideForRange counts an epsilonsplit for faces that come closer to the plane than epsilonmax
+// without crossing it by more than epsilonmin
+constexpr vec_t FACESIDE_EPSILONMIN = 0.002;
+constexpr vec_t FACESIDE_EPSILONMAX = 0.2;
 
 // =====================================================================================
-//  FaceSide
+//  FaceSideForRange
 //      For BSP hueristic
+//      low and high are the smallest and largest distance of the points of the face from the plane
 // =====================================================================================
-static auto FaceSide(FaceBSP *in, const dplane_t *const split, double *epsilonsplit = nullptr) -> int
+static auto FaceSideForRange(vec_t low, vec_t high, double *epsilonsplit) -> int
 {
-	const vec_t epsilonmin = 0.002, epsilonmax = 0.2;
-	vec_t d_front, d_back;
-	vec_t dot;
-	int i;
-	vec_t *p;
+	const vec_t epsilonmin = FACESIDE_EPSILONMIN, epsilonmax = FACESIDE_EPSILONMAX;
+	vec_t d_front = qmax(high, (vec_t)0);
+	vec_t d_back = qmin(low, (vec_t)0);
 
-	d_front = d_back = 0;
-
-	// axial planes are fast
-	if (split->type <= last_axial)
-	{
-		for (i = 0, p = in->pts[0] + split->type; i < in->numpoints; i++, p += 3)
-		{
-			dot = *p - split->dist;
-			if (dot > d_front)
-				d_front = dot;
-			if (dot < d_back)
-				d_back = dot;
-		}
-	}
-	else
-	{
-		// sloping planes take longer
-		for (i = 0, p = in->pts[0]; i < in->numpoints; i++, p += 3)
-		{
-			dot = DotProduct(p, split->normal);
-			dot -= split->dist;
-			if (dot > d_front)
-				d_front = dot;
-			if (dot < d_back)
-				d_back = dot;
-		}
-	}
 	if (d_front <= ON_EPSILON)
 	{
 		if (d_front > epsilonmin || d_back > -epsilonmax)
@@ -98,62 +73,212 @@ static auto FaceSide(FaceBSP *in, const dplane_t *const split, double *epsilonsp
 	return SIDE_ON;
 }
 
+// Faces to be tested against one plane together, see FaceSides
+struct FaceSideBatch
+{
+	std::vector<FaceBSP *> faces;
+	std::vector<vec_t> lows;
+	std::vector<vec_t> highs;
+	// sloping planes
+	std::vector<const vec3_t *> points;
+	std::vector<int> numpoints;
+};
+
+// =====================================================================================
+//  FaceSides
+//      fills in batch.lows and batch.highs for FaceSideForRange, for all faces at once
+// =====================================================================================
+static void FaceSides(FaceSideBatch &batch, const dplane_t *const split)
+{
+	int count = batch.faces.size();
+	batch.lows.resize(count);
+	batch.highs.resize(count);
+
+	// axial planes are fast
+	if (split->type <= last_axial)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			vec_t low = BSP_BOGUS_RANGE, high = -BSP_BOGUS_RANGE;
+			const FaceBSP *f = batch.faces[i];
+			for (int j = 0; j < f->numpoints; j++)
+			{
+				vec_t dot = f->pts[j][split->type] - split->dist;
+				low = qmin(low, dot);
+				high = qmax(high, dot);
+			}
+			batch.lows[i] = low;
+			batch.highs[i] = high;
+		}
+		return;
+	}
+
+	// sloping planes take longer
+	batch.points.resize(count);
+	batch.numpoints.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		batch.points[i] = batch.faces[i]->pts;
+		batch.numpoints[i] = batch.faces[i]->numpoints;
+	}
+	DistanceRanges(batch.points.data(), batch.numpoints.data(), count, split->normal, split->dist, batch.lows.data(), batch.highs.data());
+}
+
 // organize all surfaces into a tree structure to accelerate intersection test
 // can reduce more than 90% compile time for very complicated maps
+//
+// Every node keeps the tree of its surfaces while the bsp is built. SplitSurfaceTree hands
+// the faces that stay whole to the children along with their tree nodes, so the tree is
+// built once per model; faces the split plane cuts or touches are taken out and put back by
+// AddCutFaces once SplitNodeSurfaces has made their fragments.
+
+constexpr int SURFACETREE_LEAF_SIZE = 5;
 
 struct surfacetreenode_t
 {
 	int size; // can be zero, which invalidates mins and maxs
 	int size_discardable;
+	int mindetaillevel; // of all its faces
 	vec3_t mins;
 	vec3_t maxs;
 	bool isleaf;
+	std::vector<FaceBSP *> faces; // leaf: all its faces; node: the faces too big for either child
 	// node
-	surfacetreenode_t *children[2];
-	std::vector<FaceBSP *> *nodefaces;
-	int nodefaces_discardablesize;
+	int axis;
+	vec_t dist, dist1, dist2;
+	surfacetreenode_t *children[2]; // either can be null
 	// leaf
-	std::vector<FaceBSP *> *leaffaces;
+	int buildsize; // number of faces when it was last built
 };
 
-struct surfacetree_t
+struct surfacetreeresult_t
 {
-	bool dontbuild;
-	vec_t epsilon; // if a face is not epsilon far from the splitting plane, put it in result.middle
-	surfacetreenode_t *headnode;
-	struct
-	{
-		int frontsize;
-		int backsize;
-		std::vector<FaceBSP *> *middle; // may contains coplanar faces and discardable(SOLIDHINT) faces
-	} result;							// "public"
+	int frontsize;
+	int backsize;
+	std::vector<FaceBSP *> middle; // may contains coplanar faces and discardable(SOLIDHINT) faces
 };
 
-void BuildSurfaceTree_r(surfacetree_t *tree, surfacetreenode_t *node)
+static void FaceBounds(const FaceBSP *f, vec3_t mins, vec3_t maxs)
+{
+	VectorCopy(f->pts[0], mins);
+	VectorCopy(f->pts[0], maxs);
+	for (int x = 1; x < f->numpoints; x++)
+	{
+		VectorCompareMinimum(mins, f->pts[x], mins);
+		VectorCompareMaximum(maxs, f->pts[x], maxs);
+	}
+}
+
+static void AddSurfaceTreeBounds(surfacetreenode_t *node, const vec3_t mins, const vec3_t maxs, int detaillevel)
 {
-	node->size = node->leaffaces->size();
-	node->size_discardable = 0;
 	if (node->size == 0)
 	{
-		node->isleaf = true;
+		VectorCopy(mins, node->mins);
+		VectorCopy(maxs, node->maxs);
+		node->mindetaillevel = detaillevel;
 		return;
 	}
+	VectorCompareMinimum(node->mins, mins, node->mins);
+	VectorCompareMaximum(node->maxs, maxs, node->maxs);
+	node->mindetaillevel = qmin(node->mindetaillevel, detaillevel);
+}
 
-	VectorFill(node->mins, BSP_BOGUS_RANGE);
-	VectorFill(node->maxs, -BSP_BOGUS_RANGE);
-	for (std::vector<FaceBSP *>::iterator i = node->leaffaces->begin(); i != node->leaffaces->end(); ++i)
+// =====================================================================================
+//  UpdateSurfaceTreeNode
+//      recounts the faces of a node and shrinks its bounds to them and its children
+// =====================================================================================
+static void UpdateSurfaceTreeNode(surfacetreenode_t *node)
+{
+	node->size = 0;
+	node->size_discardable = 0;
+	for (FaceBSP *f : node->faces)
 	{
-		FaceBSP *f = *i;
-		for (int x = 0; x < f->numpoints; x++)
-		{
-			VectorCompareMinimum(node->mins, f->pts[x], node->mins);
-			VectorCompareMaximum(node->maxs, f->pts[x], node->maxs);
-		}
+		vec3_t mins, maxs;
+		FaceBounds(f, mins, maxs);
+		AddSurfaceTreeBounds(node, mins, maxs, f->detaillevel);
+		node->size++;
 		if (f->facestyle == face_discardable)
 		{
 			node->size_discardable++;
 		}
 	}
+	for (surfacetreenode_t *child : node->children)
+	{
+		if (child && child->size)
+		{
+			AddSurfaceTreeBounds(node, child->mins, child->maxs, child->mindetaillevel);
+			node->size += child->size;
+			node->size_discardable += child->size_discardable;
+		}
+	}
+}
+
+// =====================================================================================
+//  SurfaceTreeChild
+//      which child of a node the face spanning low..high along its axis belongs to, -1 for the node itself
+// =====================================================================================
+static auto SurfaceTreeChild(const surfacetreenode_t *node, vec_t low, vec_t high) -> int
+{
+	// Each child node is at most 3/4 the size of the parent node.
+	// Most faces should be passed to a child node, faces left in the parent node are the ones whose dimensions are large enough to be comparable to the dimension of the parent node.
+	if (low < node->dist1 + ON_EPSILON && high > node->dist2 - ON_EPSILON)
+	{
+		return -1;
+	}
+	if (low >= node->dist1 && high <= node->dist2)
+	{
+		return (low + high) / 2 > node->dist ? 0 : 1;
+	}
+	if (low >= node->dist1)
+	{
+		return 0;
+	}
+	if (high <= node->dist2)
+	{
+		return 1;
+	}
+	return -1;
+}
+
+static auto NewSurfaceTreeNode() -> surfacetreenode_t *
+{
+	auto *node = new surfacetreenode_t;
+	node->size = 0;
+	node->size_discardable = 0;
+	node->mindetaillevel = 0;
+	node->isleaf = true;
+	node->axis = 0;
+	node->dist = node->dist1 = node->dist2 = 0;
+	node->children[0] = node->children[1] = nullptr;
+	node->buildsize = 0;
+	return node;
+}
+
+static void DeleteSurfaceTree(surfacetreenode_t *node)
+{
+	if (!node)
+	{
+		return;
+	}
+	DeleteSurfaceTree(node->children[0]);
+	DeleteSurfaceTree(node->children[1]);
+	delete node;
+}
+
+// =====================================================================================
+//  BuildSurfaceTree_r
+//      node->faces holds all the faces below the node
+// =====================================================================================
+static void BuildSurfaceTree_r(surfacetreenode_t *node)
+{
+	node->isleaf = true;
+	node->children[0] = node->children[1] = nullptr;
+	node->buildsize = node->faces.size();
+	UpdateSurfaceTreeNode(node);
+	if (node->size <= SURFACETREE_LEAF_SIZE)
+	{
+		return;
+	}
 
 	int bestaxis = -1;
 	{
@@ -167,28 +292,19 @@ void BuildSurfaceTree_r(surfacetree_t *tree, surfacetreenode_t *node)
 			}
 		}
 	}
-	if (node->size <= 5 || tree->dontbuild == true || bestaxis == -1)
+	if (bestaxis == -1)
 	{
-		node->isleaf = true;
 		return;
 	}
 
-	node->isleaf = false;
-	vec_t dist, dist1, dist2;
-	dist = (node->mins[bestaxis] + node->maxs[bestaxis]) / 2;
-	dist1 = (3 * node->mins[bestaxis] + node->maxs[bestaxis]) / 4;
-	dist2 = (node->mins[bestaxis] + 3 * node->maxs[bestaxis]) / 4;
-	// Each child node is at most 3/4 the size of the parent node.
-	// Most faces should be passed to a child node, faces left in the parent node are the ones whose dimensions are large enough to be comparable to the dimension of the parent node.
-	node->nodefaces = new std::vector<FaceBSP *>;
-	node->nodefaces_discardablesize = 0;
-	node->children[0] = new surfacetreenode_t;
-	node->children[0]->leaffaces = new std::vector<FaceBSP *>;
-	node->children[1] = new surfacetreenode_t;
-	node->children[1]->leaffaces = new std::vector<FaceBSP *>;
-	for (std::vector<FaceBSP *>::iterator i = node->leaffaces->begin(); i != node->leaffaces->end(); ++i)
-	{
-		FaceBSP *f = *i;
+	node->axis = bestaxis;
+	node->dist = (node->mins[bestaxis] + node->maxs[bestaxis]) / 2;
+	node->dist1 = (3 * node->mins[bestaxis] + node->maxs[bestaxis]) / 4;
+	node->dist2 = (node->mins[bestaxis] + 3 * node->maxs[bestaxis]) / 4;
+	std::vector<FaceBSP *> nodefaces;
+	surfacetreenode_t *children[2] = {NewSurfaceTreeNode(), NewSurfaceTreeNode()};
+	for (FaceBSP *f : node->faces)
+	{
 		vec_t low = BSP_BOGUS_RANGE;
 		vec_t high = -BSP_BOGUS_RANGE;
 		for (int x = 0; x < f->numpoints; x++)
@@ -196,91 +312,99 @@ void BuildSurfaceTree_r(surfacetree_t *tree, surfacetreenode_t *node)
 			low = qmin(low, f->pts[x][bestaxis]);
 			high = qmax(high, f->pts[x][bestaxis]);
 		}
-		if (low < dist1 + ON_EPSILON && high > dist2 - ON_EPSILON)
-		{
-			node->nodefaces->push_back(f);
-			if (f->facestyle == face_discardable)
-			{
-				node->nodefaces_discardablesize++;
-			}
-		}
-		else if (low >= dist1 && high <= dist2)
-		{
-			if ((low + high) / 2 > dist)
-			{
-				node->children[0]->leaffaces->push_back(f);
-			}
-			else
-			{
-				node->children[1]->leaffaces->push_back(f);
-			}
-		}
-		else if (low >= dist1)
+		int side = SurfaceTreeChild(node, low, high);
+		if (side < 0)
 		{
-			node->children[0]->leaffaces->push_back(f);
+			nodefaces.push_back(f);
 		}
-		else if (high <= dist2)
+		else
 		{
-			node->children[1]->leaffaces->push_back(f);
+			children[side]->faces.push_back(f);
 		}
 	}
-	if (node->children[0]->leaffaces->size() == node->leaffaces->size() || node->children[1]->leaffaces->size() == node->leaffaces->size())
+	if (children[0]->faces.size() == node->faces.size() || children[1]->faces.size() == node->faces.size())
 	{
 		Warning("BuildSurfaceTree_r: didn't split node with bound (%f,%f,%f)-(%f,%f,%f)", node->mins[0], node->mins[1], node->mins[2], node->maxs[0], node->maxs[1], node->maxs[2]);
-		delete node->children[0]->leaffaces;
-		delete node->children[1]->leaffaces;
-		delete node->children[0];
-		delete node->children[1];
-		delete node->nodefaces;
-		node->isleaf = true;
+		delete children[0];
+		delete children[1];
 		return;
 	}
-	delete node->leaffaces;
-	BuildSurfaceTree_r(tree, node->children[0]);
-	BuildSurfaceTree_r(tree, node->children[1]);
+	node->isleaf = false;
+	node->faces.swap(nodefaces);
+	node->children[0] = children[0];
+	node->children[1] = children[1];
+	BuildSurfaceTree_r(node->children[0]);
+	BuildSurfaceTree_r(node->children[1]);
 }
 
-auto BuildSurfaceTree(SurfaceBSP *surfaces, vec_t epsilon) -> surfacetree_t *
+static auto BuildSurfaceTree(const SurfaceBSP *surfaces) -> surfacetreenode_t *
 {
-	surfacetree_t *tree;
-	tree = new surfacetree_t;
-	tree->epsilon = epsilon;
-	tree->result.middle = new std::vector<FaceBSP *>;
-	tree->headnode = new surfacetreenode_t;
-	tree->headnode->leaffaces = new std::vector<FaceBSP *>;
+	surfacetreenode_t *headnode = NewSurfaceTreeNode();
+	for (const SurfaceBSP *p2 = surfaces; p2; p2 = p2->next)
 	{
-		SurfaceBSP *p2;
-		FaceBSP *f;
-		for (p2 = surfaces; p2; p2 = p2->next)
+		if (p2->onnode)
 		{
-			if (p2->onnode)
-			{
-				continue;
-			}
-			for (f = p2->faces; f; f = f->next)
-			{
-				tree->headnode->leaffaces->push_back(f);
-			}
+			continue;
+		}
+		for (FaceBSP *f = p2->faces; f; f = f->next)
+		{
+			f->intree = true;
+			headnode->faces.push_back(f);
 		}
 	}
-	tree->dontbuild = tree->headnode->leaffaces->size() < 20;
-	BuildSurfaceTree_r(tree, tree->headnode);
-	if (tree->dontbuild)
-	{
-		*tree->result.middle = *tree->headnode->leaffaces;
-		tree->result.backsize = 0;
-		tree->result.frontsize = 0;
-	}
-	return tree;
+	BuildSurfaceTree_r(headnode);
+	return headnode;
 }
 
-void TestSurfaceTree_r(surfacetree_t *tree, const surfacetreenode_t *node, const dplane_t *split)
+// =====================================================================================
+//  AddSurfaceTreeFace
+//      walks down like BuildSurfaceTree_r would have sent the face, growing the bounds on the
+//      way, and builds a leaf again once it has twice the faces it was built with
+// =====================================================================================
+static void AddSurfaceTreeFace(surfacetreenode_t **tree, FaceBSP *f)
 {
-	if (node->size == 0)
+	vec3_t mins, maxs;
+	FaceBounds(f, mins, maxs);
+	f->intree = true;
+
+	for (surfacetreenode_t **pnode = tree;; )
 	{
-		return;
+		if (!*pnode)
+		{
+			*pnode = NewSurfaceTreeNode();
+		}
+		surfacetreenode_t *node = *pnode;
+		AddSurfaceTreeBounds(node, mins, maxs, f->detaillevel);
+		node->size++;
+		if (f->facestyle == face_discardable)
+		{
+			node->size_discardable++;
+		}
+		if (node->isleaf)
+		{
+			node->faces.push_back(f);
+			if ((int)node->faces.size() > qmax(SURFACETREE_LEAF_SIZE, 2 * node->buildsize))
+			{
+				BuildSurfaceTree_r(node);
+			}
+			return;
+		}
+		int side = SurfaceTreeChild(node, mins[node->axis], maxs[node->axis]);
+		if (side < 0)
+		{
+			node->faces.push_back(f);
+			return;
+		}
+		pnode = &node->children[side];
 	}
-	vec_t low, high;
+}
+
+// =====================================================================================
+//  SurfaceTreeNodeRange
+//      how far the bounds of a node reach in front of and behind a plane
+// =====================================================================================
+static void SurfaceTreeNodeRange(const surfacetreenode_t *node, const dplane_t *split, vec_t &low, vec_t &high)
+{
 	low = high = -split->dist;
 	for (int k = 0; k < 3; k++)
 	{
@@ -295,68 +419,335 @@ void TestSurfaceTree_r(surfacetree_t *tree, const surfacetreenode_t *node, const
 			low += split->normal[k] * node->maxs[k];
 		}
 	}
-	if (low > tree->epsilon)
+}
+
+// =====================================================================================
+//  TestSurfaceTree_r
+//      if a face is not epsilon far from the splitting plane, put it in result.middle
+// =====================================================================================
+static void TestSurfaceTree_r(const surfacetreenode_t *node, const dplane_t *split, vec_t epsilon, surfacetreeresult_t &result)
+{
+	if (!node || node->size == 0)
 	{
-		tree->result.frontsize += node->size;
-		tree->result.frontsize -= node->size_discardable;
 		return;
 	}
-	if (high < -tree->epsilon)
+	vec_t low, high;
+	SurfaceTreeNodeRange(node, split, low, high);
+	if (low > epsilon)
 	{
-		tree->result.backsize += node->size;
-		tree->result.backsize -= node->size_discardable;
+		result.frontsize += node->size - node->size_discardable;
 		return;
 	}
-	if (node->isleaf)
+	if (high < -epsilon)
+	{
+		result.backsize += node->size - node->size_discardable;
+		return;
+	}
+	result.middle.insert(result.middle.end(), node->faces.begin(), node->faces.end());
+	TestSurfaceTree_r(node->children[0], split, epsilon, result);
+	TestSurfaceTree_r(node->children[1], split, epsilon, result);
+}
+
+static void TestSurfaceTree(const surfacetreenode_t *tree, const dplane_t *split, vec_t epsilon, surfacetreeresult_t &result)
+{
+	result.middle.clear();
+	result.backsize = 0;
+	result.frontsize = 0;
+	TestSurfaceTree_r(tree, split, epsilon, result);
+}
+
+// =====================================================================================
+//  SplitSurfaceTree_r
+//      Subtrees clear of the plane go to one side as they are. Of the rest, the faces
+//      that SplitFace will keep whole on one side follow it, the others are dropped into
+//      cutfaces and the planes of their surfaces noted in cutplanes.
+// =====================================================================================
+static void SplitSurfaceTree_r(surfacetreenode_t *node, const dplane_t *split, std::vector<int> &cutplanes, std::vector<FaceBSP *> &cutfaces, surfacetreenode_t **front, surfacetreenode_t **back)
+{
+	*front = *back = nullptr;
+	if (!node)
 	{
-		for (std::vector<FaceBSP *>::iterator i = node->leaffaces->begin(); i != node->leaffaces->end(); ++i)
+		return;
+	}
+	if (node->size == 0)
+	{
+		DeleteSurfaceTree(node);
+		return;
+	}
+	vec_t low, high;
+	SurfaceTreeNodeRange(node, split, low, high);
+	// the bounds come from the same points, this only covers the rounding
+	if (low > 2 * ON_EPSILON)
+	{
+		*front = node;
+		return;
+	}
+	if (high < -2 * ON_EPSILON)
+	{
+		*back = node;
+		return;
+	}
+
+	surfacetreenode_t *sides[2];
+	for (surfacetreenode_t *&side : sides)
+	{
+		side = NewSurfaceTreeNode();
+		side->isleaf = node->isleaf;
+		side->axis = node->axis;
+		side->dist = node->dist;
+		side->dist1 = node->dist1;
+		side->dist2 = node->dist2;
+		side->buildsize = node->buildsize;
+	}
+	for (FaceBSP *f : node->faces)
+	{
+		bool infront = true, behind = true;
+		for (int x = 0; x < f->numpoints; x++)
+		{
+			vec_t dot = DotProduct(f->pts[x], split->normal) - split->dist;
+			infront = infront && dot > ON_EPSILON;
+			behind = behind && dot < -ON_EPSILON;
+		}
+		if (infront)
+		{
+			sides[0]->faces.push_back(f);
+		}
+		else if (behind)
 		{
-			tree->result.middle->push_back(*i);
+			sides[1]->faces.push_back(f);
+		}
+		else
+		{
+			f->intree = false;
+			cutplanes.push_back(f->planenum & ~1);
+			cutfaces.push_back(f);
 		}
 	}
-	else
+	SplitSurfaceTree_r(node->children[0], split, cutplanes, cutfaces, &sides[0]->children[0], &sides[1]->children[0]);
+	SplitSurfaceTree_r(node->children[1], split, cutplanes, cutfaces, &sides[0]->children[1], &sides[1]->children[1]);
+	delete node;
+
+	for (surfacetreenode_t *&side : sides)
+	{
+		UpdateSurfaceTreeNode(side);
+		if (side->size == 0)
+		{
+			DeleteSurfaceTree(side);
+			side = nullptr;
+		}
+	}
+	*front = sides[0];
+	*back = sides[1];
+}
+
+// =====================================================================================
+//  SplitSurfaceTree
+//      hands the tree of a node on to its children, before the surfaces are split
+// =====================================================================================
+static void SplitSurfaceTree(NodeBSP *node, std::vector<int> &cutplanes, std::vector<FaceBSP *> &cutfaces)
+{
+	SplitSurfaceTree_r(node->surfacetree, &g_mapplanes[node->planenum], cutplanes, cutfaces, &node->children[0]->surfacetree, &node->children[1]->surfacetree);
+	node->surfacetree = nullptr;
+	std::sort(cutplanes.begin(), cutplanes.end());
+	cutplanes.erase(std::unique(cutplanes.begin(), cutplanes.end()), cutplanes.end());
+}
+
+// =====================================================================================
+//  AddCutFaces
+//      puts the faces SplitSurfaceTree dropped, or their fragments, into the tree of a child
+// =====================================================================================
+static void AddCutFaces(NodeBSP *node, const std::vector<int> &cutplanes, std::vector<FaceBSP *> &addedfaces)
+{
+	for (SurfaceBSP *s = node->surfaces; s; s = s->next)
 	{
-		for (std::vector<FaceBSP *>::iterator i = node->nodefaces->begin(); i != node->nodefaces->end(); ++i)
+		if (s->onnode || !std::binary_search(cutplanes.begin(), cutplanes.end(), s->planenum))
 		{
-			tree->result.middle->push_back(*i);
+			continue;
+		}
+		for (FaceBSP *f = s->faces; f; f = f->next)
+		{
+			if (!f->intree)
+			{
+				AddSurfaceTreeFace(&node->surfacetree, f);
+				addedfaces.push_back(f);
+			}
 		}
-		TestSurfaceTree_r(tree, node->children[0], split);
-		TestSurfaceTree_r(tree, node->children[1], split);
 	}
 }
 
-void TestSurfaceTree(surfacetree_t *tree, const dplane_t *split)
+// =====================================================================================
+//  RemoveSurfaceTreeFaces_r
+//      takes out the faces below detaillevel before FixDetaillevelForDiscardable frees them
+// =====================================================================================
+static void RemoveSurfaceTreeFaces_r(surfacetreenode_t *node, int detaillevel)
 {
-	if (tree->dontbuild)
+	if (!node || node->size == 0 || node->mindetaillevel >= detaillevel)
 	{
 		return;
 	}
-	tree->result.middle->clear();
-	tree->result.backsize = 0;
-	tree->result.frontsize = 0;
-	TestSurfaceTree_r(tree, tree->headnode, split);
+	node->faces.erase(std::remove_if(node->faces.begin(), node->faces.end(), [detaillevel](const FaceBSP *f) { return f->detaillevel < detaillevel; }), node->faces.end());
+	RemoveSurfaceTreeFaces_r(node->children[0], detaillevel);
+	RemoveSurfaceTreeFaces_r(node->children[1], detaillevel);
+	UpdateSurfaceTreeNode(node);
+}
+
+// Candidates that are handed to another thread at a time
+constexpr int PLANE_SCORE_CHUNK = 32;
+
+// How the faces of a surface tree lie against one candidate plane. These are sums over the
+// faces, so a child node can work out its counts from those of its parent: take out the
+// faces that went to the other child and the cut ones, then add the fragments it got.
+struct PlaneCounts
+{
+	int planenum;
+	int front;
+	int back;
+	int cross;
+	int epsilonsplit;
+};
+
+// The counts of the candidates of one detail level, sorted by plane
+struct planecounts_t
+{
+	int detaillevel;
+	std::vector<PlaneCounts> planes;
+};
+
+// The split metric of one candidate. ChoosePlaneFromList still has to add the part that
+// depends on the average split count of all candidates.
+struct PlaneScore
+{
+	SurfaceBSP *surface;
+	double value;
+	double splitweight; // times the average split count
+	int splits;
+	PlaneCounts counts; // ChoosePlaneFromList and UpdatePlaneCounts only
+	bool counted;       // counts came from the parent node
+};
+
+// Scratch space for scoring candidates, one per thread
+struct PlaneScoreScratch
+{
+	surfacetreeresult_t result;
+	FaceSideBatch batch;
+};
+
+// What the candidates of one Choose*PlaneFromList call are scored against
+struct PlaneScoring
+{
+	const surfacetreenode_t *tree;
+	const vec_t *mins; // ChooseMidPlaneFromList only
+	const vec_t *maxs;
+	int sign; // UpdatePlaneCounts only: 1 to add the faces of tree, -1 to take them out
+	void (*score)(const PlaneScoring &scoring, PlaneScore &score, PlaneScoreScratch &scratch);
+};
+
+struct PlaneScoreTask
+{
+	const PlaneScoring *scoring;
+	PlaneScore *scores;
+	int count;
+};
+
+static void ScorePlanesTask(void *data)
+{
+	auto *task = (PlaneScoreTask *)data;
+	PlaneScoreScratch scratch;
+	for (int i = 0; i < task->count; i++)
+	{
+		task->scoring->score(*task->scoring, task->scores[i], scratch);
+	}
 }
 
-void DeleteSurfaceTree_r(surfacetreenode_t *node)
+// =====================================================================================
+//  ScorePlanes
+//      Every candidate is scored on its own, so they can be spread over the threads;
+//      the callers pick the best one afterwards in list order.
+// =====================================================================================
+static void ScorePlanes(const PlaneScoring &scoring, std::vector<PlaneScore> &scores)
 {
-	if (node->isleaf)
+	std::vector<PlaneScoreTask> tasks;
+	for (int i = 0; i < (int)scores.size(); i += PLANE_SCORE_CHUNK)
+	{
+		tasks.push_back({&scoring, &scores[i], qmin(PLANE_SCORE_CHUNK, (int)scores.size() - i)});
+	}
+	if (g_numthreads > 1 && tasks.size() > 1)
 	{
-		delete node->leaffaces;
+		TaskGroup group;
+		for (size_t i = 1; i < tasks.size(); i++)
+		{
+			AddTask(group, ScorePlanesTask, &tasks[i]);
+		}
+		ScorePlanesTask(&tasks[0]);
+		WaitTasks(group);
 	}
 	else
 	{
-		delete node->children[0];
-		delete node->children[1];
-		delete node->nodefaces;
+		for (PlaneScoreTask &task : tasks)
+		{
+			ScorePlanesTask(&task);
+		}
 	}
 }
 
-void DeleteSurfaceTree(surfacetree_t *tree)
+// =====================================================================================
+//  ScoreMidPlane
+//      calculate the split metric along the axis of the plane, smaller values are better
+// =====================================================================================
+static void ScoreMidPlane(const PlaneScoring &scoring, PlaneScore &score, PlaneScoreScratch &scratch)
 {
-	DeleteSurfaceTree_r(tree->headnode);
-	delete[] tree->headnode;
-	delete tree->result.middle;
-	delete tree;
+	const SurfaceBSP *p = score.surface;
+	const dplane_t *plane = &g_mapplanes[p->planenum];
+	const vec_t *mins = scoring.mins;
+	const vec_t *maxs = scoring.maxs;
+	int l = plane->type;
+	vec_t dist = plane->dist * plane->normal[l];
+	double crosscount = 0;
+	double frontcount = 0;
+	double backcount = 0;
+	double coplanarcount = 0;
+
+	TestSurfaceTree(scoring.tree, plane, ON_EPSILON, scratch.result);
+	frontcount += scratch.result.frontsize;
+	backcount += scratch.result.backsize;
+	scratch.batch.faces.clear();
+	for (FaceBSP *f : scratch.result.middle)
+	{
+		if (f->facestyle == face_discardable)
+		{
+			continue;
+		}
+		if (f->planenum == p->planenum || f->planenum == (p->planenum ^ 1))
+		{
+			coplanarcount++;
+			continue;
+		}
+		scratch.batch.faces.push_back(f);
+	}
+	FaceSides(scratch.batch, plane);
+	for (size_t i = 0; i < scratch.batch.faces.size(); i++)
+	{
+		switch (FaceSideForRange(scratch.batch.lows[i], scratch.batch.highs[i], nullptr))
+		{
+		case SIDE_FRONT:
+			frontcount++;
+			break;
+		case SIDE_BACK:
+			backcount++;
+			break;
+		case SIDE_ON:
+			crosscount++;
+			break;
+		}
+	}
+
+	double frontsize = frontcount + 0.5 * coplanarcount + 0.5 * crosscount;
+	double frontfrac = (maxs[l] - dist) / (maxs[l] - mins[l]);
+	double backsize = backcount + 0.5 * coplanarcount + 0.5 * crosscount;
+	double backfrac = (dist - mins[l]) / (maxs[l] - mins[l]);
+	score.value = crosscount + 0.1 * (frontsize * (log(frontfrac) / log(2.0)) + backsize * (log(backfrac) / log(2.0)));
+	// the first part is how the split will increase the number of faces
+	// the second part is how the split will increase the average depth of the bsp tree
 }
 
 // =====================================================================================
@@ -364,28 +755,10 @@ void DeleteSurfaceTree(surfacetree_t *tree)
 //      When there are a huge number of planes, just choose one closest
 //      to the middle.
 // =====================================================================================
-static auto ChooseMidPlaneFromList(SurfaceBSP *surfaces, const vec3_t mins, const vec3_t maxs, int detaillevel) -> SurfaceBSP *
+static auto ChooseMidPlaneFromList(const surfacetreenode_t *tree, SurfaceBSP *surfaces, const vec3_t mins, const vec3_t maxs, int detaillevel) -> SurfaceBSP *
 {
-	int l;
-	SurfaceBSP *p;
-	SurfaceBSP *bestsurface;
-	vec_t bestvalue;
-	vec_t value;
-	vec_t dist;
-	dplane_t *plane;
-	surfacetree_t *surfacetree;
-	std::vector<FaceBSP *>::iterator it;
-	FaceBSP *f;
-
-	surfacetree = BuildSurfaceTree(surfaces, ON_EPSILON);
-
-	//
-	// pick the plane that splits the least
-	//
-	bestvalue = 9e30;
-	bestsurface = nullptr;
-
-	for (p = surfaces; p; p = p->next)
+	std::vector<PlaneScore> scores;
+	for (SurfaceBSP *p = surfaces; p; p = p->next)
 	{
 		if (p->onnode)
 		{
@@ -396,122 +769,151 @@ static auto ChooseMidPlaneFromList(SurfaceBSP *surfaces, const vec3_t mins, cons
 			continue;
 		}
 
-		plane = &g_mapplanes[p->planenum];
+		const dplane_t *plane = &g_mapplanes[p->planenum];
 
 		// check for axis aligned surfaces
-		l = plane->type;
+		int l = plane->type;
 		if (l > last_axial)
 		{
 			continue;
 		}
 
-		//
-		// calculate the split metric along axis l, smaller values are better
-		//
-		value = 0;
-
-		dist = plane->dist * plane->normal[l];
+		vec_t dist = plane->dist * plane->normal[l];
 		if (maxs[l] - dist < ON_EPSILON || dist - mins[l] < ON_EPSILON)
 			continue;
 		if (maxs[l] - dist < g_maxnode_size / 2.0 - ON_EPSILON || dist - mins[l] < g_maxnode_size / 2.0 - ON_EPSILON)
 			continue;
-		double crosscount = 0;
-		double frontcount = 0;
-		double backcount = 0;
-		double coplanarcount = 0;
+		scores.push_back({p, 0, 0, 0, {}, false});
+	}
+
+	PlaneScoring scoring = {tree, mins, maxs, 0, ScoreMidPlane};
+	ScorePlanes(scoring, scores);
 
-		TestSurfaceTree(surfacetree, plane);
-		frontcount += surfacetree->result.frontsize;
-		backcount += surfacetree->result.backsize;
-		for (it = surfacetree->result.middle->begin(); it != surfacetree->result.middle->end(); ++it)
+	//
+	// pick the plane that splits the least, the last one of equal ones
+	//
+	vec_t bestvalue = 9e30;
+	SurfaceBSP *bestsurface = nullptr;
+	for (const PlaneScore &score : scores)
+	{
+		if (score.value > bestvalue)
 		{
-			f = *it;
-			if (f->facestyle == face_discardable)
-			{
-				continue;
-			}
-			if (f->planenum == p->planenum || f->planenum == (p->planenum ^ 1))
-			{
-				coplanarcount++;
-				continue;
-			}
-			switch (FaceSide(f, plane))
-			{
-			case SIDE_FRONT:
-				frontcount++;
-				break;
-			case SIDE_BACK:
-				backcount++;
-				break;
-			case SIDE_ON:
-				crosscount++;
-				break;
-			}
+			continue;
+		}
+		bestvalue = score.value;
+		bestsurface = score.surface;
+	}
+
+	return bestsurface;
+}
+
+// =====================================================================================
+//  CountPlaneFaces
+//      adds the faces of a tree to the counts of a plane, or takes them out with sign -1
+// =====================================================================================
+static void CountPlaneFaces(const surfacetreenode_t *tree, int sign, PlaneCounts &counts, PlaneScoreScratch &scratch)
+{
+	const dplane_t *plane = &g_mapplanes[counts.planenum];
+	double epsilonsplit = 0;
+
+	// faces farther away than this can't add to epsilonsplit
+	TestSurfaceTree(tree, plane, FACESIDE_EPSILONMAX + ON_EPSILON, scratch.result);
+	counts.front += sign * scratch.result.frontsize;
+	counts.back += sign * scratch.result.backsize;
+	scratch.batch.faces.clear();
+	for (FaceBSP *f : scratch.result.middle)
+	{
+		if (f->planenum == counts.planenum || f->planenum == (counts.planenum ^ 1))
+		{
+			continue;
+		}
+		scratch.batch.faces.push_back(f);
+	}
+	FaceSides(scratch.batch, plane);
+	for (size_t i = 0; i < scratch.batch.faces.size(); i++)
+	{
+		int side = FaceSideForRange(scratch.batch.lows[i], scratch.batch.highs[i], &epsilonsplit);
+		if (scratch.batch.faces[i]->facestyle == face_discardable)
+		{
+			continue;
 		}
+		switch (side)
+		{
+		case SIDE_FRONT:
+			counts.front += sign;
+			break;
+		case SIDE_BACK:
+			counts.back += sign;
+			break;
+		case SIDE_ON:
+			counts.cross += sign;
+			break;
+		}
+	}
+	counts.epsilonsplit += sign * (int)epsilonsplit;
+}
 
-		double frontsize = frontcount + 0.5 * coplanarcount + 0.5 * crosscount;
-		double frontfrac = (maxs[l] - dist) / (maxs[l] - mins[l]);
-		double backsize = backcount + 0.5 * coplanarcount + 0.5 * crosscount;
-		double backfrac = (dist - mins[l]) / (maxs[l] - mins[l]);
-		value = crosscount + 0.1 * (frontsize * (log(frontfrac) / log(2.0)) + backsize * (log(backfrac) / log(2.0)));
-		// the first part is how the split will increase the number of faces
-		// the second part is how the split will increase the average depth of the bsp tree
+// =====================================================================================
+//  ScorePlane
+// =====================================================================================
+static void ScorePlane(const PlaneScoring &scoring, PlaneScore &score, PlaneScoreScratch &scratch)
+{
+	const SurfaceBSP *p = score.surface;
+	double coplanarcount = 0;
 
-		if (value > bestvalue)
+	for (const FaceBSP *f = p->faces; f; f = f->next)
+	{
+		if (f->facestyle == face_discardable)
 		{
 			continue;
 		}
-
-		//
-		// currently the best!
-		//
-		bestvalue = value;
-		bestsurface = p;
+		coplanarcount++;
+	}
+	if (!score.counted)
+	{
+		score.counts = {p->planenum, 0, 0, 0, 0};
+		CountPlaneFaces(scoring.tree, 1, score.counts, scratch);
 	}
+	double crosscount = score.counts.cross; // use double here because we need to perform "crosscount++"
+	double frontcount = score.counts.front;
+	double backcount = score.counts.back;
+	double epsilonsplit = score.counts.epsilonsplit;
+	score.splits = score.counts.cross;
 
-	DeleteSurfaceTree(surfacetree);
-	if (!bestsurface)
+	double value = crosscount - sqrt(coplanarcount); // Not optimized. --vluzacn
+	if (coplanarcount == 0)
 	{
-		return nullptr;
+		crosscount += 1;
 	}
+	// This is the most efficient code among what I have ever tested:
+	// (1) BSP file is small, despite possibility of slowing down vis and rad (but still faster than the original non BSP balancing method).
+	// (2) Factors need not adjust across various maps.
+	double frac = (coplanarcount / 2 + crosscount / 2 + frontcount) / (coplanarcount + frontcount + backcount + crosscount);
+	double ent = (0.0001 < frac && frac < 0.9999) ? (-frac * log(frac) / log(2.0) - (1 - frac) * log(1 - frac) / log(2.0)) : 0.0; // the formula tends to 0 when frac=0,1
+	score.splitweight = crosscount * (1 - ent);
+	score.value = value + epsilonsplit * 10000;
+}
 
-	return bestsurface;
+static auto PlaneCountsLess(const PlaneCounts &a, const PlaneCounts &b) -> bool
+{
+	return a.planenum < b.planenum;
 }
 
 // =====================================================================================
 //  ChoosePlaneFromList
-//      Choose the plane that splits the least faces
+//      Choose the plane that splits the least faces. The counts of the candidates are
+//      left in node->planecounts; those the parent handed down are used instead of
+//      testing the tree again.
 // =====================================================================================
-static auto ChoosePlaneFromList(SurfaceBSP *surfaces, const vec3_t mins, const vec3_t maxs
-								// mins and maxs are invalid when detaillevel > 0
-								,
-								int detaillevel) -> SurfaceBSP *
+static auto ChoosePlaneFromList(NodeBSP *node, SurfaceBSP *surfaces, int detaillevel) -> SurfaceBSP *
 {
-	SurfaceBSP *p;
-	SurfaceBSP *bestsurface;
-	vec_t bestvalue;
-	vec_t value;
-	dplane_t *plane;
-	FaceBSP *f;
-	double planecount;
-	double totalsplit;
-	double avesplit;
-	double(*tmpvalue)[2];
-	surfacetree_t *surfacetree;
-	std::vector<FaceBSP *>::iterator it;
-
-	planecount = 0;
-	totalsplit = 0;
-	tmpvalue = new double[g_bspnumplanes][2];
-	surfacetree = BuildSurfaceTree(surfaces, ON_EPSILON);
-
-	//
-	// pick the plane that splits the least
-	//
-	bestvalue = 9e30;
-	bestsurface = nullptr;
-
-	for (p = surfaces; p; p = p->next)
+	const planecounts_t *known = node->planecounts;
+	if (known && known->detaillevel != detaillevel)
+	{
+		known = nullptr;
+	}
+	std::vector<PlaneScore> scores;
+	for (SurfaceBSP *p = surfaces; p; p = p->next)
 	{
 		if (p->onnode)
 		{
@@ -521,97 +923,101 @@ static auto ChoosePlaneFromList(SurfaceBSP *surfaces, const vec3_t mins, const v
 		{
 			continue;
 		}
-		planecount++;
-
-		double crosscount = 0; // use double here because we need to perform "crosscount++"
-		double frontcount = 0;
-		double backcount = 0;
-		double coplanarcount = 0;
-		double epsilonsplit = 0;
-
-		plane = &g_mapplanes[p->planenum];
-
-		for (f = p->faces; f; f = f->next)
-		{
-			if (f->facestyle == face_discardable)
-			{
-				continue;
-			}
-			coplanarcount++;
-		}
-		TestSurfaceTree(surfacetree, plane);
+		PlaneScore score = {p, 0, 0, 0, {}, false};
+		if (known)
 		{
-			frontcount += surfacetree->result.frontsize;
-			backcount += surfacetree->result.backsize;
-			for (it = surfacetree->result.middle->begin(); it != surfacetree->result.middle->end(); ++it)
+			PlaneCounts key = {p->planenum, 0, 0, 0, 0};
+			auto it = std::lower_bound(known->planes.begin(), known->planes.end(), key, PlaneCountsLess);
+			if (it != known->planes.end() && it->planenum == p->planenum)
 			{
-				f = *it;
-				if (f->planenum == p->planenum || f->planenum == (p->planenum ^ 1))
-				{
-					continue;
-				}
-				if (f->facestyle == face_discardable)
-				{
-					FaceSide(f, plane, &epsilonsplit);
-					continue;
-				}
-				switch (FaceSide(f, plane, &epsilonsplit))
-				{
-				case SIDE_FRONT:
-					frontcount++;
-					break;
-				case SIDE_BACK:
-					backcount++;
-					break;
-				case SIDE_ON:
-					totalsplit++;
-					crosscount++;
-					break;
-				}
+				score.counts = *it;
+				score.counted = true;
 			}
 		}
+		scores.push_back(score);
+	}
 
-		value = crosscount - sqrt(coplanarcount); // Not optimized. --vluzacn
-		if (coplanarcount == 0)
-		{
-			crosscount += 1;
-		}
-		// This is the most efficient code among what I have ever tested:
-		// (1) BSP file is small, despite possibility of slowing down vis and rad (but still faster than the original non BSP balancing method).
-		// (2) Factors need not adjust across various maps.
-		double frac = (coplanarcount / 2 + crosscount / 2 + frontcount) / (coplanarcount + frontcount + backcount + crosscount);
-		double ent = (0.0001 < frac && frac < 0.9999) ? (-frac * log(frac) / log(2.0) - (1 - frac) * log(1 - frac) / log(2.0)) : 0.0; // the formula tends to 0 when frac=0,1
-		tmpvalue[p->planenum][1] = crosscount * (1 - ent);
-		value += epsilonsplit * 10000;
+	PlaneScoring scoring = {node->surfacetree, nullptr, nullptr, 0, ScorePlane};
+	ScorePlanes(scoring, scores);
 
-		tmpvalue[p->planenum][0] = value;
+	double totalsplit = 0;
+	for (const PlaneScore &score : scores)
+	{
+		totalsplit += score.splits;
 	}
-	avesplit = totalsplit / planecount;
-	for (p = surfaces; p; p = p->next)
+	double avesplit = totalsplit / scores.size();
+
+	//
+	// pick the plane that splits the least, the first one of equal ones
+	//
+	vec_t bestvalue = 9e30;
+	SurfaceBSP *bestsurface = nullptr;
+	for (const PlaneScore &score : scores)
 	{
-		if (p->onnode)
-		{
-			continue;
-		}
-		if (p->detaillevel != detaillevel)
-		{
-			continue;
-		}
-		value = tmpvalue[p->planenum][0] + avesplit * tmpvalue[p->planenum][1];
+		vec_t value = score.value + avesplit * score.splitweight;
 		if (value < bestvalue)
 		{
 			bestvalue = value;
-			bestsurface = p;
+			bestsurface = score.surface;
 		}
 	}
 
 	if (!bestsurface)
 		Error("ChoosePlaneFromList: no valid planes");
-	delete tmpvalue;
-	DeleteSurfaceTree(surfacetree);
+
+	// a plane can have a surface of each facing, with the same counts
+	auto *counts = new planecounts_t;
+	counts->detaillevel = detaillevel;
+	for (const PlaneScore &score : scores)
+	{
+		counts->planes.push_back(score.counts);
+	}
+	std::sort(counts->planes.begin(), counts->planes.end(), PlaneCountsLess);
+	counts->planes.erase(std::unique(counts->planes.begin(), counts->planes.end(), [](const PlaneCounts &a, const PlaneCounts &b) { return a.planenum == b.planenum; }), counts->planes.end());
+	delete node->planecounts;
+	node->planecounts = counts;
 	return bestsurface;
 }
 
+// =====================================================================================
+//  UpdatePlaneCounts
+//      adds the faces of a tree to every plane of the table, or takes them out with sign -1
+// =====================================================================================
+static void CountPlaneScore(const PlaneScoring &scoring, PlaneScore &score, PlaneScoreScratch &scratch)
+{
+	CountPlaneFaces(scoring.tree, scoring.sign, score.counts, scratch);
+}
+static void UpdatePlaneCounts(planecounts_t *counts, const surfacetreenode_t *tree, int sign)
+{
+	if (!tree || tree->size == 0)
+	{
+		return;
+	}
+	std::vector<PlaneScore> scores;
+	for (const PlaneCounts &planecounts : counts->planes)
+	{
+		scores.push_back({nullptr, 0, 0, 0, planecounts, true});
+	}
+	PlaneScoring scoring = {tree, nullptr, nullptr, sign, CountPlaneScore};
+	ScorePlanes(scoring, scores);
+	for (size_t i = 0; i < scores.size(); i++)
+	{
+		counts->planes[i] = scores[i].counts;
+	}
+}
+static void UpdatePlaneCounts(planecounts_t *counts, const std::vector<FaceBSP *> &faces, int sign)
+{
+	if (faces.empty())
+	{
+		return;
+	}
+	surfacetreenode_t *tree = NewSurfaceTreeNode();
+	tree->faces = faces;
+	BuildSurfaceTree_r(tree);
+	UpdatePlaneCounts(counts, tree, sign);
+	DeleteSurfaceTree(tree);
+}
+
 // =====================================================================================
 //  SelectPartition
 //      Selects a surface from a linked list of surfaces to split the group on
@@ -642,7 +1048,7 @@ auto CalcSplitDetaillevel(const NodeBSP *node) -> int
 	}
 	return bestdetaillevel;
 }
-static auto SelectPartition(SurfaceBSP *surfaces, const NodeBSP *const node, const bool usemidsplit, int splitdetaillevel, vec3_t validmins, vec3_t validmaxs) -> SurfaceBSP *
+static auto SelectPartition(SurfaceBSP *surfaces, NodeBSP *const node, const bool usemidsplit, int splitdetaillevel, vec3_t validmins, vec3_t validmaxs) -> SurfaceBSP *
 {
 	if (splitdetaillevel == -1)
 	{
@@ -652,12 +1058,17 @@ static auto SelectPartition(SurfaceBSP *surfaces, const NodeBSP *const node, con
 
 	if (usemidsplit)
 	{
-		SurfaceBSP *s = ChooseMidPlaneFromList(surfaces,
+		SurfaceBSP *s = ChooseMidPlaneFromList(node->surfacetree, surfaces,
 											   validmins, validmaxs, splitdetaillevel);
 		if (s != nullptr)
+		{
+			// the counts handed down don't fit the children of this split
+			delete node->planecounts;
+			node->planecounts = nullptr;
 			return s;
+		}
 	}
-	return ChoosePlaneFromList(surfaces, node->mins, node->maxs, splitdetaillevel);
+	return ChoosePlaneFromList(node, surfaces, splitdetaillevel);
 }
 
 // =====================================================================================
@@ -726,7 +1137,7 @@ void FixDetaillevelForDiscardable(NodeBSP *node, int detaillevel)
 			if (detaillevel == -1 || f->detaillevel < detaillevel)
 			{
 				*pfnext = f->next;
-				delete f;
+				FreeFace(f);
 			}
 			else
 			{
@@ -1049,9 +1460,9 @@ static void FreeLeafSurfs(NodeBSP *leaf)
 		for (f = surf->faces; f; f = fnext)
 		{
 			fnext = f->next;
-			delete f;
+			FreeFace(f);
 		}
-		delete surf;
+		FreeSurface(surf);
 	}
 
 	leaf->surfaces = nullptr;
@@ -1108,7 +1519,7 @@ auto ContentsToString(int contents) -> const char *
 		return "UNKNOWN";
 	}
 }
-static void LinkLeafFaces(SurfaceBSP *planelist, NodeBSP *leafnode)
+static void LinkLeafFaces(SurfaceBSP *planelist, NodeBSP *leafnode, int hullnum)
 {
 	FaceBSP *f;
 	SurfaceBSP *surf;
@@ -1167,7 +1578,7 @@ static void LinkLeafFaces(SurfaceBSP *planelist, NodeBSP *leafnode)
 		Warning(R"(Ambiguous leafnode content ( %s and %s ) at (%.0f,%.0f,%.0f)-(%.0f,%.0f,%.0f) in hull %d of model %d (entity: classname "%s", origin "%s", targetname "%s"))",
 				ContentsToString(ContentsForRank(r)), ContentsToString(ContentsForRank(rank)),
 				leafnode->mins[0], leafnode->mins[1], leafnode->mins[2], leafnode->maxs[0], leafnode->maxs[1], leafnode->maxs[2],
-				g_hullnum, g_bspnummodels - 1,
+				hullnum, g_bspnummodels - 1,
 				(ent ? ValueForKey(ent, "classname") : "unknown"),
 				(ent ? ValueForKey(ent, "origin") : "unknown"),
 				(ent ? ValueForKey(ent, "targetname") : "unknown"));
@@ -1192,6 +1603,15 @@ static void MakeLeaf(NodeBSP *leafnode)
 		FreeBrush(leafnode->boundsbrush);
 	}
 	leafnode->boundsbrush = nullptr;
+	if (leafnode->cell)
+	{
+		FreeBrush(leafnode->cell);
+	}
+	leafnode->cell = nullptr;
+	DeleteSurfaceTree(leafnode->surfacetree);
+	leafnode->surfacetree = nullptr;
+	delete leafnode->planecounts;
+	leafnode->planecounts = nullptr;
 
 	if (!(leafnode->isportalleaf && leafnode->contents == static_cast<int>(contents_t::CONTENTS_SOLID)))
 	{
@@ -1380,59 +1800,167 @@ static void SplitNodePortals(NodeBSP *node)
 }
 
 // =====================================================================================
-//  CalcNodeBounds
-//      Determines the boundaries of a node by minmaxing all the portal points, whcih
-//      completely enclose the node.
-//      Returns true if the node should be midsplit.(very large)
+//  MakeNodeCell
+//      Copies the portals of the head node into its cell, in list order and turned to face into the node.
 // =====================================================================================
-static auto CalcNodeBounds(NodeBSP *node, vec3_t validmins, vec3_t validmaxs) -> bool
+static void MakeNodeCell(NodeBSP *node)
 {
-	int i;
-	int j;
-	vec_t v;
 	PortalBSP *p;
-	PortalBSP *next_portal;
+	SideBSP *s;
+	SideBSP **prev;
 	int side = 0;
 
-	if (node->isdetail)
+	node->cell = AllocBrush();
+	prev = &node->cell->sides;
+	for (p = node->portals; p; p = p->next[side])
 	{
-		return false;
+		side = p->nodes[0] == node ? 0 : 1;
+		s = AllocSide();
+		s->plane = p->plane;
+		if (side)
+		{
+			s->plane.dist = -s->plane.dist;
+			VectorSubtract(vec3_origin, s->plane.normal, s->plane.normal);
+		}
+		s->w = new Winding(*p->winding);
+		*prev = s;
+		prev = &s->next;
 	}
-	node->mins[0] = node->mins[1] = node->mins[2] = BSP_BOGUS_RANGE;
-	node->maxs[0] = node->maxs[1] = node->maxs[2] = -BSP_BOGUS_RANGE;
+}
 
-	for (p = node->portals; p; p = next_portal)
+// =====================================================================================
+//  SplitNodeCell
+//      Does to the cell of node what MakeNodePortal and SplitNodePortals do to its portals,
+//      in the same order. The children's cells then give the bounds their portals will have,
+//      without waiting for the neighbours that also cut those portals.
+// =====================================================================================
+static void SplitNodeCell(NodeBSP *node)
+{
+	SideBSP *s;
+	SideBSP *next;
+	SideBSP *news;
+	BrushBSP *f;
+	BrushBSP *b;
+	dplane_t *plane;
+	Winding *w;
+	Winding *frontwinding;
+	Winding *backwinding;
+
+	plane = &g_mapplanes[node->planenum];
+	f = node->children[0]->cell = AllocBrush();
+	b = node->children[1]->cell = AllocBrush();
+
+	// the side on the cutting plane, like the new portal
+	w = new Winding(*plane);
+	for (s = node->cell->sides; s && w->m_NumPoints; s = s->next)
 	{
-		if (p->nodes[0] == node)
+		w->Clip(s->plane, true);
+	}
+	if (w->m_NumPoints == 0)
+	{
+		delete w;
+	}
+	else
+	{
+		news = AllocSide();
+		news->plane = *plane;
+		news->w = w;
+		f->sides = news;
+		news = AllocSide();
+		news->plane = *plane;
+		news->plane.dist = -news->plane.dist;
+		VectorSubtract(vec3_origin, news->plane.normal, news->plane.normal);
+		news->w = new Winding(*w);
+		b->sides = news;
+	}
+
+	// cut the other sides into the children
+	for (s = node->cell->sides; s; s = next)
+	{
+		next = s->next;
+		s->w->Divide(*plane, &frontwinding, &backwinding);
+		if (!frontwinding && !backwinding)
 		{
-			side = 0;
+			FreeSide(s);
+			continue;
 		}
-		else if (p->nodes[1] == node)
+		if (!frontwinding)
 		{
-			side = 1;
+			s->next = b->sides;
+			b->sides = s;
+			continue;
 		}
-		else
+		if (!backwinding)
 		{
-			Error("CalcNodeBounds: mislinked portal");
+			s->next = f->sides;
+			f->sides = s;
+			continue;
 		}
-		next_portal = p->next[side];
 
-		for (i = 0; i < p->winding->m_NumPoints; i++)
+		news = AllocSide();
+		news->plane = s->plane;
+		news->w = backwinding;
+		delete s->w;
+		s->w = frontwinding;
+		s->next = f->sides;
+		f->sides = s;
+		news->next = b->sides;
+		b->sides = news;
+	}
+
+	node->cell->sides = nullptr;
+	FreeBrush(node->cell);
+	node->cell = nullptr;
+}
+
+// =====================================================================================
+//  AddWindingToNodeBounds
+// =====================================================================================
+static void AddWindingToNodeBounds(const Winding *w, NodeBSP *node)
+{
+	unsigned int i;
+	int j;
+	vec_t v;
+
+	for (i = 0; i < w->m_NumPoints; i++)
+	{
+		for (j = 0; j < 3; j++)
 		{
-			for (j = 0; j < 3; j++)
+			v = w->m_Points[i][j];
+			if (v < node->mins[j])
 			{
-				v = p->winding->m_Points[i][j];
-				if (v < node->mins[j])
-				{
-					node->mins[j] = v;
-				}
-				if (v > node->maxs[j])
-				{
-					node->maxs[j] = v;
-				}
+				node->mins[j] = v;
+			}
+			if (v > node->maxs[j])
+			{
+				node->maxs[j] = v;
 			}
 		}
 	}
+}
+
+// =====================================================================================
+//  CalcNodeBounds
+//      Determines the boundaries of a node by minmaxing all the points of its cell, which
+//      completely encloses the node.
+//      Returns true if the node should be midsplit.(very large)
+// =====================================================================================
+static auto CalcNodeBounds(NodeBSP *node, vec3_t validmins, vec3_t validmaxs) -> bool
+{
+	int i;
+	SideBSP *s;
+
+	if (node->isdetail)
+	{
+		return false;
+	}
+	node->mins[0] = node->mins[1] = node->mins[2] = BSP_BOGUS_RANGE;
+	node->maxs[0] = node->maxs[1] = node->maxs[2] = -BSP_BOGUS_RANGE;
+
+	for (s = node->cell->sides; s; s = s->next)
+	{
+		AddWindingToNodeBounds(s->w, node);
+	}
 
 	if (node->isportalleaf)
 	{
@@ -1460,6 +1988,43 @@ static auto CalcNodeBounds(NodeBSP *node, vec3_t validmins, vec3_t validmaxs) ->
 	return false;
 }
 
+// =====================================================================================
+//  CalcPortalBounds
+//      Sets the final boundaries of a node from the portals that enclose it.
+// =====================================================================================
+static void CalcPortalBounds(NodeBSP *node)
+{
+	PortalBSP *p;
+	PortalBSP *next_portal;
+	int side = 0;
+
+	if (node->isdetail)
+	{
+		return;
+	}
+	node->mins[0] = node->mins[1] = node->mins[2] = BSP_BOGUS_RANGE;
+	node->maxs[0] = node->maxs[1] = node->maxs[2] = -BSP_BOGUS_RANGE;
+
+	for (p = node->portals; p; p = next_portal)
+	{
+		if (p->nodes[0] == node)
+		{
+			side = 0;
+		}
+		else if (p->nodes[1] == node)
+		{
+			side = 1;
+		}
+		else
+		{
+			Error("CalcPortalBounds: mislinked portal");
+		}
+		next_portal = p->next[side];
+
+		AddWindingToNodeBounds(p->winding, node);
+	}
+}
+
 // =====================================================================================
 //  CopyFacesToNode
 //      Do a final merge attempt, then subdivide the faces to surface cache size if needed.
@@ -1500,8 +2065,9 @@ static void CopyFacesToNode(NodeBSP *node, SurfaceBSP *surf)
 		}
 		if (f->contents != static_cast<int>(contents_t::CONTENTS_SOLID))
 		{
-			newf = AllocFace();
-			*newf = *f;
+			// tjunc may add points to the faces on the node
+			newf = AllocFace(qmax(f->numpoints, MAXPOINTS));
+			CopyFace(newf, f);
 			f->original = newf;
 			newf->next = node->faces;
 			node->faces = newf;
@@ -1509,10 +2075,28 @@ static void CopyFacesToNode(NodeBSP *node, SurfaceBSP *surf)
 	}
 }
 
+// =====================================================================================
+//  CountSurfaces
+//      stops counting at limit
+// =====================================================================================
+static auto CountSurfaces(const SurfaceBSP *surfaces, int limit) -> int
+{
+	int count = 0;
+	for (; surfaces && count < limit; surfaces = surfaces->next)
+	{
+		count++;
+	}
+	return count;
+}
+
+static void BuildBspTreeTask(void *data);
+
 // =====================================================================================
 //  BuildBspTree_r
+//      Runs on any thread: a node only touches its own surfaces, brushes and cell.
+//      The shared portals are made afterwards by MakeTreePortals_r.
 // =====================================================================================
-static void BuildBspTree_r(NodeBSP *node)
+static void BuildBspTree_r(NodeBSP *node, BspBuild &build)
 {
 	SurfaceBSP *split;
 	bool midsplit;
@@ -1531,12 +2115,21 @@ static void BuildBspTree_r(NodeBSP *node)
 	}
 
 	int splitdetaillevel = CalcSplitDetaillevel(node);
+	if (splitdetaillevel == -1)
+	{
+		DeleteSurfaceTree(node->surfacetree);
+		node->surfacetree = nullptr;
+	}
+	else
+	{
+		RemoveSurfaceTreeFaces_r(node->surfacetree, splitdetaillevel);
+	}
 	FixDetaillevelForDiscardable(node, splitdetaillevel);
 	split = SelectPartition(node->surfaces, node, midsplit, splitdetaillevel, validmins, validmaxs);
 	if (!node->isdetail && (!split || split->detaillevel > 0))
 	{
 		node->isportalleaf = true;
-		LinkLeafFaces(node->surfaces, node); // set contents
+		LinkLeafFaces(node->surfaces, node, build.hullnum); // set contents
 		if (node->contents == static_cast<int>(contents_t::CONTENTS_SOLID))
 		{
 			split = nullptr;
@@ -1557,15 +2150,42 @@ static void BuildBspTree_r(NodeBSP *node)
 	allsurfs = node->surfaces;
 	node->planenum = split->planenum;
 	node->faces = nullptr;
-	CopyFacesToNode(node, split);
 
 	node->children[0] = AllocNode();
 	node->children[1] = AllocNode();
 	node->children[0]->isdetail = split->detaillevel > 0;
 	node->children[1]->isdetail = split->detaillevel > 0;
 
+	// before CopyFacesToNode merges the faces of split
+	std::vector<int> cutplanes;
+	std::vector<FaceBSP *> cutfaces;
+	SplitSurfaceTree(node, cutplanes, cutfaces);
+
+	// the bigger child works out its split counts from ours, which costs as much as testing
+	// the faces of the smaller one
+	planecounts_t *counts = node->planecounts;
+	node->planecounts = nullptr;
+	int bigside = 0;
+	if (counts)
+	{
+		const surfacetreenode_t *front = node->children[0]->surfacetree;
+		const surfacetreenode_t *back = node->children[1]->surfacetree;
+		bigside = (back ? back->size : 0) > (front ? front->size : 0) ? 1 : 0;
+		UpdatePlaneCounts(counts, node->children[!bigside]->surfacetree, -1);
+		UpdatePlaneCounts(counts, cutfaces, -1);
+	}
+	CopyFacesToNode(node, split);
+
 	// split all the polysurfaces into front and back lists
 	SplitNodeSurfaces(allsurfs, node);
+	std::vector<FaceBSP *> addedfaces[2];
+	AddCutFaces(node->children[0], cutplanes, addedfaces[0]);
+	AddCutFaces(node->children[1], cutplanes, addedfaces[1]);
+	if (counts)
+	{
+		UpdatePlaneCounts(counts, addedfaces[bigside], 1);
+		node->children[bigside]->planecounts = counts;
+	}
 	SplitNodeBrushes(node->detailbrushes, node);
 	if (node->boundsbrush)
 	{
@@ -1601,14 +2221,53 @@ static void BuildBspTree_r(NodeBSP *node)
 
 	if (!split->detaillevel)
 	{
-		MakeNodePortal(node);
-		SplitNodePortals(node);
+		SplitNodeCell(node);
+	}
+	else if (node->cell)
+	{
+		FreeBrush(node->cell);
+		node->cell = nullptr;
+	}
+
+	// recursively do the children, a big back side goes to whichever thread is idle
+	if (g_numthreads > 1 && CountSurfaces(node->children[1]->surfaces, BSP_TASK_MIN_SURFACES) >= BSP_TASK_MIN_SURFACES)
+	{
+		AddTask(build.tasks, BuildBspTreeTask, new BspBuildTask{&build, node->children[1]});
+		BuildBspTree_r(node->children[0], build);
+	}
+	else
+	{
+		BuildBspTree_r(node->children[0], build);
+		BuildBspTree_r(node->children[1], build);
+	}
+	build.numnodes++;
+}
+
+static void BuildBspTreeTask(void *data)
+{
+	auto *task = (BspBuildTask *)data;
+	BuildBspTree_r(task->node, *task->build);
+	delete task;
+}
+
+// =====================================================================================
+//  MakeTreePortals_r
+//      Cuts the real portals down the finished tree in the same order BuildBspTree_r once did
+//      it, so every nondetail node ends up with the same portals and bounds no matter how
+//      the tree was built.
+// =====================================================================================
+static void MakeTreePortals_r(NodeBSP *node)
+{
+	CalcPortalBounds(node);
+	if (node->planenum == PLANENUM_LEAF || node->children[0]->isdetail)
+	{
+		return;
 	}
+	MakeNodePortal(node);
+	SplitNodePortals(node);
 
-	// recursively do the children
-	BuildBspTree_r(node->children[0]);
-	BuildBspTree_r(node->children[1]);
-	UpdateStatus();
+	MakeTreePortals_r(node->children[0]);
+	MakeTreePortals_r(node->children[1]);
 }
 
 // =====================================================================================
@@ -1616,19 +2275,18 @@ static void BuildBspTree_r(NodeBSP *node)
 //      Takes a chain of surfaces plus a split type, and returns a bsp tree with faces
 //      off the nodes.
 //      The original surface chain will be completely freed.
+//      Runs inside RunTasks, so the hulls can be built at the same time.
 // =====================================================================================
 auto SolidBSP(const SurfchainBSP *const surfhead,
 			  BrushBSP *detailbrushes,
+			  int hullnum,
 			  bool report_progress) -> NodeBSP *
 {
 	NodeBSP *headnode;
+	BspBuild build;
 
-	ResetStatus(report_progress);
+	build.hullnum = hullnum;
 	double start_time = I_FloatTime();
-	if (report_progress)
-	{
-		Log("SolidBSP [hull %d] ", g_hullnum);
-	}
 
 	headnode = AllocNode();
 	headnode->surfaces = surfhead->surfaces;
@@ -1640,15 +2298,20 @@ auto SolidBSP(const SurfchainBSP *const surfhead,
 	headnode->boundsbrush = BrushFromBox(brushmins, brushmaxs);
 
 	// generate six portals that enclose the entire world
-	MakeHeadnodePortals(headnode, surfhead->mins, surfhead->maxs);
+	MakeHeadnodePortals(headnode, &g_outside_nodes[hullnum], surfhead->mins, surfhead->maxs);
+	MakeNodeCell(headnode);
+	headnode->surfacetree = BuildSurfaceTree(headnode->surfaces);
 
 	// recursively partition everything
-	BuildBspTree_r(headnode);
+	BuildBspTree_r(headnode, build);
+	WaitTasks(build.tasks);
+	MakeTreePortals_r(headnode);
 
 	double end_time = I_FloatTime();
 	if (report_progress)
 	{
-		Log("%d (%.2f seconds)\n", ++g_numProcessed, (end_time - start_time));
+		// one line per hull, as the others may be printing theirs at the same time
+		Log("SolidBSP [hull %d] %d (%.2f seconds)\n", hullnum, build.numnodes + 1, (end_time - start_time));
 	}
 
 	return headnode;
@@ -13,8 +13,6 @@
 //  GetEdge
 //  MakeFaceEdges
 
-static int subdivides;
-
 /* a surface has all of the faces that could be drawn on a given plane
    the outside filling stage can remove some of them so a better bsp can be generated */
 
@@ -89,8 +87,6 @@ void SubdivideFace(FaceBSP *f, FaceBSP **prevptr)
             }
 
             // split it
-            subdivides++;
-
             VectorCopy(tex->vecs[axis], temp);
             v = VectorNormalize(temp);
 
@@ -311,9 +311,9 @@ static void AddFaceEdges(const FaceBSP *const f)
 
 //============================================================================
 
-static byte superfacebuf[1024 * 16];
+alignas(FaceBSP) static byte superfacebuf[1024 * 16];
 static FaceBSP *superface = (FaceBSP *)superfacebuf;
-static int MAX_SUPERFACEEDGES = (sizeof(superfacebuf) - sizeof(FaceBSP) + sizeof(superface->pts)) / sizeof(vec3_t);
+static int MAX_SUPERFACEEDGES = (sizeof(superfacebuf) - FaceSize(0)) / sizeof(vec3_t);
 static FaceBSP *newlist;
 
 static void SplitFaceForTjunc(FaceBSP *f, FaceBSP *original)
@@ -333,7 +333,7 @@ static void SplitFaceForTjunc(FaceBSP *f, FaceBSP *original)
         if (f->numpoints <= MAXPOINTS)
         { // the face is now small enough without more cutting
             // so copy it back to the original
-            *original = *f;
+            CopyFace(original, f);
             original->original = chain;
             original->next = newlist;
             newlist = original;
@@ -386,7 +386,7 @@ static void SplitFaceForTjunc(FaceBSP *f, FaceBSP *original)
         // cut off as big a piece as possible, less than MAXPOINTS, and not
         // past lastcorner
 
-        newface = NewFaceFromFace(f);
+        newface = NewFaceFromFace(f, MAXPOINTS);
 
         hlassume(f->original == nullptr, assume_ValidPointer); // "SplitFaceForTjunc: f->original"
 
@@ -436,7 +436,8 @@ static void FixFaceEdges(FaceBSP *f)
     vec_t t1;
     vec_t t2;
 
-    *superface = *f;
+    superface->maxpoints = MAX_SUPERFACEEDGES;
+    CopyFace(superface, f);
 
 restart:
     for (i = 0; i < superface->numpoints; i++)
@@ -466,7 +467,7 @@ restart:
 
     if (superface->numpoints <= MAXPOINTS)
     {
-        *f = *superface;
+        CopyFace(f, superface);
         f->next = newlist;
         newlist = f;
         return;
@@ -91,7 +91,7 @@ static auto WriteClipNodes_r(NodeBSP *node, const NodeBSP *portalleaf, clipnodem
 	{
 		if (node->contents == static_cast<int>(contents_t::CONTENTS_SOLID))
 		{
-			delete node;
+			FreeNode(node);
 			return contents_t::CONTENTS_SOLID;
 		}
 		else
@@ -110,7 +110,7 @@ static auto WriteClipNodes_r(NodeBSP *node, const NodeBSP *portalleaf, clipnodem
 			num = portalleaf->contents;
 		}
 		delete[] node->markfaces;
-		delete node;
+		FreeNode(node);
 		return num;
 	}
 
@@ -146,7 +146,7 @@ static auto WriteClipNodes_r(NodeBSP *node, const NodeBSP *portalleaf, clipnodem
 		c = output->second; // use existing clipnode
 	}
 
-	delete node;
+	FreeNode(node);
 	return c;
 }
 
@@ -389,7 +389,7 @@ static void FreeDrawNodes_r(NodeBSP *node)
 	{
 		if (node->children[i]->planenum != -1)
 		{
-			delete node->children[i];
+			FreeNode(node->children[i]);
 		}
 	}
 
@@ -399,10 +399,10 @@ static void FreeDrawNodes_r(NodeBSP *node)
 	for (f = node->faces; f; f = next)
 	{
 		next = f->next;
-		delete f;
+		FreeFace(f);
 	}
 
-	delete node;
+	FreeNode(node);
 }
 
 // =====================================================================================
@@ -0,0 +1,266 @@
+/*
+
+    COMPILE DRIVER    -aka-    C O M P I L E
+
+    Runs sCSG, sBSP, sVIS and sRAD on one map, in that order, from a single
+    command line.
+
+    This is only a driver. Each stage is still a separate process that reads
+    the previous stage's files from disk and leaves its own files behind
+    (.p0-.p3, .b0-.b3, .pln, .hsz, .prt). Nothing is passed in memory.
+    Running the stages in one process needs common/ built one way for all
+    four tools first: CSG/BSP build it with a double vec_t and BSP's own
+    dplane_t, VIS/RAD with a float vec_t, so linking them together would
+    give two definitions of Winding, mathlib and bspfile.
+
+*/
+
+#include <cstring>
+#include <cerrno>
+#include <climits>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "hlcompile.h"
+#include "arguments.h"
+#include "cmdlib.h"
+#include "log.h"
+
+extern char **environ;
+
+StageInfo g_stages[(int)CompileStage::STAGE_COUNT] = {
+    {"sCSG", "-csg",
+     {{"-worldextent", true}, {"-noskyclip", false}, {"-clipeconomy", false}, {"-cache", false}, {"-nocache", false},
+      {"-cliptype", true}, {"-texdata", true}, {"-wadcache", true}, {"-lightdata", true}, {"-threads", true},
+      {"-pin", false}, {"-trace", false}},
+     {}, true, 0.0},
+    {"sBSP", "-bsp",
+     {{"-nohull2", false}, {"-leakonly", false}, {"-subdivide", true}, {"-maxnodesize", true}, {"-texdata", true},
+      {"-lightdata", true}, {"-threads", true}, {"-pin", false}, {"-trace", false}},
+     {}, true, 0.0},
+    {"sVIS", "-vis",
+     {{"-fast", false}, {"-full", false}, {"-maxdistance", true}, {"-threads", true}, {"-pin", false},
+      {"-trace", false}},
+     {}, !DEFAULT_NOVIS, 0.0},
+    {"sRAD", "-rad",
+     {{"-extra", false}, {"-bounce", true}, {"-threads", true}, {"-pin", false}, {"-trace", false}, {"-chop", true},
+      {"-texchop", true}, {"-fade", true}, {"-limiter", true}, {"-low", false}, {"-high", false},
+      {"-texdata", true}, {"-wadcache", true}, {"-lightdata", true}},
+     {}, !DEFAULT_NORAD, 0.0},
+};
+
+// =====================================================================================
+//  GetToolDirectory
+//      the stage executables are expected next to sCOMPILE
+// =====================================================================================
+static auto GetToolDirectory() -> std::string
+{
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0)
+    {
+        return ".";
+    }
+    path[len] = '\0';
+    char *slash = strrchr(path, '/');
+    if (!slash)
+    {
+        return ".";
+    }
+    *slash = '\0';
+    return path;
+}
+
+// =====================================================================================
+//  RunStage
+//      spawns one tool with its options and the map name, and returns once it has exited
+// =====================================================================================
+static void RunStage(StageInfo &stage, const std::string &tooldir, const char *mapname)
+{
+    std::string program = tooldir + SYSTEM_SLASH_STR + stage.program;
+    std::vector<char *> argv;
+
+    argv.push_back(const_cast<char *>(program.c_str()));
+    for (std::string &arg : stage.args)
+    {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(const_cast<char *>(mapname));
+    argv.push_back(nullptr);
+
+    fflush(stdout);
+    double start = I_FloatTime();
+    pid_t pid;
+    int err = posix_spawn(&pid, program.c_str(), nullptr, nullptr, argv.data(), environ);
+    if (err)
+    {
+        Error("Could not start %s: %s\n", program.c_str(), strerror(err));
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            Error("waitpid failed for %s: %s\n", stage.program, strerror(errno));
+        }
+    }
+    stage.seconds = I_FloatTime() - start;
+
+    if (WIFSIGNALED(status))
+    {
+        Error("%s was killed by signal %d\n", stage.program, WTERMSIG(status));
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        Error("%s failed with exit code %d\n", stage.program, WEXITSTATUS(status));
+    }
+}
+
+// =====================================================================================
+//  FindStageOption
+// =====================================================================================
+static auto FindStageOption(const StageInfo &stage, const char *arg) -> const StageOption *
+{
+    for (const StageOption &option : stage.options)
+    {
+        if (!strcasecmp(arg, option.name))
+        {
+            return &option;
+        }
+    }
+    return nullptr;
+}
+
+// =====================================================================================
+//  HandleArgs
+//      options before the first stage switch go to every stage that accepts them,
+//      -novis and -norad are taken anywhere, the map name is last
+// =====================================================================================
+void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
+{
+    StageInfo *current = nullptr; // options before the first stage switch are shared
+
+    if (argc < 2 || argv[argc - 1][0] == '-')
+    {
+        Log("No mapfile specified\n");
+        Usage(ProgramType::PROGRAM_COMPILE);
+    }
+    mapname_from_arg = argv[argc - 1];
+
+    for (int i = 1; i < argc - 1; i++)
+    {
+        StageInfo *stageswitch = nullptr;
+        for (StageInfo &stage : g_stages)
+        {
+            if (!strcasecmp(argv[i], stage.argument))
+            {
+                stageswitch = &stage;
+                break;
+            }
+        }
+        if (stageswitch)
+        {
+            current = stageswitch;
+            continue;
+        }
+        if (!strcasecmp(argv[i], "-novis"))
+        {
+            g_stages[(int)CompileStage::STAGE_VIS].enabled = false;
+            continue;
+        }
+        if (!strcasecmp(argv[i], "-norad"))
+        {
+            g_stages[(int)CompileStage::STAGE_RAD].enabled = false;
+            continue;
+        }
+
+        // an option the table doesn't know is left to the tool of its group to report
+        bool known = false;
+        bool hasvalue = false;
+        for (StageInfo &stage : g_stages)
+        {
+            if (current && current != &stage)
+            {
+                continue;
+            }
+            const StageOption *option = FindStageOption(stage, argv[i]);
+            if (option)
+            {
+                known = true;
+                hasvalue = option->hasvalue;
+            }
+        }
+        if (!known && !current)
+        {
+            Log("Unknown option \"%s\"\n", argv[i]);
+            Usage(ProgramType::PROGRAM_COMPILE);
+        }
+        if (hasvalue && i + 1 >= argc - 1)
+        {
+            Log("Expected a value for '%s'\n", argv[i]);
+            Usage(ProgramType::PROGRAM_COMPILE);
+        }
+
+        for (StageInfo &stage : g_stages)
+        {
+            if (current ? current != &stage : !FindStageOption(stage, argv[i]))
+            {
+                continue;
+            }
+            stage.args.push_back(argv[i]);
+            if (hasvalue)
+            {
+                stage.args.push_back(argv[i + 1]);
+            }
+        }
+        if (hasvalue)
+        {
+            i++;
+        }
+    }
+}
+
+// =====================================================================================
+//  main
+// =====================================================================================
+auto main(const int argc, char **argv) -> int
+{
+    const char *mapname_from_arg = nullptr;
+    g_Program = "sCOMPILE";
+
+    if (InitConsole(argc, argv) < 0)
+        Usage(ProgramType::PROGRAM_COMPILE);
+    if (argc == 1)
+    {
+        Usage(ProgramType::PROGRAM_COMPILE);
+    }
+    HandleArgs(argc, argv, mapname_from_arg);
+
+    atexit(CloseLog);
+    LogArguments(argc, argv);
+
+    double start = I_FloatTime();
+    std::string tooldir = GetToolDirectory();
+    for (StageInfo &stage : g_stages)
+    {
+        if (stage.enabled)
+        {
+            RunStage(stage, tooldir, mapname_from_arg);
+        }
+    }
+    double end = I_FloatTime();
+
+    Log("\n");
+    for (const StageInfo &stage : g_stages)
+    {
+        if (stage.enabled)
+        {
+            Log("%-5s: %.2f seconds\n", stage.program, stage.seconds);
+        }
+    }
+    LogTimeElapsed(end - start);
+    return 0;
+}
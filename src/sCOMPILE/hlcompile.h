@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+constexpr bool DEFAULT_NOVIS = false;
+constexpr bool DEFAULT_NORAD = false;
+
+enum class CompileStage
+{
+    STAGE_CSG,
+    STAGE_BSP,
+    STAGE_VIS,
+    STAGE_RAD,
+    STAGE_COUNT
+};
+
+// an option a tool accepts, kept in step with the tool's HandleArgs
+struct StageOption
+{
+    const char *name;
+    bool hasvalue; // the next argument belongs to it
+};
+
+struct StageInfo
+{
+    const char *program;  // executable name, looked up next to sCOMPILE
+    const char *argument; // switch that starts this stage's option group
+    std::vector<StageOption> options;
+    std::vector<std::string> args;
+    bool enabled;
+    double seconds;
+};
+
+extern StageInfo g_stages[(int)CompileStage::STAGE_COUNT];
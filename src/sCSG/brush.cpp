@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstring>
+#include <vector>
 
 #include "hlcsg.h"
 #include "brush.h"
@@ -14,46 +18,107 @@ int g_nummapplanes;
 constexpr float DIST_EPSILON = 0.04;
 
 // =====================================================================================
-//  FindIntPlane, fast version (replacement by KGP)
-//	This process could be optimized by placing the planes in a (non hash-) set and using
-//	half of the inner loop check below as the comparator; I'd expect the speed gain to be
-//	very large given the change from O(N^2) to O(NlogN) to build the set of planes.
+//  Plane hash
+//	Planes are bucketed by their normal (cells of PLANE_HASH_NORMAL_CELL per component)
+//	and distance (cells of PLANE_HASH_DIST_CELL). A lookup probes every cell that a plane
+//	within DIR_EPSILON/DIST_EPSILON of the query could live in, and returns the lowest
+//	matching plane number, which is what the old linear scan returned.
+//	Lookups are lock-free: a plane is fully written before its bucket head is published.
+//	Inserts happen under ThreadLock.
 // =====================================================================================
 
-auto FindIntPlane(const vec_t *const normal, const vec_t *const origin) -> int
+constexpr int PLANE_HASH_SIZE = 65536;
+constexpr vec_t PLANE_HASH_NORMAL_CELL = 1.0 / 64;
+constexpr vec_t PLANE_HASH_DIST_CELL = 8.0;
+
+static std::atomic<int> g_planehash[PLANE_HASH_SIZE]; // first plane + 1 in each bucket, 0 = empty
+static int g_planehashnext[MAX_INTERNAL_MAP_PLANES];	 // next plane + 1 in the same bucket
+
+static auto PlaneHashCell(vec_t value, vec_t cellsize) -> int
 {
-	vec_t t;
-	auto returnval = 0;
+	return (int)floor(value / cellsize);
+}
 
-find_plane:
-	for (; returnval < g_nummapplanes; returnval++)
-	{
-		// BUG: there might be some multithread issue --vluzacn
-		if (-DIR_EPSILON < (t = normal[0] - g_mapplanes[returnval].normal[0]) && t < DIR_EPSILON &&
-			-DIR_EPSILON < (t = normal[1] - g_mapplanes[returnval].normal[1]) && t < DIR_EPSILON &&
-			-DIR_EPSILON < (t = normal[2] - g_mapplanes[returnval].normal[2]) && t < DIR_EPSILON)
-		{
-			t = DotProduct(origin, g_mapplanes[returnval].normal) - g_mapplanes[returnval].dist;
+static auto PlaneHashBucket(const int (&normalcell)[3], int distcell) -> int
+{
+	unsigned hash = (unsigned)normalcell[0] * 73856093u ^ (unsigned)normalcell[1] * 19349663u ^
+					(unsigned)normalcell[2] * 83492791u ^ (unsigned)distcell * 2654435761u;
+	return hash & (PLANE_HASH_SIZE - 1);
+}
 
-			if (-DIST_EPSILON < t && t < DIST_EPSILON)
-			{
-				return returnval;
-			}
-		}
+static void PlaneHashInsert(int planenum)
+{
+	const Plane *p = &g_mapplanes[planenum];
+	int normalcell[3];
+	for (int i = 0; i < 3; i++)
+	{
+		normalcell[i] = PlaneHashCell(p->normal[i], PLANE_HASH_NORMAL_CELL);
 	}
+	int bucket = PlaneHashBucket(normalcell, PlaneHashCell(p->dist, PLANE_HASH_DIST_CELL));
+	g_planehashnext[planenum] = g_planehash[bucket].load(std::memory_order_relaxed);
+	g_planehash[bucket].store(planenum + 1, std::memory_order_release);
+}
 
-	ThreadLock();
-	if (returnval != g_nummapplanes) // make sure we don't race
+static auto PlaneHashFind(const vec_t *const normal, const vec_t *const origin) -> int
+{
+	// a matching plane's normal differs by less than DIR_EPSILON per component, so its
+	// distance differs from ours by less than DIST_EPSILON + |origin| * sqrt(3) * DIR_EPSILON;
+	// the ranges below are padded to stay clear of rounding at cell edges
+	vec_t dist = DotProduct(origin, normal);
+	vec_t slack = 2 * DIST_EPSILON + VectorLength(origin) * (2 * DIR_EPSILON);
+	int lo[4], hi[4];
+	for (int i = 0; i < 3; i++)
 	{
-		ThreadUnlock();
-		goto find_plane; // check to see if other thread added plane we need
+		lo[i] = PlaneHashCell(normal[i] - 2 * DIR_EPSILON, PLANE_HASH_NORMAL_CELL);
+		hi[i] = PlaneHashCell(normal[i] + 2 * DIR_EPSILON, PLANE_HASH_NORMAL_CELL);
 	}
+	lo[3] = PlaneHashCell(dist - slack, PLANE_HASH_DIST_CELL);
+	hi[3] = PlaneHashCell(dist + slack, PLANE_HASH_DIST_CELL);
 
-	// create new planes - double check that we have room for 2 planes
-	hlassume(g_nummapplanes + 1 < MAX_INTERNAL_MAP_PLANES, assume_MAX_INTERNAL_MAP_PLANES);
-
-	auto *p = &g_mapplanes[g_nummapplanes];
+	int best = -1;
+	int cell[3];
+	for (cell[0] = lo[0]; cell[0] <= hi[0]; cell[0]++)
+	{
+		for (cell[1] = lo[1]; cell[1] <= hi[1]; cell[1]++)
+		{
+			for (cell[2] = lo[2]; cell[2] <= hi[2]; cell[2]++)
+			{
+				for (int distcell = lo[3]; distcell <= hi[3]; distcell++)
+				{
+					int bucket = PlaneHashBucket(cell, distcell);
+					for (int i = g_planehash[bucket].load(std::memory_order_acquire) - 1; i >= 0; i = g_planehashnext[i] - 1)
+					{
+						if (best != -1 && i > best)
+						{
+							continue;
+						}
+						const Plane *p = &g_mapplanes[i];
+						vec_t t;
+						if (-DIR_EPSILON < (t = normal[0] - p->normal[0]) && t < DIR_EPSILON &&
+							-DIR_EPSILON < (t = normal[1] - p->normal[1]) && t < DIR_EPSILON &&
+							-DIR_EPSILON < (t = normal[2] - p->normal[2]) && t < DIR_EPSILON)
+						{
+							t = DotProduct(origin, p->normal) - p->dist;
+							if (-DIST_EPSILON < t && t < DIST_EPSILON)
+							{
+								best = i;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	return best;
+}
 
+// =====================================================================================
+//  MakePlanePair
+//      fills in the two planes FindIntPlane stores for normal and origin, an axial plane
+//      facing positive first; returns which of the two faces along normal
+// =====================================================================================
+static auto MakePlanePair(const vec_t *const normal, const vec_t *const origin, Plane *p) -> int
+{
 	VectorCopy(origin, p->origin);
 	VectorCopy(normal, p->normal);
 	VectorNormalize(p->normal);
@@ -81,13 +146,44 @@ find_plane:
 		auto temp = *p;
 		*p = *(p + 1);
 		*(p + 1) = temp;
-		returnval = g_nummapplanes + 1;
+		return 1;
 	}
-	else
+	return 0;
+}
+
+// the same plane bit for bit (a zero keeps its sign), leaving out the origin it was made from
+static auto PlanesCoincide(const Plane *a, const Plane *b) -> bool
+{
+	return !memcmp(a->normal, b->normal, sizeof(vec3_t)) && !memcmp(&a->dist, &b->dist, sizeof(vec_t)) && a->type == b->type;
+}
+
+// =====================================================================================
+//  FindIntPlane
+// =====================================================================================
+
+auto FindIntPlane(const vec_t *const normal, const vec_t *const origin) -> int
+{
+	auto returnval = PlaneHashFind(normal, origin);
+	if (returnval != -1)
+	{
+		return returnval;
+	}
+
+	ThreadLock();
+	returnval = PlaneHashFind(normal, origin); // another thread may have added it meanwhile
+	if (returnval != -1)
 	{
-		returnval = g_nummapplanes;
+		ThreadUnlock();
+		return returnval;
 	}
 
+	// create new planes - double check that we have room for 2 planes
+	hlassume(g_nummapplanes + 1 < MAX_INTERNAL_MAP_PLANES, assume_MAX_INTERNAL_MAP_PLANES);
+
+	returnval = g_nummapplanes + MakePlanePair(normal, origin, &g_mapplanes[g_nummapplanes]);
+
+	PlaneHashInsert(g_nummapplanes);
+	PlaneHashInsert(g_nummapplanes + 1);
 	g_nummapplanes += 2;
 	ThreadUnlock();
 	return returnval;
@@ -111,32 +207,52 @@ auto PlaneFromPoints(const vec_t *const p0, const vec_t *const p1, const vec_t *
 // =====================================================================================
 //  AddHullPlane (subroutine for replacement of ExpandBrush, KGP)
 //  Called to add any and all clip hull planes by the new ExpandBrush.
+//  Only records the plane; AddHullPlanes makes the faces, so ExpandBrush creates no planes.
 // =====================================================================================
 
-void AddHullPlane(BrushHull *hull, const vec_t *const normal, const vec_t *const origin, const bool check_planenum)
+void AddHullPlane(std::vector<HullPlaneRequest> &planes, const vec_t *const normal, const vec_t *const origin, const bool check_planenum)
 {
-	auto planenum = FindIntPlane(normal, origin);
-	// check to see if this plane is already in the brush (optional to speed
-	// up cases where we know the plane hasn't been added yet, like axial case)
-	if (check_planenum)
-	{
+	HullPlaneRequest request;
+	VectorCopy(normal, request.normal);
+	VectorCopy(origin, request.origin);
+	request.check_planenum = check_planenum;
+	planes.push_back(request);
+}
 
-		BrushFace *current_face;
-		for (current_face = hull->faces; current_face; current_face = current_face->next)
+// =====================================================================================
+//  AddHullPlanes
+//      adds the faces for the planes ExpandBrush asked for, in the order it asked
+// =====================================================================================
+void AddHullPlanes(BrushHull *hull, const std::vector<HullPlaneRequest> &planes)
+{
+	for (const HullPlaneRequest &request : planes)
+	{
+		auto planenum = FindIntPlane(request.normal, request.origin);
+		// check to see if this plane is already in the brush (optional to speed
+		// up cases where we know the plane hasn't been added yet, like axial case)
+		if (request.check_planenum)
 		{
-			if (current_face->planenum == planenum)
+			BrushFace *current_face;
+			for (current_face = hull->faces; current_face; current_face = current_face->next)
 			{
-				return;
-			} // don't add a plane twice
+				if (current_face->planenum == planenum)
+				{
+					break;
+				} // don't add a plane twice
+			}
+			if (current_face)
+			{
+				continue;
+			}
 		}
+		auto *new_face = (BrushFace *)Alloc(sizeof(BrushFace)); // freed by FreeHullFaces
+		new_face->planenum = planenum;
+		new_face->plane = &g_mapplanes[new_face->planenum];
+		new_face->next = hull->faces;
+		new_face->contents = CONTENTS_EMPTY;
+		hull->faces = new_face;
+		new_face->texinfo = -1;
 	}
-	auto *new_face = (BrushFace *)Alloc(sizeof(BrushFace)); // TODO: This leaks
-	new_face->planenum = planenum;
-	new_face->plane = &g_mapplanes[new_face->planenum];
-	new_face->next = hull->faces;
-	new_face->contents = CONTENTS_EMPTY;
-	hull->faces = new_face;
-	new_face->texinfo = -1;
 }
 
 // =====================================================================================
@@ -173,7 +289,7 @@ void AddHullPlane(BrushHull *hull, const vec_t *const normal, const vec_t *const
 //     cliptype          simple    precise     legacy normalized   smallest
 //     clipnodecount        971       1089       1202       1232       1000
 
-void ExpandBrushWithHullBrush(const Brush *brush, const BrushHull *hull0, const HullBrush *hb, BrushHull *hull)
+void ExpandBrushWithHullBrush(const Brush *brush, const BrushHull *hull0, const HullBrush *hb, std::vector<HullPlaneRequest> &planes)
 {
 	const HullBrushFace *hbf;
 	const HullBrushEdge *hbe;
@@ -247,7 +363,7 @@ void ExpandBrushWithHullBrush(const Brush *brush, const BrushHull *hull0, const
 		{
 			VectorSubtract(brushface.point, bestvertex, origin);
 		}
-		AddHullPlane(hull, normal, origin, true);
+		AddHullPlane(planes, normal, origin, true);
 	}
 
 	// check for edge-edge type. edge-face type and face-edge type are excluded.
@@ -324,7 +440,7 @@ void ExpandBrushWithHullBrush(const Brush *brush, const BrushHull *hull0, const
 					continue;
 				}
 				VectorSubtract(brushedge.point, hbe->point, origin);
-				AddHullPlane(hull, normal, origin, true);
+				AddHullPlane(planes, normal, origin, true);
 			}
 		}
 	}
@@ -361,13 +477,13 @@ void ExpandBrushWithHullBrush(const Brush *brush, const BrushHull *hull0, const
 		{
 			VectorSubtract(bestvertex, hbf->point, origin);
 		}
-		AddHullPlane(hull, normal, origin, true);
+		AddHullPlane(planes, normal, origin, true);
 	}
 
 	delete axialbevel;
 }
 
-void ExpandBrush(Brush *brush, const int hullnum)
+auto FindHullShape(const Brush *brush, const int hullnum, const bool report) -> const HullShape *
 {
 	const HullShape *hs = &g_defaulthulls[hullnum];
 	{ // look up the name of its hull shape in g_hullshapes[]
@@ -380,7 +496,7 @@ void ExpandBrush(Brush *brush, const int hullnum)
 				const HullShape *s = &g_hullshapes[i];
 				if (!strcmp(name, s->id))
 				{
-					if (found)
+					if (found && report)
 					{
 						Warning("Entity %i, Brush %i: Found several info_hullshape entities with the same name '%s'.",
 								brush->originalentitynum, brush->originalbrushnum,
@@ -390,7 +506,7 @@ void ExpandBrush(Brush *brush, const int hullnum)
 					found = true;
 				}
 			}
-			if (!found)
+			if (!found && report)
 			{
 				Error("Entity %i, Brush %i: Couldn't find info_hullshape entity '%s'.",
 					  brush->originalentitynum, brush->originalbrushnum,
@@ -398,6 +514,12 @@ void ExpandBrush(Brush *brush, const int hullnum)
 			}
 		}
 	}
+	return hs;
+}
+
+void ExpandBrush(const Brush *brush, const int hullnum, std::vector<HullPlaneRequest> &planes)
+{
+	const HullShape *hs = FindHullShape(brush, hullnum, true);
 
 	if (!hs->disabled)
 	{
@@ -405,7 +527,7 @@ void ExpandBrush(Brush *brush, const int hullnum)
 		{
 			return; // leave this hull of this brush empty (noclip)
 		}
-		ExpandBrushWithHullBrush(brush, &brush->hulls[0], hs->brushes[0], &brush->hulls[hullnum]);
+		ExpandBrushWithHullBrush(brush, &brush->hulls[0], hs->brushes[0], planes);
 
 		return;
 	}
@@ -423,8 +545,6 @@ void ExpandBrush(Brush *brush, const int hullnum)
 
 	bool warned = false;
 
-	auto *hull = &brush->hulls[hullnum];
-
 	// step 1: for collision between player vertex and brush face. --vluzacn
 	for (current_face = brush->hulls[0].faces; current_face; current_face = current_face->next)
 	{
@@ -502,7 +622,7 @@ void ExpandBrush(Brush *brush, const int hullnum)
 			origin[2] += g_hull_size[hullnum][(normal[2] > 0 ? 1 : 0)][2];
 		}
 
-		AddHullPlane(hull, normal, origin, false);
+		AddHullPlane(planes, normal, origin, false);
 	} // end for loop over all faces
 
 	// step 2: for collision between player edge and brush edge. --vluzacn
@@ -634,7 +754,7 @@ void ExpandBrush(Brush *brush, const int hullnum)
 						}
 
 						// add the bevel plane to the expanded hull
-						AddHullPlane(hull, normal, origin, true); // double check that this edge hasn't been added yet
+						AddHullPlane(planes, normal, origin, true); // double check that this edge hasn't been added yet
 					}
 				} // end for loop (check for each direction)
 			} // end for loop (over all edges in face)
@@ -651,26 +771,44 @@ void ExpandBrush(Brush *brush, const int hullnum)
 	normal[0] = -1;
 	normal[1] = 0;
 	normal[2] = 0;
-	AddHullPlane(hull, normal, (axialbevel[plane_x][0] ? brush->hulls[0].bounds.m_Mins : origin), false);
+	AddHullPlane(planes, normal, (axialbevel[plane_x][0] ? brush->hulls[0].bounds.m_Mins : origin), false);
 	normal[0] = 0;
 	normal[1] = -1;
-	AddHullPlane(hull, normal, (axialbevel[plane_y][0] ? brush->hulls[0].bounds.m_Mins : origin), false);
+	AddHullPlane(planes, normal, (axialbevel[plane_y][0] ? brush->hulls[0].bounds.m_Mins : origin), false);
 	normal[1] = 0;
 	normal[2] = -1;
-	AddHullPlane(hull, normal, (axialbevel[plane_z][0] ? brush->hulls[0].bounds.m_Mins : origin), false);
+	AddHullPlane(planes, normal, (axialbevel[plane_z][0] ? brush->hulls[0].bounds.m_Mins : origin), false);
 
 	normal[2] = 0;
 
 	// add maxes
 	VectorAdd(brush->hulls[0].bounds.m_Maxs, g_hull_size[hullnum][1], origin);
 	normal[0] = 1;
-	AddHullPlane(hull, normal, (axialbevel[plane_x][1] ? brush->hulls[0].bounds.m_Maxs : origin), false);
+	AddHullPlane(planes, normal, (axialbevel[plane_x][1] ? brush->hulls[0].bounds.m_Maxs : origin), false);
 	normal[0] = 0;
 	normal[1] = 1;
-	AddHullPlane(hull, normal, (axialbevel[plane_y][1] ? brush->hulls[0].bounds.m_Maxs : origin), false);
+	AddHullPlane(planes, normal, (axialbevel[plane_y][1] ? brush->hulls[0].bounds.m_Maxs : origin), false);
 	normal[1] = 0;
 	normal[2] = 1;
-	AddHullPlane(hull, normal, (axialbevel[plane_z][1] ? brush->hulls[0].bounds.m_Maxs : origin), false);
+	AddHullPlane(planes, normal, (axialbevel[plane_z][1] ? brush->hulls[0].bounds.m_Maxs : origin), false);
+}
+
+// =====================================================================================
+//  ExpandBrushStale
+//      whether ExpandBrush has to run again on the planes NumberBrushSides found, when
+//      they differ only by the origin from the ones hull 0 was made ahead with
+// =====================================================================================
+auto ExpandBrushStale(const Brush *brush, const int hullnum, const BrushSides &sides) -> bool
+{
+	const HullShape *hs = FindHullShape(brush, hullnum, false);
+
+	if (!hs->disabled)
+	{
+		// ExpandBrushWithHullBrush reads the origin of every face
+		return hs->numbrushes != 0 && sides.moved;
+	}
+	// only the non-axial planes are offset from their origin
+	return sides.movednonaxial;
 }
 
 // =====================================================================================
@@ -697,8 +835,7 @@ void SortSides(BrushHull *h)
 	{
 		sides[i] = f;
 		isused[i] = false;
-		const Plane *p = &g_mapplanes[f->planenum];
-		VectorCopy(p->normal, normals[i]);
+		VectorCopy(f->plane->normal, normals[i]);
 	}
 	for (i = 0; i < numsides; i++)
 	{
@@ -749,7 +886,8 @@ restart:
 			{
 				continue;
 			}
-			const Plane *p = &g_mapplanes[f2->planenum ^ 1];
+			// a face MakeBrushSides made has no planenum yet, its back plane follows its plane
+			const Plane *p = f2->planenum == -1 ? f2->plane + 1 : &g_mapplanes[f2->planenum ^ 1];
 			if (!w->Chop(p->normal, p->dist, NORMAL_EPSILON // fix "invalid brush" in ExpandBrush
 						 ))									// Nothing left to chop (getArea will return 0 for us in this case for below)
 			{
@@ -772,6 +910,7 @@ restart:
 				}
 				f2->next = f->next;
 			}
+			Free(f);
 			goto restart;
 		}
 		else
@@ -799,18 +938,51 @@ restart:
 }
 
 // =====================================================================================
-//  MakeBrushPlanes
+//  FreeHullFaces
 // =====================================================================================
-auto MakeBrushPlanes(Brush *b) -> bool
+void FreeHullFaces(BrushHull *h)
+{
+	BrushFace *next;
+	for (auto *f = h->faces; f; f = next)
+	{
+		next = f->next;
+		delete f->w;
+		Free(f);
+	}
+	h->faces = nullptr;
+}
+
+// =====================================================================================
+//  AddSideFace
+//      prepends the hull 0 face of side i, so the faces list the sides backwards
+// =====================================================================================
+static void AddSideFace(Brush *b, const int i, Plane *plane, const int planenum, const int texinfo)
+{
+	auto *s = &g_brushsides[b->firstside + i];
+	auto *f = (BrushFace *)Alloc(sizeof(BrushFace)); // freed by FreeHullFaces
+
+	f->planenum = planenum;
+	f->plane = plane;
+	f->next = b->hulls[0].faces;
+	b->hulls[0].faces = f;
+	f->texinfo = texinfo;
+	f->bevel = b->bevel || s->bevel;
+}
+
+// =====================================================================================
+//  MakeBrushSides
+//      works out the plane of each side the way FindIntPlane would make it and gives
+//      hull 0 a face on each, numbered -1 until NumberBrushSides finds the real planes
+// =====================================================================================
+void MakeBrushSides(Brush *b, BrushSides &sides)
 {
-	BrushFace *f;
 	vec3_t origin;
 
 	// if the origin key is set (by an origin brush), offset all of the values
 	GetVectorForKey(&g_entities[b->entitynum], "origin", origin);
 
-	// convert to mapplanes
-	// for each side in this brush
+	sides.requests.resize(b->numsides);
+	sides.planes.resize(b->numsides * 2);
 	for (int i = 0; i < b->numsides; i++)
 	{
 		auto *s = &g_brushsides[b->firstside + i];
@@ -818,19 +990,61 @@ auto MakeBrushPlanes(Brush *b) -> bool
 		{
 			VectorSubtract(s->planepts[j], origin, s->planepts[j]);
 		}
-		auto planenum = PlaneFromPoints(s->planepts[0], s->planepts[1], s->planepts[2]);
-		if (planenum == -1)
+
+		// as PlaneFromPoints does
+		auto &request = sides.requests[i];
+		vec3_t v1, v2;
+		VectorSubtract(s->planepts[0], s->planepts[1], v1);
+		VectorSubtract(s->planepts[2], s->planepts[1], v2);
+		CrossProduct(v1, v2, request.normal);
+		VectorCopy(s->planepts[0], request.origin);
+		request.check_planenum = VectorNormalize(request.normal) != 0;
+		if (!request.check_planenum)
+		{
+			continue;
+		}
+
+		// the plane of the side first, then its back
+		Plane pair[2];
+		auto k = MakePlanePair(request.normal, request.origin, pair);
+		sides.planes[i * 2] = pair[k];
+		sides.planes[i * 2 + 1] = pair[k ^ 1];
+		AddSideFace(b, i, &sides.planes[i * 2], -1, -1);
+	}
+}
+
+// =====================================================================================
+//  NumberBrushSides
+//      finds the real plane and texinfo of each side, in side order; returns false when
+//      a plane differs from the one MakeBrushSides guessed, after rebuilding the raw faces
+//      of hull 0 on the real planes. A plane found with another origin still counts as
+//      the same, ExpandBrushStale tells whether the expansions read it.
+// =====================================================================================
+auto NumberBrushSides(Brush *b, BrushSides &sides) -> bool
+{
+	vec3_t origin;
+	GetVectorForKey(&g_entities[b->entitynum], "origin", origin);
+
+	std::vector<int> planenums(b->numsides, -1);
+	std::vector<int> texinfos(b->numsides, -1);
+	for (int i = 0; i < b->numsides; i++)
+	{
+		auto *s = &g_brushsides[b->firstside + i];
+		const auto &request = sides.requests[i];
+		if (!request.check_planenum)
 		{
 			Fatal(assume_PLANE_WITH_NO_NORMAL, "Entity %i, Brush %i, Side %i: plane with no normal",
 				  b->originalentitynum, b->originalbrushnum, i);
+			continue;
 		}
+		auto planenum = FindIntPlane(request.normal, request.origin);
 
 		//
 		// see if the plane has been used already
 		//
-		for (f = b->hulls[0].faces; f; f = f->next)
+		for (int j = 0; j < i; j++)
 		{
-			if (f->planenum == planenum || f->planenum == (planenum ^ 1))
+			if (planenums[j] == planenum || planenums[j] == (planenum ^ 1))
 			{
 				Fatal(assume_BRUSH_WITH_COPLANAR_FACES, "Entity %i, Brush %i, Side %i: has a coplanar plane at (%.0f, %.0f, %.0f), texture %s",
 					  b->originalentitynum, b->originalbrushnum, i, s->planepts[0][0] + origin[0], s->planepts[0][1] + origin[1],
@@ -838,17 +1052,45 @@ auto MakeBrushPlanes(Brush *b) -> bool
 			}
 		}
 
-		f = (BrushFace *)Alloc(sizeof(*f)); // TODO: This leaks
+		planenums[i] = planenum;
+		texinfos[i] = TexinfoForBrushTexture(&s->texture, origin);
+	}
 
-		f->planenum = planenum;
-		f->plane = &g_mapplanes[planenum];
-		f->next = b->hulls[0].faces;
-		b->hulls[0].faces = f;
-		f->texinfo = TexinfoForBrushTexture(&s->texture, origin);
-		f->bevel = b->bevel || s->bevel;
+	// the faces MakeHullFaces kept point at the guessed planes
+	bool same = true;
+	sides.moved = false;
+	sides.movednonaxial = false;
+	for (auto *f = b->hulls[0].faces; f; f = f->next)
+	{
+		const auto *p = &g_mapplanes[planenums[(f->plane - sides.planes.data()) / 2]];
+		same = same && PlanesCoincide(p, f->plane);
+		if (memcmp(p->origin, f->plane->origin, sizeof(vec3_t)))
+		{
+			sides.moved = true;
+			sides.movednonaxial = sides.movednonaxial || p->type > last_axial;
+		}
+	}
+	if (same)
+	{
+		for (auto *f = b->hulls[0].faces; f; f = f->next)
+		{
+			auto i = (f->plane - sides.planes.data()) / 2;
+			f->planenum = planenums[i];
+			f->plane = &g_mapplanes[f->planenum];
+			f->texinfo = texinfos[i];
+		}
+		return true;
 	}
 
-	return true;
+	FreeHullFaces(&b->hulls[0]);
+	for (int i = 0; i < b->numsides; i++)
+	{
+		if (planenums[i] != -1)
+		{
+			AddSideFace(b, i, &g_mapplanes[planenums[i]], planenums[i], texinfos[i]);
+		}
+	}
+	return false;
 }
 
 // =====================================================================================
@@ -1094,49 +1336,96 @@ auto CheckBrushContents(const Brush *const b) -> contents_t
 // =====================================================================================
 //  CreateBrush
 //      makes a brush!
+//      the threaded phase in hlcsg.cpp runs the same steps as separate work units:
+//      CreateBrushHull0 and ExpandBrush for every brush ahead of the plane numbering,
+//      NumberBrushSides and AddHullPlanes in brush order, then MakeHullFaces for each
+//      expanded hull and FinishBrush
 // =====================================================================================
-void CreateBrush(const int brushnum) //--vluzacn
+auto CreateBrushHull0(const int brushnum, BrushSides &sides) -> bool
 {
 	auto *b = &g_mapbrushes[brushnum];
 	auto contents = b->contents;
 
 	if (contents == CONTENTS_ORIGIN)
-		return;
+		return false;
 	if (contents == CONTENTS_BOUNDINGBOX)
-		return;
+		return false;
 
 	//  HULL 0
-	MakeBrushPlanes(b);
+	MakeBrushSides(b, sides);
 	MakeHullFaces(b, &b->hulls[0]);
+	return true;
+}
+auto BrushHullExpands(const Brush *b, const int hullnum) -> bool
+{
+	auto contents = b->contents;
+
+	if (contents == CONTENTS_ORIGIN || contents == CONTENTS_BOUNDINGBOX)
+		return false;
+	if (contents == CONTENTS_HINT || contents == CONTENTS_TOEMPTY)
+		return false;
+
+	if (b->cliphull)
+		return (b->cliphull & (1 << hullnum)) != 0;
+	return !b->noclip;
+}
+auto BrushHullCost(const Brush *b, const int hullnum) -> int
+{
+	// ExpandBrush tests side pairs for bevels; a hull brush is also swept over
+	// each of its faces, edges and vertexes
+	int cost = b->numsides * b->numsides;
+	const HullShape *hs = FindHullShape(b, hullnum, false);
+	if (!hs->disabled && hs->numbrushes)
+	{
+		const HullBrush *hb = hs->brushes[0];
+		cost *= 1 + hb->numfaces + hb->numedges + hb->numvertexes;
+	}
+	return cost;
+}
+void CreateBrushHull(const int brushnum, const int hullnum)
+{
+	auto *b = &g_mapbrushes[brushnum];
+	std::vector<HullPlaneRequest> planes;
 
-	if (contents == CONTENTS_HINT)
+	ExpandBrush(b, hullnum, planes);
+	AddHullPlanes(&b->hulls[hullnum], planes);
+	MakeHullFaces(b, &b->hulls[hullnum]);
+}
+void FinishBrush(const int brushnum)
+{
+	auto *b = &g_mapbrushes[brushnum];
+	auto contents = b->contents;
+
+	if (contents == CONTENTS_ORIGIN || contents == CONTENTS_BOUNDINGBOX)
 		return;
-	if (contents == CONTENTS_TOEMPTY)
+	if (contents == CONTENTS_HINT || contents == CONTENTS_TOEMPTY)
 		return;
 
 	if (b->cliphull)
 	{
-		for (int h = 1; h < NUM_HULLS; h++)
-		{
-			if (b->cliphull & (1 << h))
-			{
-				ExpandBrush(b, h);
-				MakeHullFaces(b, &b->hulls[h]);
-			}
-		}
 		b->contents = contents_t::CONTENTS_SOLID;
-		b->hulls[0].faces = nullptr;
+		FreeHullFaces(&b->hulls[0]);
 	}
-	else
+}
+void CreateBrush(const int brushnum) //--vluzacn
+{
+	auto *b = &g_mapbrushes[brushnum];
+	BrushSides sides;
+
+	if (b->contents == CONTENTS_ORIGIN || b->contents == CONTENTS_BOUNDINGBOX)
+		return;
+
+	MakeBrushSides(b, sides);
+	NumberBrushSides(b, sides);
+	MakeHullFaces(b, &b->hulls[0]);
+	for (int h = 1; h < NUM_HULLS; h++)
 	{
-		if (b->noclip)
-			return;
-		for (int h = 1; h < NUM_HULLS; h++)
+		if (BrushHullExpands(&g_mapbrushes[brushnum], h))
 		{
-			ExpandBrush(b, h);
-			MakeHullFaces(b, &b->hulls[h]);
+			CreateBrushHull(brushnum, h);
 		}
 	}
+	FinishBrush(brushnum);
 }
 auto CreateHullBrush(const Brush *b) -> HullBrush *
 {
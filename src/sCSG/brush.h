@@ -1,5 +1,8 @@
 #pragma once
 
+#include <vector>
+
+#include "face.h"
 #include "hull.h"
 
 struct BrushHull
@@ -32,6 +35,23 @@ struct Brush
     BrushHull hulls[NUM_HULLS];
 };
 
+// a plane ExpandBrush wants on an expanded hull; AddHullPlanes turns it into a face
+struct HullPlaneRequest
+{
+    vec3_t normal;
+    vec3_t origin;
+    bool check_planenum;
+};
+
+// the planes the sides of a brush ask FindIntPlane for, worked out before any is numbered
+struct BrushSides
+{
+    std::vector<HullPlaneRequest> requests; // check_planenum is false for a side with no normal
+    std::vector<Plane> planes;              // plane and back plane FindIntPlane makes for each side if first to ask
+    bool moved = false;                     // NumberBrushSides found a plane with another origin
+    bool movednonaxial = false;             // ... and it is not axial
+};
+
 extern HullShape g_defaulthulls[NUM_HULLS];
 extern int g_numhullshapes;
 extern HullShape g_hullshapes[MAX_HULLSHAPES];
@@ -39,19 +59,29 @@ extern HullShape g_hullshapes[MAX_HULLSHAPES];
 auto FindIntPlane(const vec_t *const normal, const vec_t *const origin) -> int;
 auto PlaneFromPoints(const vec_t *const p0, const vec_t *const p1, const vec_t *const p2) -> int;
 
-void AddHullPlane(BrushHull *hull, const vec_t *const normal, const vec_t *const origin, const bool check_planenum);
-void ExpandBrushWithHullBrush(const Brush *brush, const BrushHull *hull0, const HullBrush *hb, BrushHull *hull);
-void ExpandBrush(Brush *brush, const int hullnum);
+void AddHullPlane(std::vector<HullPlaneRequest> &planes, const vec_t *const normal, const vec_t *const origin, const bool check_planenum);
+void AddHullPlanes(BrushHull *hull, const std::vector<HullPlaneRequest> &planes);
+void ExpandBrushWithHullBrush(const Brush *brush, const BrushHull *hull0, const HullBrush *hb, std::vector<HullPlaneRequest> &planes);
+auto FindHullShape(const Brush *brush, const int hullnum, const bool report) -> const HullShape *;
+void ExpandBrush(const Brush *brush, const int hullnum, std::vector<HullPlaneRequest> &planes);
+auto ExpandBrushStale(const Brush *brush, const int hullnum, const BrushSides &sides) -> bool;
 
 void SortSides(BrushHull *h);
 
 void MakeHullFaces(const Brush *const b, BrushHull *h);
-auto MakeBrushPlanes(Brush *b) -> bool;
+void FreeHullFaces(BrushHull *h);
+void MakeBrushSides(Brush *b, BrushSides &sides);
+auto NumberBrushSides(Brush *b, BrushSides &sides) -> bool;
 
 static auto TextureContents(const char *const name) -> contents_t;
 auto ContentsToString(const contents_t type) -> const char *;
 auto CheckBrushContents(const Brush *const b) -> contents_t;
 
+auto CreateBrushHull0(const int brushnum, BrushSides &sides) -> bool;
+auto BrushHullExpands(const Brush *b, const int hullnum) -> bool;
+auto BrushHullCost(const Brush *b, const int hullnum) -> int;
+void CreateBrushHull(const int brushnum, const int hullnum);
+void FinishBrush(const int brushnum);
 void CreateBrush(const int brushnum); //--vluzacn
 auto CreateHullBrush(const Brush *b) -> HullBrush *;
 void CreateHullShape(int entitynum, bool disabled, const char *id, int defaulthulls);
\ No newline at end of file
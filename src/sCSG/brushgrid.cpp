@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+
+#include "brushgrid.h"
+
+// =====================================================================================
+//  BrushGridCellRange
+//      cells touched by bounds, padded by ON_EPSILON like BoundingBox::testDisjoint
+// =====================================================================================
+static void BrushGridCellRange(const BrushGrid &grid, const BoundingBox &bounds, int (&lo)[3], int (&hi)[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        lo[i] = (int)floor((bounds.m_Mins[i] - ON_EPSILON - grid.mins[i]) / grid.cellsize);
+        hi[i] = (int)floor((bounds.m_Maxs[i] + ON_EPSILON - grid.mins[i]) / grid.cellsize);
+        lo[i] = qmax(0, qmin(lo[i], grid.size[i] - 1));
+        hi[i] = qmax(0, qmin(hi[i], grid.size[i] - 1));
+    }
+}
+
+static auto BrushGridCellCount(const int (&lo)[3], const int (&hi)[3]) -> int
+{
+    return (hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+}
+
+// =====================================================================================
+//  BuildBrushGrid
+// =====================================================================================
+void BuildBrushGrid(BrushGrid &grid, const Brush *brushes, int firstbrush, int numbrushes, int hull)
+{
+    grid.size[0] = grid.size[1] = grid.size[2] = 0;
+    grid.cellstart = nullptr;
+    grid.cellbrushes = nullptr;
+    grid.numlarge = 0;
+    grid.largebrushes = new int[numbrushes];
+
+    BoundingBox extent;
+    int count = 0;
+    for (int i = firstbrush; i < firstbrush + numbrushes; i++)
+    {
+        if (brushes[i].hulls[hull].faces)
+        {
+            extent.add(brushes[i].hulls[hull].bounds);
+            count++;
+        }
+    }
+
+    if (count >= BRUSHGRID_MIN_BRUSHES)
+    {
+        // about one cell per brush
+        vec3_t size;
+        VectorSubtract(extent.m_Maxs, extent.m_Mins, size);
+        for (int i = 0; i < 3; i++)
+        {
+            size[i] = qmax(size[i], (vec_t)1.0);
+        }
+        grid.cellsize = cbrt(size[0] * size[1] * size[2] / count);
+        VectorCopy(extent.m_Mins, grid.mins);
+        for (int i = 0; i < 3; i++)
+        {
+            grid.size[i] = qmax(1, qmin((int)ceil(size[i] / grid.cellsize), BRUSHGRID_MAX_AXIS_CELLS));
+        }
+        grid.cellsize = qmax(grid.cellsize, qmax(size[0] / grid.size[0], qmax(size[1] / grid.size[1], size[2] / grid.size[2])));
+
+        int numcells = grid.size[0] * grid.size[1] * grid.size[2];
+        grid.cellstart = new int[numcells + 1]();
+        int lo[3], hi[3];
+        for (int pass = 0; pass < 2; pass++) // count, then fill
+        {
+            for (int i = firstbrush; i < firstbrush + numbrushes; i++)
+            {
+                const BrushHull *bh = &brushes[i].hulls[hull];
+                if (!bh->faces)
+                {
+                    continue;
+                }
+                BrushGridCellRange(grid, bh->bounds, lo, hi);
+                if (BrushGridCellCount(lo, hi) > BRUSHGRID_MAX_BRUSH_CELLS)
+                {
+                    if (pass == 0)
+                    {
+                        grid.largebrushes[grid.numlarge++] = i;
+                    }
+                    continue;
+                }
+                for (int z = lo[2]; z <= hi[2]; z++)
+                {
+                    for (int y = lo[1]; y <= hi[1]; y++)
+                    {
+                        for (int x = lo[0]; x <= hi[0]; x++)
+                        {
+                            int cell = (z * grid.size[1] + y) * grid.size[0] + x;
+                            if (pass == 0)
+                            {
+                                grid.cellstart[cell + 1]++;
+                            }
+                            else
+                            {
+                                grid.cellbrushes[grid.cellstart[cell]++] = i;
+                            }
+                        }
+                    }
+                }
+            }
+            if (pass == 0)
+            {
+                for (int cell = 0; cell < numcells; cell++)
+                {
+                    grid.cellstart[cell + 1] += grid.cellstart[cell];
+                }
+                grid.cellbrushes = new int[grid.cellstart[numcells]];
+            }
+            else
+            {
+                // the fill pass advanced every start to the next cell's start
+                for (int cell = numcells; cell > 0; cell--)
+                {
+                    grid.cellstart[cell] = grid.cellstart[cell - 1];
+                }
+                grid.cellstart[0] = 0;
+            }
+        }
+    }
+    else
+    {
+        for (int i = firstbrush; i < firstbrush + numbrushes; i++)
+        {
+            if (brushes[i].hulls[hull].faces)
+            {
+                grid.largebrushes[grid.numlarge++] = i;
+            }
+        }
+    }
+}
+
+// =====================================================================================
+//  FreeBrushGrid
+// =====================================================================================
+void FreeBrushGrid(BrushGrid &grid)
+{
+    delete[] grid.cellstart;
+    delete[] grid.cellbrushes;
+    delete[] grid.largebrushes;
+    grid.cellstart = nullptr;
+    grid.cellbrushes = nullptr;
+    grid.largebrushes = nullptr;
+    grid.numlarge = 0;
+}
+
+// =====================================================================================
+//  BrushGridCandidates
+//      every brush whose bounds may touch the given bounds, in ascending brush order
+// =====================================================================================
+void BrushGridCandidates(const BrushGrid &grid, const BoundingBox &bounds, std::vector<int> &candidates)
+{
+    candidates.assign(grid.largebrushes, grid.largebrushes + grid.numlarge);
+    if (!grid.cellstart)
+    {
+        return;
+    }
+
+    int lo[3], hi[3];
+    BrushGridCellRange(grid, bounds, lo, hi);
+    for (int z = lo[2]; z <= hi[2]; z++)
+    {
+        for (int y = lo[1]; y <= hi[1]; y++)
+        {
+            for (int x = lo[0]; x <= hi[0]; x++)
+            {
+                int cell = (z * grid.size[1] + y) * grid.size[0] + x;
+                candidates.insert(candidates.end(), grid.cellbrushes + grid.cellstart[cell], grid.cellbrushes + grid.cellstart[cell + 1]);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+}
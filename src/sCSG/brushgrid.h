@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "hlcsg.h"
+
+constexpr int BRUSHGRID_MIN_BRUSHES = 16;     // smaller entities just list every brush
+constexpr int BRUSHGRID_MAX_BRUSH_CELLS = 64; // brushes covering more cells go to the large list
+constexpr int BRUSHGRID_MAX_AXIS_CELLS = 256;
+
+// Uniform grid over the brushes of one entity in one hull, used by CSGBrush
+// to find the brushes whose bounds may overlap a given brush.
+struct BrushGrid
+{
+    vec3_t mins;
+    vec_t cellsize;
+    int size[3]; // all 0 when the entity is too small for a grid
+    int *cellstart;   // size[0] * size[1] * size[2] + 1 offsets into cellbrushes
+    int *cellbrushes; // brush numbers, ascending within each cell
+    int numlarge;
+    int *largebrushes; // brush numbers, ascending
+};
+
+void BuildBrushGrid(BrushGrid &grid, const Brush *brushes, int firstbrush, int numbrushes, int hull);
+void FreeBrushGrid(BrushGrid &grid);
+void BrushGridCandidates(const BrushGrid &grid, const BoundingBox &bounds, std::vector<int> &candidates);
@@ -0,0 +1,444 @@
+#include <atomic>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "csgcache.h"
+#include "textures.h"
+#include "hullio.h"
+#include "log.h"
+
+static std::vector<byte> g_cachefile;                        // the previous compile's cache
+static std::unordered_map<uint64_t, size_t> g_cacheentries;  // key -> offset of its CsgCacheEntry
+static std::vector<std::vector<byte>> g_newentries;          // per csg work item, the entries to write
+static std::atomic<int> g_numreused;
+
+// =====================================================================================
+//  HashBytes
+//      FNV-1a
+// =====================================================================================
+static void HashBytes(uint64_t &hash, const void *const data, size_t size)
+{
+    const byte *p = (const byte *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+}
+
+template <typename T>
+static void HashValue(uint64_t &hash, const T &value)
+{
+    HashBytes(hash, &value, sizeof(value));
+}
+
+auto CombineCacheHash(uint64_t hash, uint64_t value) -> uint64_t
+{
+    HashValue(hash, value);
+    return hash;
+}
+
+// =====================================================================================
+//  BrushContentHash
+//      everything CSGBrush reads from a brush, by value: plane and texinfo numbers
+//      differ between compiles, so their planes and texinfos are hashed instead.
+//      The keys of the brush's entity are hashed too, so editing an entity csg's its
+//      brushes again.
+// =====================================================================================
+auto BrushContentHash(const Brush *const b) -> uint64_t
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const EntityProperty *ep = g_entities[b->entitynum].epairs; ep; ep = ep->next)
+    {
+        HashBytes(hash, ep->key, strlen(ep->key) + 1);
+        HashBytes(hash, ep->value, strlen(ep->value) + 1);
+    }
+    HashValue(hash, b->contents);
+    HashValue(hash, b->detaillevel);
+    HashValue(hash, b->chopdown);
+    HashValue(hash, b->chopup);
+    HashValue(hash, b->clipnodedetaillevel);
+    HashValue(hash, b->coplanarpriority);
+    HashValue(hash, (int)(b->entitynum != 0));
+    for (int hull = 0; hull < NUM_HULLS; hull++)
+    {
+        const BrushHull *bh = &b->hulls[hull];
+        for (const BrushFace *face = bh->faces; face; face = face->next)
+        {
+            const Plane *plane = &g_mapplanes[face->planenum];
+            HashValue(hash, plane->normal);
+            HashValue(hash, plane->dist);
+            HashValue(hash, face->texinfo != -1);
+            if (face->texinfo != -1)
+            {
+                const BSPLumpTexInfo *tex = &g_bsptexinfo[face->texinfo];
+                const char *texname = GetTextureByNumber_CSG(face->texinfo);
+                HashValue(hash, tex->vecs);
+                HashValue(hash, tex->flags);
+                HashBytes(hash, texname, strlen(texname) + 1);
+            }
+            HashValue(hash, face->contents);
+            HashValue(hash, face->backcontents);
+            HashValue(hash, face->w->m_NumPoints);
+            HashBytes(hash, face->w->m_Points, face->w->m_NumPoints * sizeof(vec3_t));
+        }
+        HashValue(hash, bh->faces != nullptr);
+        HashValue(hash, bh->bounds.m_Mins);
+        HashValue(hash, bh->bounds.m_Maxs);
+    }
+    return hash;
+}
+
+static void HullFaceList(const BrushHull *bh, std::vector<const BrushFace *> &faces)
+{
+    faces.clear();
+    for (const BrushFace *face = bh->faces; face; face = face->next)
+    {
+        faces.push_back(face);
+    }
+}
+
+// =====================================================================================
+//  HullFaceCode
+//      2 * position of the hull face on the plane (or its opposite) + 1 if opposite
+// =====================================================================================
+static auto HullFaceCode(const std::vector<const BrushFace *> &faces, int planenum) -> int
+{
+    for (size_t i = 0; i < faces.size(); i++)
+    {
+        if (faces[i]->planenum == planenum)
+        {
+            return 2 * i;
+        }
+        if (faces[i]->planenum == (planenum ^ 1))
+        {
+            return 2 * i + 1;
+        }
+    }
+    return -1;
+}
+
+static void AppendBytes(std::vector<byte> &out, const void *const data, size_t size)
+{
+    out.insert(out.end(), (const byte *)data, (const byte *)data + size);
+}
+
+// =====================================================================================
+//  EncodeBrushOutput
+//      false if some record doesn't come from the brush's own faces
+// =====================================================================================
+static auto EncodeBrushOutput(uint64_t key, const Brush *const b, const BrushOutput &out, std::vector<byte> &entry) -> bool
+{
+    CsgCacheEntry header;
+    header.key = key;
+    entry.assign(sizeof(header), 0);
+
+    std::vector<const BrushFace *> faces;
+    for (int hull = 0; hull < NUM_HULLS; hull++)
+    {
+        HullFaceList(&b->hulls[hull], faces);
+
+        size_t start = entry.size();
+        const std::vector<byte> &facedata = out.faces[hull];
+        for (size_t pos = 0; pos < facedata.size();)
+        {
+            HullFaceRecord record;
+            memcpy(&record, facedata.data() + pos, sizeof(record));
+            int code = HullFaceCode(faces, record.planenum);
+            if (code < 0 || (record.texinfo != -1 && record.texinfo != faces[code >> 1]->texinfo))
+            {
+                return false;
+            }
+            record.planenum = code;
+            record.texinfo = record.texinfo == -1 ? -1 : 0;
+            AppendBytes(entry, &record, sizeof(record));
+            AppendBytes(entry, facedata.data() + pos + sizeof(record), record.numpoints * sizeof(vec3_t));
+            pos += sizeof(record) + record.numpoints * sizeof(vec3_t);
+        }
+        header.facesize[hull] = entry.size() - start;
+
+        start = entry.size();
+        const std::vector<byte> &detaildata = out.detailbrushes[hull];
+        for (size_t pos = 0; pos < detaildata.size();)
+        {
+            AppendBytes(entry, detaildata.data() + pos, sizeof(int32_t));
+            pos += sizeof(int32_t);
+            while (true)
+            {
+                HullSideRecord side;
+                memcpy(&side, detaildata.data() + pos, sizeof(side));
+                pos += sizeof(side);
+                if (side.planenum == -1)
+                {
+                    AppendBytes(entry, &side, sizeof(side));
+                    break;
+                }
+                side.planenum = HullFaceCode(faces, side.planenum);
+                if (side.planenum < 0)
+                {
+                    return false;
+                }
+                AppendBytes(entry, &side, sizeof(side));
+                AppendBytes(entry, detaildata.data() + pos, side.numpoints * sizeof(vec3_t));
+                pos += side.numpoints * sizeof(vec3_t);
+            }
+        }
+        header.detailsize[hull] = entry.size() - start;
+    }
+
+    size_t start = entry.size();
+    for (const auto &warning : out.warnings)
+    {
+        CsgCacheWarning record;
+        record.warning = warning.first;
+        record.namelength = warning.second.size();
+        AppendBytes(entry, &record, sizeof(record));
+        AppendBytes(entry, warning.second.data(), warning.second.size());
+    }
+    header.warningsize = entry.size() - start;
+    memcpy(entry.data(), &header, sizeof(header));
+    return true;
+}
+
+// =====================================================================================
+//  DecodeBrushOutput
+//      false if the entry doesn't fit the brush, which only a damaged cache can cause
+// =====================================================================================
+static auto DecodeBrushOutput(const byte *const entry, const Brush *const b, BrushOutput &out) -> bool
+{
+    CsgCacheEntry header;
+    memcpy(&header, entry, sizeof(header));
+    const byte *data = entry + sizeof(header);
+
+    std::vector<const BrushFace *> faces;
+    for (int hull = 0; hull < NUM_HULLS; hull++)
+    {
+        HullFaceList(&b->hulls[hull], faces);
+
+        for (size_t pos = 0; pos < header.facesize[hull];)
+        {
+            HullFaceRecord record;
+            if (pos + sizeof(record) > header.facesize[hull])
+            {
+                return false;
+            }
+            memcpy(&record, data + pos, sizeof(record));
+            size_t pointsize = record.numpoints * sizeof(vec3_t);
+            if (record.numpoints < 0 || record.planenum < 0 || (size_t)(record.planenum >> 1) >= faces.size() || pos + sizeof(record) + pointsize > header.facesize[hull])
+            {
+                return false;
+            }
+            const BrushFace *face = faces[record.planenum >> 1];
+            record.texinfo = record.texinfo == -1 ? -1 : face->texinfo;
+            record.planenum = face->planenum ^ (record.planenum & 1);
+            AppendBytes(out.faces[hull], &record, sizeof(record));
+            AppendBytes(out.faces[hull], data + pos + sizeof(record), pointsize);
+            pos += sizeof(record) + pointsize;
+        }
+        data += header.facesize[hull];
+
+        for (size_t pos = 0; pos < header.detailsize[hull];)
+        {
+            if (pos + sizeof(int32_t) > header.detailsize[hull])
+            {
+                return false;
+            }
+            AppendBytes(out.detailbrushes[hull], data + pos, sizeof(int32_t));
+            pos += sizeof(int32_t);
+            while (true)
+            {
+                HullSideRecord side;
+                if (pos + sizeof(side) > header.detailsize[hull])
+                {
+                    return false;
+                }
+                memcpy(&side, data + pos, sizeof(side));
+                pos += sizeof(side);
+                if (side.planenum == -1)
+                {
+                    AppendBytes(out.detailbrushes[hull], &side, sizeof(side));
+                    break;
+                }
+                size_t pointsize = side.numpoints * sizeof(vec3_t);
+                if (side.numpoints < 0 || side.planenum < 0 || (size_t)(side.planenum >> 1) >= faces.size() || pos + pointsize > header.detailsize[hull])
+                {
+                    return false;
+                }
+                side.planenum = faces[side.planenum >> 1]->planenum ^ (side.planenum & 1);
+                AppendBytes(out.detailbrushes[hull], &side, sizeof(side));
+                AppendBytes(out.detailbrushes[hull], data + pos, pointsize);
+                pos += pointsize;
+            }
+        }
+        data += header.detailsize[hull];
+    }
+
+    for (size_t pos = 0; pos < header.warningsize;)
+    {
+        CsgCacheWarning record;
+        if (pos + sizeof(record) > header.warningsize)
+        {
+            return false;
+        }
+        memcpy(&record, data + pos, sizeof(record));
+        pos += sizeof(record);
+        if (record.warning < 0 || record.warning >= BRUSHWARNING_COUNT || record.namelength < 0 || pos + record.namelength > header.warningsize)
+        {
+            return false;
+        }
+        out.warnings.emplace_back(record.warning, std::string((const char *)data + pos, record.namelength));
+        pos += record.namelength;
+    }
+    return true;
+}
+
+static auto CsgCacheEntrySize(const CsgCacheEntry &header) -> size_t
+{
+    size_t size = sizeof(header);
+    for (int hull = 0; hull < NUM_HULLS; hull++)
+    {
+        size += header.facesize[hull] + header.detailsize[hull];
+    }
+    return size + header.warningsize;
+}
+
+// =====================================================================================
+//  LoadCsgCache
+//      a missing or damaged cache just means every brush is csg'd again
+// =====================================================================================
+void LoadCsgCache(const char *const mapname, int count)
+{
+    g_cachefile.clear();
+    g_cacheentries.clear();
+    g_newentries.assign(count, std::vector<byte>());
+    g_numreused = 0;
+
+    char name[_MAX_PATH];
+    safe_snprintf(name, _MAX_PATH, "%s.csgcache", mapname);
+    FILE *f = fopen(name, "rb");
+    if (!f)
+    {
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > 0)
+    {
+        g_cachefile.resize(size);
+        if (fread(g_cachefile.data(), 1, size, f) != (size_t)size)
+        {
+            g_cachefile.clear();
+        }
+    }
+    fclose(f);
+
+    CsgCacheHeader header;
+    if (g_cachefile.size() < sizeof(header))
+    {
+        g_cachefile.clear();
+        return;
+    }
+    memcpy(&header, g_cachefile.data(), sizeof(header));
+    if (header.magic != CSGCACHE_MAGIC || header.version != CSGCACHE_VERSION || header.numentries < 0)
+    {
+        g_cachefile.clear();
+        return;
+    }
+    size_t pos = sizeof(header);
+    for (int i = 0; i < header.numentries; i++)
+    {
+        CsgCacheEntry entry;
+        if (pos + sizeof(entry) > g_cachefile.size())
+        {
+            break;
+        }
+        memcpy(&entry, g_cachefile.data() + pos, sizeof(entry));
+        size_t entrysize = CsgCacheEntrySize(entry);
+        if (pos + entrysize > g_cachefile.size())
+        {
+            break;
+        }
+        g_cacheentries.emplace(entry.key, pos);
+        pos += entrysize;
+    }
+}
+
+// =====================================================================================
+//  ReuseCachedBrush
+// =====================================================================================
+auto ReuseCachedBrush(int index, uint64_t key, const Brush *const b, BrushOutput &out) -> bool
+{
+    auto found = g_cacheentries.find(key);
+    if (found == g_cacheentries.end())
+    {
+        return false;
+    }
+    const byte *entry = g_cachefile.data() + found->second;
+    if (!DecodeBrushOutput(entry, b, out))
+    {
+        out = BrushOutput();
+        return false;
+    }
+    CsgCacheEntry header;
+    memcpy(&header, entry, sizeof(header));
+    g_newentries[index].assign(entry, entry + CsgCacheEntrySize(header));
+    g_numreused++;
+    return true;
+}
+
+// =====================================================================================
+//  StoreCachedBrush
+// =====================================================================================
+void StoreCachedBrush(int index, uint64_t key, const Brush *const b, const BrushOutput &out)
+{
+    if (!EncodeBrushOutput(key, b, out, g_newentries[index]))
+    {
+        g_newentries[index].clear();
+    }
+}
+
+// =====================================================================================
+//  WriteCsgCache
+//      the cache is only an optimization, failing to write it is not an error;
+//      it is renamed into place so an interrupted compile never leaves half of it
+// =====================================================================================
+void WriteCsgCache(const char *const mapname)
+{
+    Log("%i of %i brushes reused from the csg cache\n", (int)g_numreused, (int)g_newentries.size());
+
+    char name[_MAX_PATH];
+    char tmpname[_MAX_PATH];
+    safe_snprintf(name, _MAX_PATH, "%s.csgcache", mapname);
+    safe_snprintf(tmpname, _MAX_PATH, "%s.%d", name, (int)getpid());
+    FILE *f = fopen(tmpname, "wb");
+    if (f)
+    {
+        CsgCacheHeader header;
+        header.magic = CSGCACHE_MAGIC;
+        header.version = CSGCACHE_VERSION;
+        header.numentries = 0;
+        for (const std::vector<byte> &entry : g_newentries)
+        {
+            header.numentries += !entry.empty();
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        for (const std::vector<byte> &entry : g_newentries)
+        {
+            ok = ok && fwrite(entry.data(), 1, entry.size(), f) == entry.size();
+        }
+        ok = !fclose(f) && ok;
+        if (!ok || rename(tmpname, name))
+        {
+            unlink(tmpname);
+        }
+    }
+
+    g_cachefile.clear();
+    g_cachefile.shrink_to_fit();
+    g_cacheentries.clear();
+    g_newentries.clear();
+    g_newentries.shrink_to_fit();
+}
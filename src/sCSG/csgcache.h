@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hlcsg.h"
+
+// Incremental CSG. The .p0-.p3 and .b0-.b3 records of every brush are kept in
+// <map>.csgcache under a key that covers the brush's own hulls and every brush
+// whose hull bounds touch them, and the next compile reuses them for each brush
+// whose key still matches instead of running CSGBrush again.
+//
+// Plane and texinfo numbers change whenever the map does, so the stored
+// records refer to the brush's own hull faces by position instead (every
+// output face lies on one of them and keeps its texinfo or none); they are
+// turned back into the current numbers when the brush is reused. The warnings
+// CSGBrush found are stored with them and printed again.
+
+constexpr uint32_t CSGCACHE_MAGIC = ('C' | ('S' << 8) | ('G' << 16) | ('C' << 24));
+constexpr uint32_t CSGCACHE_VERSION = 2;
+
+struct CsgCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t numentries;
+};
+
+struct CsgCacheEntry // followed by the face and detail brush records of every hull, then the warnings
+{
+    uint64_t key;
+    uint32_t facesize[NUM_HULLS];
+    uint32_t detailsize[NUM_HULLS];
+    uint32_t warningsize;
+};
+
+struct CsgCacheWarning // followed by the texture name, without its terminator
+{
+    int32_t warning;
+    int32_t namelength;
+};
+
+extern auto BrushContentHash(const Brush *const b) -> uint64_t;
+extern auto CombineCacheHash(uint64_t hash, uint64_t value) -> uint64_t;
+
+extern void LoadCsgCache(const char *const mapname, int count);
+extern auto ReuseCachedBrush(int index, uint64_t key, const Brush *const b, BrushOutput &out) -> bool;
+extern void StoreCachedBrush(int index, uint64_t key, const Brush *const b, const BrushOutput &out);
+extern void WriteCsgCache(const char *const mapname);
@@ -1,20 +1,52 @@
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <new>
+
+#include <sched.h>
 
 #include "hlcsg.h"
 #include "textures.h"
 #include "maplib.h"
 #include "arguments.h"
 #include "threads.h"
+#include "metrics.h"
+#include "threadtrace.h"
 #include "blockmem.h"
 #include "filelib.h"
+#include "hullio.h"
+#include "brushgrid.h"
+#include "csgcache.h"
 
 static FILE *g_outhullfiles[NUM_HULLS]; // pointer to each of the hull out files (.p0, .p1, ect.)
 static FILE *g_out_detailbrush[NUM_HULLS];
+static BrushGrid *g_brushgrids[MAX_MAP_ENTITIES]; // per entity, one grid per hull, while its brushes are csg'd
+
+static int *g_csgorder;            // brush number of each csg work item, models in entity order
+static bool *g_csgmodelend;        // work item is the last brush of its model
+static BrushOutput **g_csgoutput;  // finished work items waiting to be written
+static int g_csgcount;
+static std::atomic<int> g_csgflushed; // work items written so far
+static uint64_t *g_brushhash;      // BrushContentHash of every brush
+static uint64_t *g_csgkeys;        // csg cache key of each work item
+
+struct BrushHullUnit
+{
+    int brushnum;
+    int hullnum;
+    int cost;
+    std::vector<HullPlaneRequest> planes; // from ExpandBrush
+};
+static std::vector<BrushHullUnit> g_hullunits; // expanded hulls still to be made, in brush order
+static std::vector<int> g_hullorder;           // g_hullunits indices, most expensive first
+static std::vector<BrushSides> g_sideplanes;   // side planes of each brush, guessed by CreateBrushHull0
+static std::vector<bool> g_brushhull0;         // CreateBrushHull0 made hull 0 of the brush
 
 bool g_skyclip = DEFAULT_SKYCLIP;       // no sky clipping "-noskyclip"
 bool g_estimate = DEFAULT_ESTIMATE;     // progress estimates "-estimate"
 cliptype g_cliptype = DEFAULT_CLIPTYPE; // "-cliptype <value>"
 bool g_bClipNazi = DEFAULT_CLIPNAZI;    // "-noclipeconomy"
+bool g_csgcache = DEFAULT_CSGCACHE;     // "-cache"
 
 void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
 {
@@ -33,6 +65,14 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
         {
             g_bClipNazi = true;
         }
+        else if (!strcasecmp(argv[i], "-cache"))
+        {
+            g_csgcache = true;
+        }
+        else if (!strcasecmp(argv[i], "-nocache"))
+        {
+            g_csgcache = false;
+        }
 
         else if (!strcasecmp(argv[i], "-cliptype"))
         {
@@ -80,6 +120,17 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
                 Usage(ProgramType::PROGRAM_CSG);
             }
         }
+        else if (!strcasecmp(argv[i], "-wadcache"))
+        {
+            if (i + 1 < argc)
+            {
+                safe_strncpy(g_wadcache, argv[++i], _MAX_PATH);
+            }
+            else
+            {
+                Usage(ProgramType::PROGRAM_CSG);
+            }
+        }
         else if (!strcasecmp(argv[i], "-lightdata"))
         {
             if (i + 1 < argc)
@@ -95,6 +146,30 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
                 Usage(ProgramType::PROGRAM_CSG);
             }
         }
+        else if (!strcasecmp(argv[i], "-threads"))
+        {
+            if (i + 1 < argc)
+            {
+                g_numthreads = atoi(argv[++i]);
+                if (g_numthreads < 1)
+                {
+                    Log("Expected value of at least 1 for '-threads'\n");
+                    Usage(ProgramType::PROGRAM_CSG);
+                }
+            }
+            else
+            {
+                Usage(ProgramType::PROGRAM_CSG);
+            }
+        }
+        else if (!strcasecmp(argv[i], "-pin"))
+        {
+            g_threadpin = true;
+        }
+        else if (!strcasecmp(argv[i], "-trace"))
+        {
+            g_threadtrace = true;
+        }
         else if (!mapname_from_arg)
         {
             const char *temp = argv[i];
@@ -115,7 +190,7 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
 
 auto NewFaceFromFace(const BrushFace *const in) -> BrushFace * // Duplicates the non point information of a face, used by SplitFace
 {
-    auto *newFace = (BrushFace *)Alloc(sizeof(BrushFace));
+    auto *newFace = new (PoolAlloc(sizeof(BrushFace))) BrushFace{};
     newFace->contents = in->contents;
     newFace->texinfo = in->texinfo;
     newFace->planenum = in->planenum;
@@ -133,6 +208,13 @@ auto CopyFace(const BrushFace *const face) -> BrushFace *
     return newFace;
 }
 
+void FreeFace(BrushFace *face) // Frees a face from NewFaceFromFace or CopyFace
+{
+    delete face->w;
+    face->~BrushFace();
+    PoolFree(face, sizeof(BrushFace));
+}
+
 auto CopyFacesToOutside(BrushHull *bh) -> BrushFace *
 {
     BrushFace *outside = nullptr;
@@ -147,40 +229,43 @@ auto CopyFacesToOutside(BrushHull *bh) -> BrushFace *
     return outside;
 }
 
-void WriteFace(const int hull, const BrushFace *const face, int detaillevel, FILE **out)
+static void AppendOutput(std::vector<byte> &out, const void *data, size_t size)
 {
-    ThreadLock();
-    auto *w = face->w; // .p0 format
-
-    fprintf(out[hull], "%i %i %i %i %u\n", detaillevel, face->planenum, face->texinfo, face->contents, w->m_NumPoints); // plane summary
-
-    for (uint32_t i = 0; i < w->m_NumPoints; i++) // for each of the points on the face
-    {
-        fprintf(out[hull], "%5.8f %5.8f %5.8f\n", w->m_Points[i][0], w->m_Points[i][1], w->m_Points[i][2]); // write the co-ords
-    }
-    fprintf(out[hull], "\n");
+    out.insert(out.end(), (const byte *)data, (const byte *)data + size);
+}
 
-    ThreadUnlock();
+void WriteFace(const int hull, const BrushFace *const face, int detaillevel, BrushOutput &out)
+{
+    auto *w = face->w; // .p0 format, see hullio.h
+
+    HullFaceRecord record;
+    record.detaillevel = detaillevel;
+    record.planenum = face->planenum;
+    record.texinfo = face->texinfo;
+    record.contents = face->contents;
+    record.numpoints = w->m_NumPoints;
+    AppendOutput(out.faces[hull], &record, sizeof(record));
+    AppendOutput(out.faces[hull], w->m_Points, w->m_NumPoints * sizeof(vec3_t));
 }
 
-void WriteDetailBrush(int hull, const BrushFace *faces, FILE **out)
+void WriteDetailBrush(int hull, const BrushFace *faces, BrushOutput &out)
 {
-    ThreadLock();
-    fprintf(out[hull], "0\n");
+    int32_t brushinfo = 0;
+    AppendOutput(out.detailbrushes[hull], &brushinfo, sizeof(brushinfo));
     for (const BrushFace *face = faces; face; face = face->next)
     {
         auto *w = face->w;
-        fprintf(out[hull], "%i %u\n", face->planenum, w->m_NumPoints);
-        for (uint32_t i = 0; i < w->m_NumPoints; i++)
-        {
-            fprintf(out[hull], "%5.8f %5.8f %5.8f\n", w->m_Points[i][0], w->m_Points[i][1], w->m_Points[i][2]);
-        }
+        HullSideRecord side;
+        side.planenum = face->planenum;
+        side.numpoints = w->m_NumPoints;
+        AppendOutput(out.detailbrushes[hull], &side, sizeof(side));
+        AppendOutput(out.detailbrushes[hull], w->m_Points, w->m_NumPoints * sizeof(vec3_t));
     }
-    fprintf(out[hull], "-1 -1\n");
-    ThreadUnlock();
+    HullSideRecord end = {-1, -1};
+    AppendOutput(out.detailbrushes[hull], &end, sizeof(end));
 }
 
-void SaveOutside(const Brush *const brush, const int hull, BrushFace *outside, const int mirrorcontents) // The faces remaining on the outside list are final polygons.  Write them to the output file.
+void SaveOutside(const Brush *const brush, const int hull, BrushFace *outside, const int mirrorcontents, BrushOutput &out) // The faces remaining on the outside list are final polygons.  Write them to the output file.
 {                                                                                                        // Passable contents (water, lava, etc) will generate a mirrored copy of the face to be seen from the inside.
     BrushFace *face;
     BrushFace *face2;
@@ -273,9 +358,7 @@ void SaveOutside(const Brush *const brush, const int hull, BrushFace *outside, c
                 VectorNormalize(texnormal);
                 if (fabs(DotProduct(texnormal, face->plane->normal)) <= NORMAL_EPSILON)
                 {
-                    Warning("Entity %i, Brush %i: Malformed texture alignment (texture %s): Texture axis perpendicular to face.",
-                            brush->originalentitynum, brush->originalbrushnum,
-                            texname);
+                    out.warnings.emplace_back(BRUSHWARNING_TEXTURE_PERPENDICULAR, texname);
                 }
 
                 auto bad = false;
@@ -292,12 +375,12 @@ void SaveOutside(const Brush *const brush, const int hull, BrushFace *outside, c
                 }
                 if (bad)
                 {
-                    Warning("Entity %i, Brush %i: Malformed texture alignment (texture %s): Bad surface extents.", brush->originalentitynum, brush->originalbrushnum, texname);
+                    out.warnings.emplace_back(BRUSHWARNING_TEXTURE_EXTENTS, texname);
                 }
             }
         }
 
-        WriteFace(hull, face, (hull ? brush->clipnodedetaillevel : brush->detaillevel), g_outhullfiles);
+        WriteFace(hull, face, (hull ? brush->clipnodedetaillevel : brush->detaillevel), out);
 
         { // if (mirrorcontents != static_cast<int>(contents_t::CONTENTS_SOLID))
             face->planenum ^= 1;
@@ -311,21 +394,20 @@ void SaveOutside(const Brush *const brush, const int hull, BrushFace *outside, c
                 VectorCopy(face->w->m_Points[face->w->m_NumPoints - 1 - i], face->w->m_Points[i]);
                 VectorCopy(temp, face->w->m_Points[face->w->m_NumPoints - 1 - i]);
             }
-            WriteFace(hull, face, (hull ? brush->clipnodedetaillevel : brush->detaillevel), g_outhullfiles);
+            WriteFace(hull, face, (hull ? brush->clipnodedetaillevel : brush->detaillevel), out);
         }
-        delete face->w;
-        delete face;
+        FreeFace(face);
     }
 }
 
-void CSGBrush(int brushnum)
+void CSGBrush(int brushnum, BrushOutput &out)
 {
     BrushFace *face;
     BrushFace *face2; // f2
     BrushFace *nextFace;
 
-    auto *brush1 = &g_mapbrushes[brushnum];        // get brush info from the given brushnum that we can work with
-    auto *entity = &g_entities[brush1->entitynum]; // get entity info from the given brushnum that we can work with
+    auto *brush1 = &g_mapbrushes[brushnum]; // get brush info from the given brushnum that we can work with
+    std::vector<int> candidates;
 
     for (int hull = 0; hull < NUM_HULLS; hull++) // for each of the hulls
     {
@@ -346,7 +428,7 @@ void CSGBrush(int brushnum)
                       ContentsToString((contents_t)brush1->contents));
                 break;
             case contents_t::CONTENTS_SOLID:
-                WriteDetailBrush(hull, brushHull1->faces, g_out_detailbrush);
+                WriteDetailBrush(hull, brushHull1->faces, out);
                 break;
             }
         }
@@ -362,15 +444,16 @@ void CSGBrush(int brushnum)
             }
         }
 
-        for (int brushNumber = 0; brushNumber < entity->numbrushes; brushNumber++) // for each brush in entity e
+        BrushGridCandidates(g_brushgrids[brush1->entitynum][hull], brushHull1->bounds, candidates);
+        for (int brushNumber : candidates) // for each brush in entity e that may touch b1, in brush order
         {
-            if (entity->firstbrush + brushNumber == brushnum) // see if b2 needs to clip a chunk out of b1
+            if (brushNumber == brushnum) // see if b2 needs to clip a chunk out of b1
             {
                 continue;
             }
-            shouldOverwrite = entity->firstbrush + brushNumber > brushnum;
+            shouldOverwrite = brushNumber > brushnum;
 
-            auto *brush2 = &g_mapbrushes[entity->firstbrush + brushNumber];
+            auto *brush2 = &g_mapbrushes[brushNumber];
             auto *brushHull2 = &brush2->hulls[hull];
             if (brush2->contents == CONTENTS_TOEMPTY)
                 continue;
@@ -494,8 +577,7 @@ void CSGBrush(int brushnum)
                             }
                             else
                             {
-                                delete face->w;
-                                delete face;
+                                FreeFace(face);
                                 face = nullptr;
                                 break;
                             }
@@ -521,8 +603,7 @@ void CSGBrush(int brushnum)
                     }
                     if ((hull ? brush2->clipnodedetaillevel < brush1->clipnodedetaillevel : brush2->detaillevel < brush1->detaillevel) && brush2->contents == static_cast<int>(contents_t::CONTENTS_SOLID))
                     { // real solid
-                        delete face->w;
-                        delete face;
+                        FreeFace(face);
                         continue;
                     }
                     if (brush1->contents == CONTENTS_TOEMPTY)
@@ -541,8 +622,7 @@ void CSGBrush(int brushnum)
                             face->backcontents = brush2->contents;
                         if (face->contents == static_cast<int>(contents_t::CONTENTS_SOLID) && face->backcontents == static_cast<int>(contents_t::CONTENTS_SOLID) && strncasecmp(GetTextureByNumber_CSG(face->texinfo), "SOLIDHINT", 9) && strncasecmp(GetTextureByNumber_CSG(face->texinfo), "BEVELHINT", 9))
                         {
-                            delete face->w;
-                            delete face;
+                            FreeFace(face);
                         }
                         else
                         {
@@ -561,13 +641,12 @@ void CSGBrush(int brushnum)
                     }
                     else // inside a solid brush, throw it away
                     {
-                        delete face->w;
-                        delete face;
+                        FreeFace(face);
                     }
                 }
             }
         }
-        SaveOutside(brush1, hull, outsideFaceList, brush1->contents); // all of the faces left in outside are real surface faces
+        SaveOutside(brush1, hull, outsideFaceList, brush1->contents, out); // all of the faces left in outside are real surface faces
     }
 }
 
@@ -827,11 +906,133 @@ void SetModelCenters(Entity *entities, int numentities, Brush *brushes)
     }
 }
 
+// =====================================================================================
+//  FlushBrushOutput
+//      prints one brush's warnings, writes its records and, after the last brush of a model,
+//      the end of model markers
+// =====================================================================================
+static void FlushBrushOutput(int index)
+{
+    BrushOutput *out = g_csgoutput[index];
+    const Brush *brush = &g_mapbrushes[g_csgorder[index]];
+    for (const auto &warning : out->warnings)
+    {
+        Warning("Entity %i, Brush %i: Malformed texture alignment (texture %s): %s",
+                brush->originalentitynum, brush->originalbrushnum, warning.second.c_str(),
+                warning.first == BRUSHWARNING_TEXTURE_PERPENDICULAR ? "Texture axis perpendicular to face." : "Bad surface extents.");
+    }
+    for (int hull = 0; hull < NUM_HULLS; hull++)
+    {
+        SafeWrite(g_outhullfiles[hull], out->faces[hull].data(), out->faces[hull].size());
+        SafeWrite(g_out_detailbrush[hull], out->detailbrushes[hull].data(), out->detailbrushes[hull].size());
+        if (g_csgmodelend[index])
+        {
+            HullFaceRecord endface = {-1, -1, -1, -1, -1};
+            int32_t endbrushes = -1;
+            SafeWrite(g_outhullfiles[hull], &endface, sizeof(endface));
+            SafeWrite(g_out_detailbrush[hull], &endbrushes, sizeof(endbrushes));
+        }
+    }
+    delete out;
+    g_csgoutput[index] = nullptr;
+}
+
+// Finished brushes that may wait for an earlier one to be written, per thread
+constexpr int CSG_REORDER_WINDOW = 64;
+
+// =====================================================================================
+//  CSGModelBrush
+//      csg one brush, then flush every finished brush that is next in output order.
+//      The brushes are handed out in order; one that is too far ahead of the last written
+//      brush waits, so only a window of finished output is ever held in memory.
+// =====================================================================================
+static void CSGModelBrush(int index)
+{
+    while (index - g_csgflushed.load(std::memory_order_acquire) >= CSG_REORDER_WINDOW * g_numthreads)
+    {
+        sched_yield();
+    }
+
+    auto *out = new BrushOutput;
+    int brushnum = g_csgorder[index];
+    if (!g_csgcache)
+    {
+        CSGBrush(brushnum, *out);
+    }
+    else if (!ReuseCachedBrush(index, g_csgkeys[index], &g_mapbrushes[brushnum], *out))
+    {
+        CSGBrush(brushnum, *out);
+        StoreCachedBrush(index, g_csgkeys[index], &g_mapbrushes[brushnum], *out);
+    }
+
+    ThreadLock();
+    g_csgoutput[index] = out;
+    while (g_csgflushed < g_csgcount && g_csgoutput[g_csgflushed])
+    {
+        FlushBrushOutput(g_csgflushed);
+        g_csgflushed++;
+    }
+    ThreadUnlock();
+}
+
+// =====================================================================================
+//  HashBrushContent
+// =====================================================================================
+static void HashBrushContent(int brushnum)
+{
+    g_brushhash[brushnum] = BrushContentHash(&g_mapbrushes[brushnum]);
+}
+
+// =====================================================================================
+//  MakeCsgCacheKey
+//      the brush itself and, per hull, every brush of its entity that CSGBrush
+//      may clip it with, in order, and whether that brush comes after it
+// =====================================================================================
+static void MakeCsgCacheKey(int index)
+{
+    int brushnum = g_csgorder[index];
+    const Brush *b = &g_mapbrushes[brushnum];
+    uint64_t key = g_brushhash[brushnum];
+    std::vector<int> candidates;
+    for (int hull = 0; hull < NUM_HULLS; hull++)
+    {
+        key = CombineCacheHash(key, hull);
+        const BrushHull *bh = &b->hulls[hull];
+        if (!bh->faces)
+        {
+            continue;
+        }
+        BrushGridCandidates(g_brushgrids[b->entitynum][hull], bh->bounds, candidates);
+        for (int c : candidates)
+        {
+            const BrushHull *ch = &g_mapbrushes[c].hulls[hull];
+            if (c == brushnum || !ch->faces || bh->bounds.testDisjoint(ch->bounds))
+            {
+                continue;
+            }
+            key = CombineCacheHash(key, g_brushhash[c]);
+            key = CombineCacheHash(key, c > brushnum);
+        }
+    }
+    g_csgkeys[index] = key;
+}
+
 void ProcessModels(Entity *entities, Brush *brushes, int numentities)
 {
     int j;
     int contents;
 
+    int totalbrushes = 0;
+    for (int i = 0; i < numentities; i++)
+    {
+        totalbrushes += entities[i].numbrushes;
+    }
+    g_csgorder = new int[totalbrushes];
+    g_csgmodelend = new bool[totalbrushes];
+    g_csgoutput = new BrushOutput *[totalbrushes]();
+    g_csgcount = 0;
+    g_csgflushed = 0;
+
     for (int i = 0; i < numentities; i++)
     {
         if (!entities[i].numbrushes) // only models
@@ -876,24 +1077,172 @@ void ProcessModels(Entity *entities, Brush *brushes, int numentities)
         }
         delete[] temps;
 
-        if (i == 0) // csg them in order, first its worldspawn....
+        g_brushgrids[i] = new BrushGrid[NUM_HULLS];
+        for (j = 0; j < NUM_HULLS; j++)
         {
-            NamedRunThreadsOnIndividual(entities[i].numbrushes, g_estimate, CSGBrush);
-            CheckFatal();
+            BuildBrushGrid(g_brushgrids[i][j], brushes, first, entities[i].numbrushes, j);
         }
-        else
+
+        for (j = 0; j < entities[i].numbrushes; j++)
         {
-            for (j = 0; j < entities[i].numbrushes; j++)
+            g_csgorder[g_csgcount] = first + j;
+            g_csgmodelend[g_csgcount] = (j == entities[i].numbrushes - 1);
+            g_csgcount++;
+        }
+    }
+
+    if (g_csgcache)
+    {
+        g_brushhash = new uint64_t[g_nummapbrushes];
+        g_csgkeys = new uint64_t[g_csgcount];
+        NamedRunThreadsOnIndividual(g_nummapbrushes, g_estimate, HashBrushContent);
+        NamedRunThreadsOnIndividual(g_csgcount, g_estimate, MakeCsgCacheKey);
+        LoadCsgCache(g_Mapname, g_csgcount);
+    }
+
+    // csg the brushes of all models together, their output is written in model and brush order
+    NamedRunThreadsOnIndividualInOrder(g_csgcount, g_estimate, CSGModelBrush);
+    CheckFatal();
+    if (g_csgflushed != g_csgcount)
+    {
+        Error("ProcessModels: only %i of %i brushes were written\n", g_csgflushed.load(), g_csgcount);
+    }
+
+    if (g_csgcache)
+    {
+        WriteCsgCache(g_Mapname);
+        delete[] g_brushhash;
+        delete[] g_csgkeys;
+        g_brushhash = nullptr;
+        g_csgkeys = nullptr;
+    }
+
+    for (int i = 0; i < numentities; i++)
+    {
+        if (!g_brushgrids[i])
+            continue;
+        for (j = 0; j < NUM_HULLS; j++)
+        {
+            FreeBrushGrid(g_brushgrids[i][j]);
+        }
+        delete[] g_brushgrids[i];
+        g_brushgrids[i] = nullptr;
+    }
+    delete[] g_csgorder;
+    delete[] g_csgmodelend;
+    delete[] g_csgoutput;
+}
+
+// =====================================================================================
+//  CreateBrushHull0Unit
+// =====================================================================================
+static void CreateBrushHull0Unit(int brushnum)
+{
+    g_brushhull0[brushnum] = CreateBrushHull0(brushnum, g_sideplanes[brushnum]);
+}
+
+// =====================================================================================
+//  ExpandBrushHullUnit
+// =====================================================================================
+static void ExpandBrushHullUnit(int index)
+{
+    auto *unit = &g_hullunits[g_hullorder[index]];
+    ExpandBrush(&g_mapbrushes[unit->brushnum], unit->hullnum, unit->planes);
+}
+
+// =====================================================================================
+//  MakeHullFacesUnit
+// =====================================================================================
+static void MakeHullFacesUnit(int index)
+{
+    auto *unit = &g_hullunits[g_hullorder[index]];
+    MakeHullFaces(&g_mapbrushes[unit->brushnum], &g_mapbrushes[unit->brushnum].hulls[unit->hullnum]);
+}
+
+// =====================================================================================
+//  CreateBrushes
+//      hull 0 of every brush first, the expanded hulls need it; each expanded hull is
+//      then its own work unit, the costliest (info_hullshape brushes) dispatched first
+//      so they don't end up alone at the end of the phase.
+//      Planes and texinfos are only looked up serially, in the order CreateBrush asks for
+//      them: the sides of a brush, then its expanded hulls. The first brush to ask for a
+//      plane sets its origin, which ExpandBrush reads, so hull 0 and the expansions are
+//      made ahead on the planes each brush would create; a brush whose sides find a
+//      different plane has hull 0 made again on the real ones, and its expansions too
+//      if they read an origin that moved. The output does not depend on the thread
+//      count or the scheduling.
+// =====================================================================================
+static void CreateBrushes()
+{
+    g_sideplanes.clear();
+    g_sideplanes.resize(g_nummapbrushes);
+    g_brushhull0.assign(g_nummapbrushes, false);
+    NamedRunThreadsOnIndividual(g_nummapbrushes, g_estimate, CreateBrushHull0Unit);
+    CheckFatal();
+
+    g_hullunits.clear();
+    for (int i = 0; i < g_nummapbrushes; i++)
+    {
+        for (int h = 1; h < NUM_HULLS; h++)
+        {
+            if (BrushHullExpands(&g_mapbrushes[i], h))
             {
-                CSGBrush(first + j);
+                g_hullunits.push_back({i, h, BrushHullCost(&g_mapbrushes[i], h), {}});
             }
         }
+    }
+    g_hullorder.resize(g_hullunits.size());
+    for (size_t i = 0; i < g_hullorder.size(); i++)
+    {
+        g_hullorder[i] = (int)i;
+    }
+    std::stable_sort(g_hullorder.begin(), g_hullorder.end(), [](int a, int b) {
+        return g_hullunits[a].cost > g_hullunits[b].cost;
+    });
+    NamedRunThreadsOnIndividual((int)g_hullorder.size(), g_estimate, ExpandBrushHullUnit);
+    CheckFatal();
 
-        for (j = 0; j < NUM_HULLS; j++)
-        { // write end of model marker
-            fprintf(g_outhullfiles[j], "-1 -1 -1 -1 -1\n");
-            fprintf(g_out_detailbrush[j], "-1\n");
+    size_t unit = 0;
+    for (int i = 0; i < g_nummapbrushes; i++)
+    {
+        auto *b = &g_mapbrushes[i];
+        size_t firstunit = unit;
+        for (; unit < g_hullunits.size() && g_hullunits[unit].brushnum == i; unit++)
+            ;
+        bool remade = g_brushhull0[i] && !NumberBrushSides(b, g_sideplanes[i]);
+        if (remade)
+        {
+            MakeHullFaces(b, &b->hulls[0]);
+        }
+        for (size_t u = firstunit; u < unit; u++)
+        {
+            if (remade || ExpandBrushStale(b, g_hullunits[u].hullnum, g_sideplanes[i]))
+            {
+                g_hullunits[u].planes.clear();
+                ExpandBrush(b, g_hullunits[u].hullnum, g_hullunits[u].planes);
+            }
         }
+        for (size_t u = firstunit; u < unit; u++)
+        {
+            AddHullPlanes(&b->hulls[g_hullunits[u].hullnum], g_hullunits[u].planes);
+        }
+    }
+    CheckFatal();
+    g_sideplanes.clear();
+    g_sideplanes.shrink_to_fit();
+    g_brushhull0.clear();
+    g_brushhull0.shrink_to_fit();
+
+    NamedRunThreadsOnIndividual((int)g_hullorder.size(), g_estimate, MakeHullFacesUnit);
+    CheckFatal();
+    g_hullunits.clear();
+    g_hullunits.shrink_to_fit();
+    g_hullorder.clear();
+    g_hullorder.shrink_to_fit();
+
+    for (int i = 0; i < g_nummapbrushes; i++)
+    {
+        FinishBrush(i);
     }
 }
 
@@ -904,14 +1253,16 @@ void OpenHullFiles(FILE **outhull, FILE **outdetail, const char *mapname)
         char name[_MAX_PATH];
 
         safe_snprintf(name, _MAX_PATH, "%s.p%i", mapname, i);
-        outhull[i] = fopen(name, "w");
+        outhull[i] = fopen(name, "wb");
         if (!outhull[i])
             Error("Couldn't open %s", name);
+        WriteHullFileHeader(outhull[i]);
 
         safe_snprintf(name, _MAX_PATH, "%s.b%i", mapname, i);
-        outdetail[i] = fopen(name, "w");
+        outdetail[i] = fopen(name, "wb");
         if (!outdetail[i])
             Error("Couldn't open %s", name);
+        WriteHullFileHeader(outdetail[i]);
     }
 }
 
@@ -998,6 +1349,9 @@ auto main(const int argc, char **argv) -> int
 
     ResetErrorLog();
     atexit(CloseLog);
+    MetricsStart();
+    atexit(MetricsWriteReport);
+    atexit(ThreadTraceWrite);
     LogArguments(argc, argv);
     hlassume(CalcFaceExtents_test(), assume_first);
     atexit(CSGCleanup); // AJM
@@ -1009,22 +1363,30 @@ auto main(const int argc, char **argv) -> int
     safe_strncpy(name, mapname_from_arg, _MAX_PATH); // make a copy of the nap name
     FlipSlashes(name);
     DefaultExtension(name, ".map"); // might be .reg
-    LoadMapFile(name);
     ThreadSetDefault();
     ThreadSetPriority(g_threadpriority);
+    LoadMapFile(name);
 
     GetUsedWads(); // Get wads from worldspawn "wad" key
 
     CheckForNoClip(g_entities, g_numentities); // Check brushes that should not generate clipnodes
 
-    NamedRunThreadsOnIndividual(g_nummapbrushes, g_estimate, CreateBrush); // createbrush
-    CheckFatal();
+    CreateBrushes();
     SetModelCenters(g_entities, g_numentities, g_mapbrushes); // Set model centers
 
     OpenHullFiles(g_outhullfiles, g_out_detailbrush, g_Mapname);
     WriteHullSizeFile(g_hull_size, g_Mapname);
 
     ProcessModels(g_entities, g_mapbrushes, g_numentities);
+    for (int i = 0; i < g_nummapbrushes; i++)
+    {
+        for (int h = 0; h < NUM_HULLS; h++)
+        {
+            FreeHullFaces(&g_mapbrushes[i].hulls[h]);
+        }
+    }
+    FreePools();
+    FreeSlabs();
 
     CloseHullFiles(g_outhullfiles, g_out_detailbrush);
 
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "mathlib.h"
 #include "map.h"
@@ -24,6 +27,7 @@ constexpr float FLOOR_Z = 0.7f;
 constexpr cliptype DEFAULT_CLIPTYPE = clip_simple;
 constexpr bool DEFAULT_CLIPNAZI = false;
 constexpr bool DEFAULT_ESTIMATE = true;
+constexpr bool DEFAULT_CSGCACHE = false;
 #define CSG_BOGUS_RANGE g_iWorldExtent // seedee
 
 //=============================================================================
@@ -42,19 +46,37 @@ constexpr int MAX_LIGHTTARGETS_NAME = 64;
 extern bool g_skyclip;
 extern bool g_estimate;
 extern bool g_bClipNazi;
+extern bool g_csgcache;
 
 extern Plane g_mapplanes[MAX_INTERNAL_MAP_PLANES];
 extern int g_nummapplanes;
 
 auto NewFaceFromFace(const BrushFace *const in) -> BrushFace *;
 auto CopyFace(const BrushFace *const face) -> BrushFace *;
+void FreeFace(BrushFace *face);
 auto CopyFacesToOutside(BrushHull *bh) -> BrushFace *;
 
-void WriteFace(const int hull, const BrushFace *const face, int detaillevel, FILE **out);
-void WriteDetailBrush(int hull, const BrushFace *faces, FILE **out);
+// One brush's records for the .p0-.p3 and .b0-.b3 files, written out in brush order
+struct BrushOutput
+{
+    std::vector<byte> faces[NUM_HULLS];
+    std::vector<byte> detailbrushes[NUM_HULLS];
+    std::vector<std::pair<int32_t, std::string>> warnings; // BrushWarning and texture name
+};
+
+// Printed when the brush is written out, so a brush reused from the csg cache warns again
+enum BrushWarning : int32_t
+{
+    BRUSHWARNING_TEXTURE_PERPENDICULAR, // texture axis perpendicular to face
+    BRUSHWARNING_TEXTURE_EXTENTS,       // bad surface extents
+    BRUSHWARNING_COUNT
+};
+
+void WriteFace(const int hull, const BrushFace *const face, int detaillevel, BrushOutput &out);
+void WriteDetailBrush(int hull, const BrushFace *faces, BrushOutput &out);
 
-void SaveOutside(const Brush *const brush, const int hull, BrushFace *outside, const int mirrorcontents);
-void CSGBrush(int brushnum);
+void SaveOutside(const Brush *const brush, const int hull, BrushFace *outside, const int mirrorcontents, BrushOutput &out);
+void CSGBrush(int brushnum, BrushOutput &out);
 extern auto ContentsToString(const contents_t type) -> const char *;
 
 void SetModelNumbers(Entity *entities, int numentities);
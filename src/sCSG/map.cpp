@@ -5,6 +5,7 @@
 #include "hlcsg.h"
 #include "blockmem.h"
 #include "log.h"
+#include "threads.h"
 
 int g_nummapbrushes;
 Brush g_mapbrushes[MAX_MAP_BRUSHES];
@@ -129,140 +130,141 @@ void TextureAxisFromPlane(const Plane *const pln, vec3_t xv, vec3_t yv)
 // =====================================================================================
 // These Face* functions are more like ProcessFace(), so i think they should called outside ParseFace
 
-void FaceCheckToolTextures(Brush *b, Side *s)
+void FaceCheckToolTextures(ParsedBrush *b, Side *s, char *texture)
 {
-	if (!strncasecmp(g_token, "NOCLIP", 6) || !strncasecmp(g_token, "NULLNOCLIP", 10))
+	if (!strncasecmp(texture, "NOCLIP", 6) || !strncasecmp(texture, "NULLNOCLIP", 10))
 	{
-		strcpy(g_token, "NULL");
+		strcpy(texture, "NULL");
 		b->noclip = true;
 	}
-	if (!strncasecmp(g_token, "BEVELBRUSH", 10))
+	if (!strncasecmp(texture, "BEVELBRUSH", 10))
 	{
-		strcpy(g_token, "NULL");
+		strcpy(texture, "NULL");
 		b->bevel = true;
 	}
-	if (!strncasecmp(g_token, "BEVEL", 5))
+	if (!strncasecmp(texture, "BEVEL", 5))
 	{
-		strcpy(g_token, "NULL");
+		strcpy(texture, "NULL");
 		s->bevel = true;
 	}
-	if (!strncasecmp(g_token, "BEVELHINT", 9))
+	if (!strncasecmp(texture, "BEVELHINT", 9))
 	{
 		s->bevel = true;
 	}
-	if (!strncasecmp(g_token, "CLIP", 4))
+	if (!strncasecmp(texture, "CLIP", 4))
 	{
 		b->cliphull |= (1 << NUM_HULLS); // arbitrary nonexistent hull
 		int h;
-		if (!strncasecmp(g_token, "CLIPHULL", 8) && (h = g_token[8] - '0', 0 < h && h < NUM_HULLS))
+		if (!strncasecmp(texture, "CLIPHULL", 8) && (h = texture[8] - '0', 0 < h && h < NUM_HULLS))
 		{
 			b->cliphull |= (1 << h); // hull h
 		}
-		if (!strncasecmp(g_token, "CLIPBEVEL", 9))
+		if (!strncasecmp(texture, "CLIPBEVEL", 9))
 		{
 			s->bevel = true;
 		}
-		if (!strncasecmp(g_token, "CLIPBEVELBRUSH", 14))
+		if (!strncasecmp(texture, "CLIPBEVELBRUSH", 14))
 		{
 			b->bevel = true;
 		}
-		strcpy(g_token, "SKIP");
+		strcpy(texture, "SKIP");
 	}
 }
 // End of Face* functions, now is time to parse face
 // =====================================================================================
 
-void ParseFace(Brush *b, Side *s)
+// =====================================================================================
+//  ReadNumber
+//      the token is copied out first, it is not terminated inside the map file
+// =====================================================================================
+static auto ReadNumber(ScriptReader &reader) -> vec_t
+{
+	char number[MAXTOKEN];
+	ReadToken(reader, false);
+	CopyToken(reader, number);
+	return atof(number);
+}
+
+static void ExpectToken(ScriptReader &reader, const char *const text, const char *const error)
 {
+	ReadToken(reader, false);
+	if (!TokenIs(reader, text))
+	{
+		Error("%s", error);
+	}
+}
+
+void ParseFace(ScriptReader &reader, int entitynum, int brushnum, int sidenum, ParsedBrush *b, Side *s)
+{
+	char token[MAXTOKEN];
+
 	// read the three point plane definition
 	for (int i = 0; i < 3; i++) // Read 3 point plane definition for brush side
 	{
 		if (i != 0) // If not the first point get next token
 		{
-			GetToken(true);
+			ReadToken(reader, true);
 		}
-		if (strcmp(g_token, "(")) // Token must be '('
+		if (!TokenIs(reader, "(")) // Token must be '('
 		{
+			CopyToken(reader, token);
 			Error("Parsing Entity %i, Brush %i, Side %i : Expecting '(' got '%s'",
-				  b->originalentitynum, b->originalbrushnum,
-				  b->numsides, g_token);
+				  entitynum, brushnum, sidenum, token);
 		}
 		for (int j = 0; j < 3; j++) // Get three coords for the point
 		{
-			GetToken(false);				   // Get next token on same line
-			s->planepts[i][j] = atof(g_token); // Convert token to float and store in planepts
+			s->planepts[i][j] = ReadNumber(reader); // Next token on the same line
 		}
-		GetToken(false);
+		ReadToken(reader, false);
 
-		if (strcmp(g_token, ")"))
+		if (!TokenIs(reader, ")"))
 		{
+			CopyToken(reader, token);
 			Error("Parsing	Entity %i, Brush %i, Side %i : Expecting ')' got '%s'",
-				  b->originalentitynum, b->originalbrushnum,
-				  b->numsides, g_token);
+				  entitynum, brushnum, sidenum, token);
 		}
 	}
 
 	// read the texturedef
-	GetToken(false);
-	strupr(g_token);
+	ReadToken(reader, false);
+	CopyToken(reader, token);
+	strupr(token);
 
-	FaceCheckToolTextures(b, s); // Check for tool textures
+	FaceCheckToolTextures(b, s, token); // Check for tool textures
 
-	safe_strncpy(s->texture.name, g_token, sizeof(s->texture.name));
+	safe_strncpy(s->texture.name, token, sizeof(s->texture.name));
 
 	// texture U axis
-	GetToken(false);
-	if (strcmp(g_token, "["))
+	ReadToken(reader, false);
+	if (!TokenIs(reader, "["))
 	{
 		hlassume(false, assume_MISSING_BRACKET_IN_TEXTUREDEF);
 	}
 
-	GetToken(false);
-	s->texture.UAxis[0] = atof(g_token);
-	GetToken(false);
-	s->texture.UAxis[1] = atof(g_token);
-	GetToken(false);
-	s->texture.UAxis[2] = atof(g_token);
-	GetToken(false);
-	s->texture.shift[0] = atof(g_token);
+	s->texture.UAxis[0] = ReadNumber(reader);
+	s->texture.UAxis[1] = ReadNumber(reader);
+	s->texture.UAxis[2] = ReadNumber(reader);
+	s->texture.shift[0] = ReadNumber(reader);
 
-	GetToken(false);
-	if (strcmp(g_token, "]"))
-	{
-		Error("missing ']' in texturedef (U)");
-	}
+	ExpectToken(reader, "]", "missing ']' in texturedef (U)");
 
 	// texture V axis
-	GetToken(false);
-	if (strcmp(g_token, "["))
-	{
-		Error("missing '[' in texturedef (V)");
-	}
+	ExpectToken(reader, "[", "missing '[' in texturedef (V)");
 
-	GetToken(false);
-	s->texture.VAxis[0] = atof(g_token);
-	GetToken(false);
-	s->texture.VAxis[1] = atof(g_token);
-	GetToken(false);
-	s->texture.VAxis[2] = atof(g_token);
-	GetToken(false);
-	s->texture.shift[1] = atof(g_token);
+	s->texture.VAxis[0] = ReadNumber(reader);
+	s->texture.VAxis[1] = ReadNumber(reader);
+	s->texture.VAxis[2] = ReadNumber(reader);
+	s->texture.shift[1] = ReadNumber(reader);
 
-	GetToken(false);
-	if (strcmp(g_token, "]"))
-	{
-		Error("missing ']' in texturedef (V)");
-	}
+	ExpectToken(reader, "]", "missing ']' in texturedef (V)");
 
 	// Texture rotation is implicit in U/V axes.
-	GetToken(false);
+	ReadToken(reader, false);
 	s->texture.rotate = 0;
 
 	// texure scale
-	GetToken(false);
-	s->texture.scale[0] = atof(g_token);
-	GetToken(false);
-	s->texture.scale[1] = atof(g_token);
+	s->texture.scale[0] = ReadNumber(reader);
+	s->texture.scale[1] = ReadNumber(reader);
 }
 
 // =====================================================================================
@@ -444,7 +446,7 @@ void BrushCheckORIGINtexture(Entity *e, Brush *b)
 
 		for (int i = 0; i < NUM_HULLS; i++)
 		{
-			b->hulls[i].faces = nullptr;
+			FreeHullFaces(&b->hulls[i]);
 		}
 
 		if (b->entitynum != 0) // Ignore for WORLD (code elsewhere enforces no ORIGIN in world message)
@@ -483,7 +485,7 @@ void BrushCheckBOUNDINGBOXtexture(Entity *e, Brush *b)
 
 		for (int i = 0; i < NUM_HULLS; i++)
 		{
-			b->hulls[i].faces = nullptr;
+			FreeHullFaces(&b->hulls[i]);
 		}
 
 		if (b->entitynum != 0) // Ignore for WORLD (code elsewhere enforces no ORIGIN in world message)
@@ -552,14 +554,13 @@ void BrushCheckContentEmpty(Entity *e, Brush *b, Side *s)
 // =====================================================================================
 
 // =====================================================================================
-//  Parse a brush from script
+//  ParseBrush
+//      add a brush read by ParseMapBrush to the current entity
 // =====================================================================================
-void ParseBrush(Entity *mapent)
+void ParseBrush(Entity *mapent, const ParsedEntity &parsed, const ParsedBrush &pb)
 {
 	auto b = &g_mapbrushes[g_nummapbrushes]; // Current brush
-	int i, j;								 // Loop counters
-	Side *side;								 // Current side of the brush
-	bool ok;
+	Side *side = nullptr;					 // Current side of the brush
 	auto nullify = BrushCheckZHLT_Invisible(mapent); // If the current entity is part of an invis entity
 	hlassume(g_nummapbrushes < MAX_MAP_BRUSHES, assume_MAX_MAP_BRUSHES);
 
@@ -578,25 +579,25 @@ void ParseBrush(Entity *mapent)
 	BrushCheckZHLT_hull(mapent, b);
 
 	mapent->numbrushes++;
-	ok = GetToken(true);
 
-	while (ok) // Loop through brush sides
+	for (int i = 0; i < pb.numsides; i++) // Loop through brush sides
 	{
-		if (!strcmp(g_token, "}")) // If we have reached the end of the brush
-		{
-			break;
-		}
-
 		hlassume(g_numbrushsides < MAX_MAP_SIDES, assume_MAX_MAP_SIDES);
 		side = &g_brushsides[g_numbrushsides]; // Get next brush side from global array
 		g_numbrushsides++;					   // Global brush side counter
 		b->numsides++;						   // Number of sides for the current brush
-		side->bevel = false;
-
-		ParseFace(b, side); // ( x1 y1 z1 ) ( x2 y2 z2 ) ( x3 y3 z3 ) TEXTURENAME [ Ux Uy Uz Ushift ] [ Vx Vy Vz Vshift ] rotation Uscale Vscale
+		*side = parsed.sides[pb.firstside + i];
+	}
+	if (pb.noclip) // Tool textures
+	{
+		b->noclip = true;
+	}
+	if (pb.bevel)
+	{
+		b->bevel = true;
+	}
+	b->cliphull |= pb.cliphull;
 
-		ok = GetToken(true); // Done with line, this reads the first item from the next line
-	};
 	BushCheckClipTexture(b); // Check CLIP* texture
 
 	b->contents = CheckBrushContents(b);
@@ -624,29 +625,132 @@ void ParseBrush(Entity *mapent)
 }
 
 // =====================================================================================
-//  ParseMapEntity
-//      parse an entity from script
+//  Reading the map
+//      the entities are found serially, each one is then read into a ParsedEntity
+//      on its own thread, and ParseMapEntity adds them to g_entities in file order
+// =====================================================================================
+static ScriptFile s_mapfile;
+static std::vector<ParsedEntity> s_parsedentities;
+
 // =====================================================================================
-auto ParseMapEntity() -> bool
+//  SkipMapEntity
+//      find the closing brace of the entity whose opening brace was just read,
+//      reading the same tokens as ParseMapEntityText but ignoring what they say
+// =====================================================================================
+static void SkipMapEntity(ScriptReader &reader)
 {
-	int entity_index;
-	Entity *current_entity;
-	EntityProperty *e;
+	while (true)
+	{
+		if (!ReadToken(reader, true))
+		{
+			Error("ParseEntity: EOF without closing brace");
+		}
+		if (TokenIs(reader, "}"))
+		{
+			return;
+		}
+		if (!TokenIs(reader, "{")) // key, then the value on the same line
+		{
+			ReadToken(reader, false);
+			continue;
+		}
+		while (ReadToken(reader, true) && !TokenIs(reader, "}")) // brush faces, see ParseFace
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				if (i != 0)
+				{
+					ReadToken(reader, true);
+				}
+				for (int j = 0; j < 4; j++)
+				{
+					ReadToken(reader, false);
+				}
+			}
+			for (int j = 0; j < 16; j++)
+			{
+				ReadToken(reader, false);
+			}
+		}
+	}
+}
 
-	g_numparsedbrushes = 0;
-	if (!GetToken(true))
+// =====================================================================================
+//  ParseMapBrush
+// =====================================================================================
+static void ParseMapBrush(ScriptReader &reader, ParsedEntity &parsed, int entitynum, int brushnum)
+{
+	ParsedBrush pb;
+	pb.firstside = parsed.sides.size();
+	pb.numsides = 0;
+	pb.noclip = false;
+	pb.bevel = false;
+	pb.cliphull = 0;
+
+	auto ok = ReadToken(reader, true);
+	while (ok) // Loop through brush sides
 	{
-		return false;
+		if (TokenIs(reader, "}")) // If we have reached the end of the brush
+		{
+			break;
+		}
+		pb.numsides++;
+		parsed.sides.push_back(Side{});
+
+		ParseFace(reader, entitynum, brushnum, pb.numsides, &pb, &parsed.sides.back()); // ( x1 y1 z1 ) ( x2 y2 z2 ) ( x3 y3 z3 ) TEXTURENAME [ Ux Uy Uz Ushift ] [ Vx Vy Vz Vshift ] rotation Uscale Vscale
+
+		ok = ReadToken(reader, true); // Done with line, this reads the first item from the next line
 	}
+	parsed.brushes.push_back(pb);
+}
 
-	entity_index = g_numentities;
+// =====================================================================================
+//  ParseMapEntityText
+//      read one entity found by LoadMapFile, runs on its own thread
+// =====================================================================================
+static void ParseMapEntityText(int entitynum)
+{
+	auto &parsed = s_parsedentities[entitynum];
+	ScriptReader reader;
+	InitScriptReader(reader, parsed.text, parsed.length, parsed.line);
+	ReadToken(reader, true); // the opening brace
 
-	if (strcmp(g_token, "{"))
+	auto brushnum = 0;
+	while (true)
 	{
-		Error("Parsing Entity %i, expected '{' got '%s'",
-			  g_numparsedentities,
-			  g_token);
+		if (!ReadToken(reader, true))
+		{
+			Error("ParseEntity: EOF without closing brace");
+		}
+		if (TokenIs(reader, "}")) // end of our context
+		{
+			break;
+		}
+		parsed.items.emplace_back();
+		if (TokenIs(reader, "{")) // must be a brush
+		{
+			parsed.items.back().brush = parsed.brushes.size();
+			ParseMapBrush(reader, parsed, entitynum, brushnum++);
+		}
+		else // else assume an epair
+		{
+			ParseEpair(reader, parsed.items.back().key, parsed.items.back().value);
+			parsed.items.back().brush = -1;
+		}
 	}
+}
+
+// =====================================================================================
+//  ParseMapEntity
+//      add an entity read by ParseMapEntityText
+// =====================================================================================
+void ParseMapEntity(const ParsedEntity &parsed)
+{
+	int entity_index;
+	Entity *current_entity;
+
+	g_numparsedbrushes = 0;
+	entity_index = g_numentities;
 
 	hlassume(g_numentities < MAX_MAP_ENTITIES, assume_MAX_MAP_ENTITIES);
 	g_numentities++;
@@ -655,28 +759,18 @@ auto ParseMapEntity() -> bool
 	current_entity->firstbrush = g_nummapbrushes;
 	current_entity->numbrushes = 0;
 
-	while (true)
+	for (const auto &item : parsed.items)
 	{
-		if (!GetToken(true))
-			Error("ParseEntity: EOF without closing brace");
-
-		if (!strcmp(g_token, "}")) // end of our context
-			break;
-
-		if (!strcmp(g_token, "{")) // must be a brush
+		if (item.brush >= 0)
 		{
-			ParseBrush(current_entity);
+			ParseBrush(current_entity, parsed, parsed.brushes[item.brush]);
 			g_numparsedbrushes++;
 		}
-		else // else assume an epair
+		else
 		{
-			e = ParseEpair();
 			if (current_entity->numbrushes > 0)
 				Warning("Error: ParseEntity: Keyvalue comes after brushes."); //--vluzacn
-			SetKeyValue(current_entity, e->key, e->value);
-			delete e->key;
-			delete e->value;
-			delete e;
+			SetKeyValue(current_entity, item.key, item.value);
 		}
 	}
 
@@ -873,7 +967,7 @@ auto ParseMapEntity() -> bool
 		}
 		memset(current_entity, 0, sizeof(*current_entity));
 		delete temp;
-		return true;
+		return;
 	}
 
 	if (!strcmp(ValueForKey(current_entity, "classname"), "info_hullshape"))
@@ -883,7 +977,7 @@ auto ParseMapEntity() -> bool
 		int defaulthulls = IntForKey(current_entity, "defaulthulls");
 		CreateHullShape(entity_index, disabled, id, defaulthulls);
 		DeleteCurrentEntity(current_entity);
-		return true;
+		return;
 	}
 
 	if (fabs(current_entity->origin[0]) > ENGINE_ENTITY_RANGE + ON_EPSILON ||
@@ -899,7 +993,6 @@ auto ParseMapEntity() -> bool
 		}
 	}
 
-	return true;
 }
 
 // =====================================================================================
@@ -937,7 +1030,7 @@ auto CountEngineEntities() -> unsigned int
 
 // =====================================================================================
 //  LoadMapFile
-//      wrapper for LoadMapFileData
+//      map the file, find the entities, read them in parallel and add them in order
 //      parse in script entities
 // =====================================================================================
 auto ContentsToString(const contents_t type) -> const char *;
@@ -946,14 +1039,44 @@ void LoadMapFile(const char *const filename)
 {
 	unsigned num_engine_entities;
 
-	LoadMapFileData(filename);
+	ScriptReader reader;
+
+	OpenScriptFile(s_mapfile, filename);
+	Log("Loading %s\n", s_mapfile.name);
+	InitScriptReader(reader, s_mapfile.data, s_mapfile.size, 1);
 
-	g_numentities = 0;
+	s_parsedentities.clear();
+	while (ReadToken(reader, true))
+	{
+		if (!TokenIs(reader, "{"))
+		{
+			char token[MAXTOKEN];
+			CopyToken(reader, token);
+			Error("Parsing Entity %i, expected '{' got '%s'",
+				  (int)s_parsedentities.size(),
+				  token);
+		}
+		s_parsedentities.emplace_back();
+		auto &parsed = s_parsedentities.back();
+		parsed.text = reader.token - (reader.tokenquoted ? 1 : 0);
+		parsed.line = reader.line;
+		SkipMapEntity(reader);
+		parsed.length = reader.position - parsed.text;
+	}
+
+	NamedRunThreadsOnIndividual(s_parsedentities.size(), g_estimate, ParseMapEntityText);
+
+	FreeEntities();
 	g_numparsedentities = 0;
-	while (ParseMapEntity())
+	for (const auto &parsed : s_parsedentities)
 	{
+		ParseMapEntity(parsed);
 		g_numparsedentities++;
 	}
+	s_parsedentities.clear();
+	s_parsedentities.shrink_to_fit();
+	CloseScriptFile(s_mapfile);
+
 	num_engine_entities = CountEngineEntities();
 
 	hlassume(num_engine_entities < MAX_ENGINE_ENTITIES, assume_MAX_ENGINE_ENTITIES);
@@ -1,6 +1,10 @@
 #pragma once
+#include <string_view>
+#include <vector>
+
 #include "mathlib.h"
 #include "bspfile.h"
+#include "maplib.h"
 
 #include "winding.h"
 #include "boundingbox.h"
@@ -18,13 +22,41 @@ extern HullShape g_defaulthulls[NUM_HULLS];
 extern int g_numhullshapes;
 extern HullShape g_hullshapes[MAX_HULLSHAPES];
 
+// The brushes and key/value pairs of one entity as read from the .map, before
+// any of the entity's keys have been looked at
+struct ParsedBrush
+{
+    int firstside; // into ParsedEntity::sides
+    int numsides;
+    bool noclip; // set by tool textures, added to what the entity keys say
+    bool bevel;
+    unsigned int cliphull;
+};
+
+struct ParsedItem // a key/value pair in the map file, or a brush when brush >= 0
+{
+    std::string_view key;
+    std::string_view value;
+    int brush;
+};
+
+struct ParsedEntity
+{
+    const char *text; // from the opening to past the closing brace
+    size_t length;
+    int line;
+    std::vector<ParsedItem> items; // in file order
+    std::vector<ParsedBrush> brushes;
+    std::vector<Side> sides;
+};
+
 auto CopyCurrentBrush(Entity *entity, const Brush *brush) -> Brush *;
 void DeleteCurrentEntity(Entity *entity);
 
 void TextureAxisFromPlane(const Plane *const pln, vec3_t xv, vec3_t yv);
 
-void FaceCheckToolTextures(Brush *b, Side *s);
-void ParseFace(Brush *b, Side *s);
+void FaceCheckToolTextures(ParsedBrush *b, Side *s, char *texture);
+void ParseFace(ScriptReader &reader, int entitynum, int brushnum, int sidenum, ParsedBrush *b, Side *s);
 
 auto BrushCheckZHLT_Invisible(Entity *mapent) -> bool;
 void BrushNullify(Brush *b, Side *s, bool isInvisible);
@@ -39,9 +71,9 @@ void BrushCheckORIGINtexture(Entity *e, Brush *b);
 void BrushCheckBOUNDINGBOXtexture(Entity *e, Brush *b);
 void BrushCheckClipSkybox(Entity *e, Brush *b, Side *s);
 void BrushCheckContentEmpty(Entity *e, Brush *b, Side *s);
-void ParseBrush(Entity *mapent);
+void ParseBrush(Entity *mapent, const ParsedEntity &parsed, const ParsedBrush &pb);
 
-auto ParseMapEntity() -> bool;
+void ParseMapEntity(const ParsedEntity &parsed);
 auto CountEngineEntities() -> unsigned int;
 auto ContentsToString(const contents_t type) -> const char *;
 void LoadMapFile(const char *const filename);
\ No newline at end of file
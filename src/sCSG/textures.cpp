@@ -1,3 +1,4 @@
+#include <atomic>
 #include <vector>
 #include <map>
 #include <string>
@@ -9,75 +10,94 @@
 #include "log.h"
 #include "filelib.h"
 #include "mathlib.h"
+#include "stringtable.h"
+#include "wadfile.h"
 
 static int nummiptex = 0;
 static WadLumpInfo miptex[MAX_MAP_TEXTURES];
-static int nTexLumps = 0;
-static WadLumpInfo *lumpinfo = nullptr;
 static int nTexFiles = 0;
-static FILE *texfiles[MAX_TEXFILES];
+static WadFile texfiles[MAX_TEXFILES];
 static WadPath *texwadpathes[MAX_TEXFILES]; // maps index of the wad to its path
-static char *texmap[MAX_INTERNAL_MAP_TEXINFO];
-static int numtexmap = 0;
+static StringTable miptexnames(MAX_MAP_TEXTURES, assume_MAX_MAP_TEXTURES);      // name -> index into miptex[]
+static StringTable texmap(MAX_INTERNAL_MAP_TEXINFO, assume_MAX_MAP_TEXINFO, 65536); // texinfo .miptex before WriteMiptex
 
-static auto texmap_store(char *texname, bool shouldlock = true) -> int
-// This function should never be called unless a new entry in g_bsptexinfo is being allocated.
+static auto texmap_store(const char *const texname) -> int
 {
-    if (shouldlock)
-    {
-        ThreadLock();
-    }
-
-    hlassume(numtexmap < MAX_INTERNAL_MAP_TEXINFO, assume_MAX_MAP_TEXINFO); // This error should never appear.
-
-    auto i = numtexmap;
-    texmap[numtexmap] = strdup(texname);
-    numtexmap++;
-    if (shouldlock)
-    {
-        ThreadUnlock();
-    }
-    return i;
+    return texmap.Intern(texname);
 }
 
-static auto texmap_retrieve(int index) -> char *
+static auto texmap_retrieve(int index) -> const char *
 {
-    hlassume(0 <= index && index < numtexmap, assume_first);
-    return texmap[index];
+    return texmap.Get(index);
 }
 
 static void texmap_clear()
 {
-    ThreadLock();
-    for (int i = 0; i < numtexmap; i++)
-    {
-        delete texmap[i];
-    }
-    numtexmap = 0;
-    ThreadUnlock();
+    texmap.Clear();
 }
 
 // =====================================================================================
-//  CleanupName
+//  Texinfo hash
+//      texinfos are hashed on their texture name, flags and vecs; lookups are lock-free
+//      because an entry is fully written before its bucket head is published, inserts
+//      happen under ThreadLock
 // =====================================================================================
-void CleanupName(const char *const in, char *out)
-{
-    int i;
+constexpr int TEXINFO_HASH_SIZE = 65536;
+
+static std::atomic<int> texinfohash[TEXINFO_HASH_SIZE]; // first texinfo + 1 in each bucket, 0 = empty
+static int texinfohashnext[MAX_INTERNAL_MAP_TEXINFO];   // next texinfo + 1 in the same bucket
 
-    for (i = 0; i < MAXWADNAME; i++)
+static auto TexinfoHashBucket(const BSPLumpTexInfo &tx) -> int
+{
+    unsigned hash = 2166136261u; // FNV-1a
+    auto mix = [&hash](const void *data, size_t size)
     {
-        if (!in[i])
+        for (size_t i = 0; i < size; i++)
         {
-            break;
+            hash = (hash ^ ((const byte *)data)[i]) * 16777619u;
+        }
+    };
+    mix(&tx.miptex, sizeof(tx.miptex));
+    mix(&tx.flags, sizeof(tx.flags));
+    for (int j = 0; j < 2; j++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            float v = tx.vecs[j][k] == 0 ? 0 : tx.vecs[j][k]; // -0 compares equal to 0
+            mix(&v, sizeof(v));
         }
-
-        out[i] = toupper(in[i]);
     }
+    return hash & (TEXINFO_HASH_SIZE - 1);
+}
 
-    for (; i < MAXWADNAME; i++)
+static auto TexinfoHashFind(int bucket, const BSPLumpTexInfo &tx) -> int
+{
+    for (int i = texinfohash[bucket].load(std::memory_order_acquire) - 1; i >= 0; i = texinfohashnext[i] - 1)
     {
-        out[i] = 0;
+        const BSPLumpTexInfo *tc = &g_bsptexinfo[i];
+        // Sleazy hack 104, Pt 3 - texinfos with the same interned name share .miptex
+        if (tc->miptex != tx.miptex || tc->flags != tx.flags)
+        {
+            continue;
+        }
+        bool same = true;
+        for (int j = 0; j < 2 && same; j++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                if (tc->vecs[j][k] != tx.vecs[j][k])
+                {
+                    same = false;
+                    break;
+                }
+            }
+        }
+        if (same)
+        {
+            return i;
+        }
     }
+    return -1;
 }
 
 // =====================================================================================
@@ -98,14 +118,6 @@ auto lump_sorter_by_wad_and_name(const void *lump1, const void *lump2) -> int
     }
 }
 
-auto lump_sorter_by_name(const void *lump1, const void *lump2) -> int
-{
-    auto *plump1 = (WadLumpInfo *)lump1;
-    auto *plump2 = (WadLumpInfo *)lump2;
-
-    return strcmp(plump1->name, plump2->name);
-}
-
 // =====================================================================================
 //  FindMiptex
 //      Find and allocate a texture into the lump data
@@ -118,19 +130,21 @@ auto FindMiptex(const char *const name) -> int
         Error("Texture name is too long (%s)\n", name);
     }
 
-    ThreadLock();
-    for (i = 0; i < nummiptex; i++)
+    i = miptexnames.Find(name);
+    if (i != -1)
     {
-        if (!strcmp(name, miptex[i].name))
-        {
-            ThreadUnlock();
-            return i;
-        }
+        return i;
     }
 
-    hlassume(nummiptex < MAX_MAP_TEXTURES, assume_MAX_MAP_TEXTURES);
-    safe_strncpy(miptex[i].name, name, MAXWADNAME);
-    nummiptex++;
+    ThreadLock();
+    i = miptexnames.Find(name); // another thread may have added it meanwhile
+    if (i == -1)
+    {
+        hlassume(nummiptex < MAX_MAP_TEXTURES, assume_MAX_MAP_TEXTURES);
+        i = miptexnames.Add(name);
+        safe_strncpy(miptex[i].name, name, MAXWADNAME);
+        nummiptex++;
+    }
     ThreadUnlock();
     return i;
 }
@@ -141,7 +155,6 @@ auto FindMiptex(const char *const name) -> int
 auto TEX_InitFromWad() -> bool
 {
     int i;
-    WadInfo wadinfo;
     WadPath *currentwad;
 
     Log("\n"); // looks cleaner
@@ -157,13 +170,12 @@ auto TEX_InitFromWad() -> bool
     // for eachwadpath
     for (i = 0; i < g_iNumWadPaths; i++)
     {
-        FILE *texfile; // temporary used in this loop
         currentwad = g_pWadPaths[i];
         auto *pszWadFile = currentwad->path;
         texwadpathes[nTexFiles] = currentwad;
-        texfiles[nTexFiles] = fopen(pszWadFile, "rb");
+        bool opened = MapWadFile(texfiles[nTexFiles], pszWadFile);
 
-        if (!texfiles[nTexFiles] && pszWadroot)
+        if (!opened && pszWadroot)
         {
             char szTmp[_MAX_PATH];
             char szFile[_MAX_PATH];
@@ -176,71 +188,31 @@ auto TEX_InitFromWad() -> bool
 
             // szSubdir will have a trailing separator
             safe_snprintf(szTmp, _MAX_PATH, "%s" SYSTEM_SLASH_STR "%s%s", pszWadroot, szSubdir, szFile);
-            texfiles[nTexFiles] = fopen(szTmp, "rb");
+            opened = MapWadFile(texfiles[nTexFiles], szTmp);
 
-            if (!texfiles[nTexFiles])
+            if (!opened)
             {
                 // if we cant find it, Convert to lower case and try again
                 strlwr(szTmp);
-                texfiles[nTexFiles] = fopen(szTmp, "rb");
+                opened = MapWadFile(texfiles[nTexFiles], szTmp);
             }
         }
 
-        if (!texfiles[nTexFiles])
+        if (!opened)
         {
-            pszWadFile = currentwad->path; // correct it back
             // still cant find it, error out
             Fatal(assume_COULD_NOT_FIND_WAD, "Could not open wad file %s", pszWadFile);
             continue;
         }
 
-        pszWadFile = currentwad->path; // correct it back
-
-        // temp assignment to make things cleaner:
-        texfile = texfiles[nTexFiles];
-
-        // read in this wadfiles information
-        SafeRead(texfile, &wadinfo, sizeof(wadinfo));
-
-        // make sure its a valid format
-        if (strncmp(wadinfo.identification, "WAD3", 4))
-        {
-            Log(" - ");
-            Error("%s isn't a Wadfile!", pszWadFile);
-        }
-
-        wadinfo.numlumps = LittleLong(wadinfo.numlumps);
-        wadinfo.infotableofs = LittleLong(wadinfo.infotableofs);
-
-        // read in lump
-        if (fseek(texfile, wadinfo.infotableofs, SEEK_SET))
-            Warning("fseek to %d in wadfile %s failed\n", wadinfo.infotableofs, pszWadFile);
-
-        // memalloc for this lump
-        lumpinfo = (WadLumpInfo *)realloc(lumpinfo, (nTexLumps + wadinfo.numlumps) * sizeof(WadLumpInfo));
-
-        for (int j = 0; j < wadinfo.numlumps; j++, nTexLumps++)
-        {
-            SafeRead(texfile, &lumpinfo[nTexLumps], (sizeof(WadLumpInfo) - sizeof(int))); // iTexFile is NOT read from file
-            char szWadFileName[_MAX_PATH];
-            ExtractFile(pszWadFile, szWadFileName);
-            CleanupName(lumpinfo[nTexLumps].name, lumpinfo[nTexLumps].name);
-            lumpinfo[nTexLumps].filepos = LittleLong(lumpinfo[nTexLumps].filepos);
-            lumpinfo[nTexLumps].disksize = LittleLong(lumpinfo[nTexLumps].disksize);
-            lumpinfo[nTexLumps].iTexFile = nTexFiles;
-        }
-
         // AJM: this feature is dependant on autowad. :(
         // CONSIDER: making it standard?
-        currentwad->totaltextures = wadinfo.numlumps;
+        currentwad->totaltextures = texfiles[nTexFiles].numlumps;
 
         nTexFiles++;
         hlassume(nTexFiles < MAX_TEXFILES, assume_MAX_TEXFILES);
     }
 
-    // sort texlumps in memory by name
-    qsort((void *)lumpinfo, (size_t)nTexLumps, sizeof(lumpinfo[0]), lump_sorter_by_name);
-
     CheckFatal();
     return true;
 }
@@ -248,74 +220,45 @@ auto TEX_InitFromWad() -> bool
 // =====================================================================================
 //  FindTexture
 // =====================================================================================
-auto FindTexture(const WadLumpInfo *const source) -> WadLumpInfo *
+auto FindTexture(const WadLumpInfo *const source, WadLumpInfo &found) -> bool
 {
-    WadLumpInfo *found = nullptr;
-
-    found = (WadLumpInfo *)bsearch(source, (void *)lumpinfo, (size_t)nTexLumps, sizeof(lumpinfo[0]), lump_sorter_by_name);
-    if (!found)
+    // find the best matching lump
+    const WadLump *best = nullptr;
+    int bestfile = -1;
+    for (int i = 0; i < nTexFiles; i++)
     {
-        Warning("::FindTexture() texture %s not found!", source->name);
-        if (!strcmp(source->name, "NULL") || !strcmp(source->name, "SKIP"))
+        const WadLump *first;
+        if (!FindWadLumps(texfiles[i], source->name, first))
         {
-            Log("Are you sure you included sdhlt.wad in your wadpath list?\n");
+            continue;
+        }
+        // included wad is better, then upper in the wad list; within one wad the lump
+        // with the lowest filepos comes first when several share the name
+        if (best == nullptr || (texwadpathes[bestfile]->usedbymap && !texwadpathes[i]->usedbymap))
+        {
+            best = first;
+            bestfile = i;
         }
     }
 
-    if (found)
+    if (!best)
     {
-        // get the first and last matching lump
-        auto *first = found;
-        auto *last = found;
-        while (first - 1 >= lumpinfo && lump_sorter_by_name(first - 1, source) == 0)
-        {
-            first = first - 1;
-        }
-        while (last + 1 < lumpinfo + nTexLumps && lump_sorter_by_name(last + 1, source) == 0)
-        {
-            last = last + 1;
-        }
-        // find the best matching lump
-        WadLumpInfo *best = nullptr;
-        for (found = first; found < last + 1; found++)
+        Warning("::FindTexture() texture %s not found!", source->name);
+        if (!strcmp(source->name, "NULL") || !strcmp(source->name, "SKIP"))
         {
-            bool better = false;
-            if (best == nullptr)
-            {
-                better = true;
-            }
-            else if (found->iTexFile != best->iTexFile)
-            {
-                auto *found_wadpath = texwadpathes[found->iTexFile];
-                auto *best_wadpath = texwadpathes[best->iTexFile];
-                if (found_wadpath->usedbymap != best_wadpath->usedbymap)
-                {
-                    better = !found_wadpath->usedbymap; // included wad is better
-                }
-                else
-                {
-                    better = found->iTexFile < best->iTexFile; // upper in the wad list is better
-                }
-            }
-            else if (found->filepos != best->filepos)
-            {
-                better = found->filepos < best->filepos; // when there are several lumps with the same name in one wad file
-            }
-
-            if (better)
-            {
-                best = found;
-            }
+            Log("Are you sure you included sdhlt.wad in your wadpath list?\n");
         }
-        found = best;
+        return false;
     }
-    return found;
+    static_cast<WadLump &>(found) = *best;
+    found.iTexFile = bestfile;
+    return true;
 }
 
 // =====================================================================================
 //  LoadLump
 // =====================================================================================
-auto LoadLump(const WadLumpInfo *const source, byte *dest, int *texsize, int dest_maxsize, byte *&writewad_data, int &writewad_datasize) -> int
+auto LoadLump(const WadLumpInfo *const source, byte *dest, int *texsize, int dest_maxsize, const byte *&writewad_data, int &writewad_datasize) -> int
 {
     writewad_data = nullptr;
     writewad_datasize = -1;
@@ -323,9 +266,10 @@ auto LoadLump(const WadLumpInfo *const source, byte *dest, int *texsize, int des
     *texsize = 0;
     if (source->filepos)
     {
-        if (fseek(texfiles[source->iTexFile], source->filepos, SEEK_SET))
+        const byte *lumpdata = WadLumpData(texfiles[source->iTexFile], source);
+        if (!lumpdata)
         {
-            Warning("fseek to %d failed\n", source->filepos);
+            Warning("Texture %s lies outside of %s\n", source->name, texfiles[source->iTexFile].path);
             Error("File read failure");
         }
         *texsize = source->disksize;
@@ -336,15 +280,12 @@ auto LoadLump(const WadLumpInfo *const source, byte *dest, int *texsize, int des
             // We will load the entire texture from the WAD at engine runtime¿
             auto *miptex = (BSPLumpMiptex *)dest;
             hlassume((int)sizeof(BSPLumpMiptex) <= dest_maxsize, assume_MAX_MAP_MIPTEX);
-            SafeRead(texfiles[source->iTexFile], dest, sizeof(BSPLumpMiptex));
+            hlassume((int)sizeof(BSPLumpMiptex) <= source->disksize, assume_MAX_MAP_MIPTEX);
+            memcpy(dest, lumpdata, sizeof(BSPLumpMiptex));
 
             for (int i = 0; i < MIPLEVELS; i++)
                 miptex->offsets[i] = 0;
-            writewad_data = new byte[source->disksize];
-            hlassume(writewad_data != nullptr, assume_NoMemory);
-            if (fseek(texfiles[source->iTexFile], source->filepos, SEEK_SET))
-                Error("File read failure");
-            SafeRead(texfiles[source->iTexFile], writewad_data, source->disksize);
+            writewad_data = lumpdata; // straight from the mapped wad
             writewad_datasize = source->disksize;
             return sizeof(BSPLumpMiptex);
         }
@@ -352,7 +293,7 @@ auto LoadLump(const WadLumpInfo *const source, byte *dest, int *texsize, int des
         {
             // Load the entire texture here so the BSP contains the texture
             hlassume(source->disksize <= dest_maxsize, assume_MAX_MAP_MIPTEX);
-            SafeRead(texfiles[source->iTexFile], dest, source->disksize);
+            memcpy(dest, lumpdata, source->disksize);
             return source->disksize;
         }
     }
@@ -390,9 +331,10 @@ void AddAnimatingTextures()
             }
 
             // see if this name exists in the wadfile
-            for (int k = 0; k < nTexLumps; k++)
+            for (int k = 0; k < nTexFiles; k++)
             {
-                if (!strcmp(name, lumpinfo[k].name))
+                const WadLump *first;
+                if (FindWadLumps(texfiles[k], name, first))
                 {
                     FindMiptex(name); // add to the miptex list
                     break;
@@ -425,13 +367,12 @@ void WriteMiptex()
     {
         for (int i = 0; i < nummiptex; i++)
         {
-            WadLumpInfo *found;
+            WadLumpInfo found;
 
-            found = FindTexture(miptex + i);
-            if (found)
+            if (FindTexture(miptex + i, found))
             {
-                miptex[i] = *found;
-                texwadpathes[found->iTexFile]->usedtextures++;
+                miptex[i] = found;
+                texwadpathes[found.iTexFile]->usedtextures++;
             }
             else
             {
@@ -508,6 +449,11 @@ void WriteMiptex()
 
         // Sort them FIRST by wadfile and THEN by name for most efficient loading in the engine.
         qsort((void *)miptex, (size_t)nummiptex, sizeof(miptex[0]), lump_sorter_by_wad_and_name);
+        miptexnames.Clear();
+        for (int i = 0; i < nummiptex; i++)
+        {
+            miptexnames.Add(miptex[i].name);
+        }
 
         // Sleazy Hack 104 Pt 2 - After sorting the miptex array, reset the texinfos to point to the right miptexs
         for (int i = 0; i < g_bspnumtexinfo; i++, tx++)
@@ -517,6 +463,10 @@ void WriteMiptex()
             tx->miptex = FindMiptex(miptex_name);
         }
         texmap_clear();
+        for (int i = 0; i < TEXINFO_HASH_SIZE; i++) // .miptex is an index now, the hash keys are gone
+        {
+            texinfohash[i].store(0, std::memory_order_relaxed);
+        }
     }
     {
         // Now setup to get the miptex data (or just the headers if using -wadtextures) from the wadfile
@@ -556,7 +506,7 @@ void WriteMiptex()
         for (int i = 0; i < nummiptex; i++) // Process each miptex, writing its data to the temp wad file
         {
             l->dataofs[i] = data - (byte *)l;
-            byte *writewad_data;
+            const byte *writewad_data;
             int writewad_datasize;
             auto len = LoadLump(miptex + i, data, &texsize, &g_bsptexdata[g_max_map_miptex] - data, writewad_data, writewad_datasize); // Load lump data
 
@@ -574,7 +524,6 @@ void WriteMiptex()
                 memcpy(writewad_lumpinfo->name, miptex[i].name, MAXWADNAME);
                 writewad_header.numlumps++;
                 SafeWrite(writewad_file, writewad_data, writewad_datasize); // Write the processed lump info temp wad file
-                delete writewad_data;
             }
 
             if (!len)
@@ -598,6 +547,11 @@ void WriteMiptex()
         SafeWrite(writewad_file, &writewad_header, sizeof(WadInfo));
         if (fclose(writewad_file))
             Error("File write failure");
+        for (int i = 0; i < nTexFiles; i++)
+        {
+            UnmapWadFile(texfiles[i]);
+        }
+        nTexFiles = 0;
     }
     Log("Texture usage: %1.2f/%1.2f MB)\n", (float)totaltexsize / (1024 * 1024), (float)g_max_map_miptex / (1024 * 1024));
 }
@@ -672,39 +626,30 @@ auto TexinfoForBrushTexture(FaceTexture *bt, const vec3_t origin) -> int
     //
     // find the g_bsptexinfo
     //
+    tx.miptex = texmap_store(bt->name);
+    auto bucket = TexinfoHashBucket(tx);
+    i = TexinfoHashFind(bucket, tx);
+    if (i != -1)
+    {
+        return i;
+    }
+
     ThreadLock();
-    auto *tc = g_bsptexinfo;
-    for (i = 0; i < g_bspnumtexinfo; i++, tc++)
+    i = TexinfoHashFind(bucket, tx); // another thread may have added it meanwhile
+    if (i != -1)
     {
-        // Sleazy hack 104, Pt 3 - Use strcmp on names to avoid dups
-        if (strcmp(texmap_retrieve(tc->miptex), bt->name) != 0)
-        {
-            continue;
-        }
-        if (tc->flags != tx.flags)
-        {
-            continue;
-        }
-        for (int j = 0; j < 2; j++)
-        {
-            for (int k = 0; k < 4; k++)
-            {
-                if (tc->vecs[j][k] != tx.vecs[j][k])
-                {
-                    goto skip;
-                }
-            }
-        }
         ThreadUnlock();
         return i;
-    skip:;
     }
 
     hlassume(g_bspnumtexinfo < MAX_INTERNAL_MAP_TEXINFO, assume_MAX_MAP_TEXINFO);
 
+    i = g_bspnumtexinfo;
+    auto *tc = &g_bsptexinfo[i];
     *tc = tx;
-    tc->miptex = texmap_store(bt->name, false);
     g_bspnumtexinfo++;
+    texinfohashnext[i] = texinfohash[bucket].load(std::memory_order_relaxed);
+    texinfohash[bucket].store(i + 1, std::memory_order_release);
     ThreadUnlock();
     return i;
 }
@@ -2,6 +2,7 @@
 
 #include "mathtypes.h"
 #include "win32fix.h"
+#include "wadfile.h"
 
 constexpr int MAX_WADPATHS = 128; // arbitrary
 
@@ -34,25 +35,16 @@ struct WadInfo
     int infotableofs;
 };
 
-struct WadLumpInfo
+struct WadLumpInfo : WadLump
 {
-    int filepos;
-    int disksize;
-    int size; // uncompressed
-    char type;
-    char compression;
-    char pad1, pad2;
-    char name[MAXWADNAME]; // Texture name // must be null terminated // upper case
-
     int iTexFile; // index of the wad this texture is located in
 };
 
 void LogWadUsage(WadPath *currentwad, int nummiptex);
-void CleanupName(const char *const in, char *out);
 int FindMiptex(const char *const name);
 bool TEX_InitFromWad();
-WadLumpInfo *FindTexture(const WadLumpInfo *const source);
-int LoadLump(const WadLumpInfo *const source, byte *dest, int *texsize, int dest_maxsize, byte *&writewad_data, int &writewad_datasize);
+bool FindTexture(const WadLumpInfo *const source, WadLumpInfo &found);
+int LoadLump(const WadLumpInfo *const source, byte *dest, int *texsize, int dest_maxsize, const byte *&writewad_data, int &writewad_datasize);
 void AddAnimatingTextures();
 void WriteMiptex();
 void LogWadUsage(WadPath *currentwad);
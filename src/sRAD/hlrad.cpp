@@ -19,6 +19,10 @@
 #include "arguments.h"
 #include "blockmem.h"
 #include "threads.h"
+#include "metrics.h"
+#include "threadtrace.h"
+#include "stringtable.h"
+#include "wadfile.h"
 
 /*
  * NOTES
@@ -122,6 +126,11 @@ struct texlight_t
 
 static std::vector<texlight_t> s_texlights;
 typedef std::vector<texlight_t>::iterator texlight_i;
+static StringTable s_texlightnames(MAX_MAP_TEXTURES, assume_MAX_TEXLIGHTS);
+static std::vector<int> s_texlightindex; // first s_texlights entry for each name in s_texlightnames
+
+static StringTable s_surfacelightnames(MAX_MAP_ENTITIES, assume_MAX_MAP_ENTITIES);
+static std::vector<std::vector<int>> s_surfacelights; // light_surface entities for each _tex in s_surfacelightnames
 
 std::vector<MinLight> s_minlights;
 
@@ -130,16 +139,13 @@ std::vector<MinLight> s_minlights;
 // =====================================================================================
 static void LightForTexture(const char *const name, vec3_t result)
 {
-	texlight_i it;
-	for (it = s_texlights.begin(); it != s_texlights.end(); it++)
+	int index = s_texlightnames.Find(name);
+	if (index == -1)
 	{
-		if (!strcasecmp(name, it->name.c_str()))
-		{
-			VectorCopy(it->value, result);
-			return;
-		}
+		VectorClear(result);
+		return;
 	}
-	VectorClear(result);
+	VectorCopy(s_texlights[s_texlightindex[index]].value, result);
 }
 
 // =====================================================================================
@@ -1216,11 +1222,27 @@ static void LoadOpaqueEntities()
 // =====================================================================================
 //  MakePatches
 // =====================================================================================
+static void IndexTexlightEntities()
+{
+	for (int i = 0; i < g_numentities; i++)
+	{
+		Entity *ent = &g_entities[i];
+		if (strcmp(ValueForKey(ent, "classname"), "light_surface"))
+			continue;
+		int index = s_surfacelightnames.Intern(ValueForKey(ent, "_tex"));
+		if (index == (int)s_surfacelights.size())
+			s_surfacelights.emplace_back();
+		s_surfacelights[index].push_back(i);
+	}
+}
 static auto FindTexlightEntity(int facenum) -> Entity *
 {
 	BSPLumpFace *face = &g_bspfaces[facenum];
 	const dplane_t *dplane = getPlaneFromFace(face);
 	const char *texname = GetTextureByNumber(face->texinfo);
+	int index = s_surfacelightnames.Find(texname);
+	if (index == -1)
+		return nullptr;
 	Entity *faceent = g_face_entity[facenum];
 	vec3_t centroid;
 	auto *w = new Winding(*face);
@@ -1230,13 +1252,9 @@ static auto FindTexlightEntity(int facenum) -> Entity *
 
 	Entity *found = nullptr;
 	vec_t bestdist = -1;
-	for (int i = 0; i < g_numentities; i++)
+	for (int i : s_surfacelights[index])
 	{
 		Entity *ent = &g_entities[i];
-		if (strcmp(ValueForKey(ent, "classname"), "light_surface"))
-			continue;
-		if (strcasecmp(ValueForKey(ent, "_tex"), texname))
-			continue;
 		vec3_t delta;
 		GetVectorForKey(ent, "origin", delta);
 		VectorSubtract(delta, centroid, delta);
@@ -1281,6 +1299,7 @@ static void MakePatches()
 
 	Log("Create Patches : ");
 	g_patches = (Patch *)AllocBlock(MAX_PATCHES * sizeof(Patch));
+	IndexTexlightEntities();
 
 	for (int i = 0; i < g_bspnummodels; i++)
 	{
@@ -1442,7 +1461,7 @@ static void SortPatches()
 {
 	// SortPatches is the ideal place to do this, because the address of the patches are going to be invalidated.
 	Patch *old_patches = g_patches;
-	g_patches = (Patch *)AllocBlock((g_num_patches + 1) * sizeof(Patch)); // allocate one extra slot considering how terribly the code were written
+	g_patches = (Patch *)AllocBlockFirstTouch(g_num_patches + 1, sizeof(Patch)); // allocate one extra slot considering how terribly the code were written
 	memcpy(g_patches, old_patches, g_num_patches * sizeof(Patch));
 	FreeBlock(old_patches);
 	qsort((void *)g_patches, (size_t)g_num_patches, sizeof(Patch), patch_sorter);
@@ -2019,8 +2038,8 @@ static void RadWorld()
 		MakeScalesStub();
 
 		// these arrays are only used in CollectLight, GatherLight and BounceLight
-		emitlight = (vec3_t(*)[MAXLIGHTMAPS])AllocBlock((g_num_patches + 1) * sizeof(vec3_t[MAXLIGHTMAPS]));
-		addlight = (vec3_t(*)[MAXLIGHTMAPS])AllocBlock((g_num_patches + 1) * sizeof(vec3_t[MAXLIGHTMAPS]));
+		emitlight = (vec3_t(*)[MAXLIGHTMAPS])AllocBlockFirstTouch(g_num_patches + 1, sizeof(vec3_t[MAXLIGHTMAPS]));
+		addlight = (vec3_t(*)[MAXLIGHTMAPS])AllocBlockFirstTouch(g_num_patches + 1, sizeof(vec3_t[MAXLIGHTMAPS]));
 		newstyles = (unsigned char(*)[MAXLIGHTMAPS])AllocBlock((g_num_patches + 1) * sizeof(unsigned char[MAXLIGHTMAPS]));
 		// spread light around
 		BounceLight();
@@ -2135,6 +2154,9 @@ void ReadInfoTexAndMinlights()
 				texlight.value[2] = b;
 				texlight.filename = "info_texlights";
 				s_texlights.push_back(texlight);
+				int index = s_texlightnames.Intern(ep->key);
+				if (index == (int)s_texlightindex.size())
+					s_texlightindex.push_back(s_texlights.size() - 1);
 			}
 			foundTexlights = true;
 		}
@@ -2191,6 +2213,14 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
 				Usage(ProgramType::PROGRAM_RAD);
 			}
 		}
+		else if (!strcasecmp(argv[i], "-pin"))
+		{
+			g_threadpin = true;
+		}
+		else if (!strcasecmp(argv[i], "-trace"))
+		{
+			g_threadtrace = true;
+		}
 		else if (!strcasecmp(argv[i], "-chop"))
 		{
 			if (i + 1 < argc) // added "1" .--vluzacn
@@ -2282,6 +2312,17 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
 				Usage(ProgramType::PROGRAM_RAD);
 			}
 		}
+		else if (!strcasecmp(argv[i], "-wadcache"))
+		{
+			if (i + 1 < argc)
+			{
+				safe_strncpy(g_wadcache, argv[++i], _MAX_PATH);
+			}
+			else
+			{
+				Usage(ProgramType::PROGRAM_RAD);
+			}
+		}
 		else if (!strcasecmp(argv[i], "-lightdata")) // lightdata
 		{
 			if (i + 1 < argc) //--vluzacn
@@ -2343,6 +2384,9 @@ auto main(const int argc, char **argv) -> int
 	ExtractFilePath(temp, g_Wadpath);
 	StripExtension(g_Mapname);
 	atexit(CloseLog);
+	MetricsStart();
+	atexit(MetricsWriteReport);
+	atexit(ThreadTraceWrite);
 	ThreadSetDefault();
 	ThreadSetPriority(g_threadpriority);
 	LogArguments(argc, argv);
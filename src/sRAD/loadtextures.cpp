@@ -3,6 +3,7 @@
 #include "hlrad.h"
 #include "filelib.h"
 #include "log.h"
+#include "wadfile.h"
 
 int g_numtextures;
 RADTexture *g_textures;
@@ -14,37 +15,15 @@ struct waddir_t
 };
 waddir_t *g_waddirs = nullptr;
 
-struct lumpinfo_t
-{
-	int filepos;
-	int disksize;
-	int size;
-	char type;
-	char compression;
-	char pad1, pad2;
-	char name[16];
-};
-
 struct wadfile_t
 {
 	struct wadfile_t *next;
-	char path[_MAX_PATH];
-	FILE *file;
-	int filesize;
-	int numlumps;
-	lumpinfo_t *lumpinfos;
+	WadFile wad;
 };
 
 wadfile_t *g_wadfiles = nullptr;
 bool g_wadfiles_opened;
 
-static auto lump_sorter_by_name(const void *lump1, const void *lump2) -> int
-{
-	auto *plump1 = (lumpinfo_t *)lump1;
-	auto *plump2 = (lumpinfo_t *)lump2;
-	return strcasecmp(plump1->name, plump2->name);
-}
-
 void OpenWadFile(const char *name, bool fullpath = false)
 {
 	auto *wad = new wadfile_t;
@@ -58,11 +37,9 @@ void OpenWadFile(const char *name, bool fullpath = false)
 	}
 	if (fullpath)
 	{
-		safe_snprintf(wad->path, _MAX_PATH, "%s", name);
-		wad->file = fopen(wad->path, "rb");
-		if (!wad->file)
+		if (!MapWadFile(wad->wad, name))
 		{
-			Error("Couldn't open %s", wad->path);
+			Error("Couldn't open %s", name);
 		}
 	}
 	else
@@ -70,9 +47,9 @@ void OpenWadFile(const char *name, bool fullpath = false)
 		waddir_t *dir;
 		for (dir = g_waddirs; dir; dir = dir->next)
 		{
-			safe_snprintf(wad->path, _MAX_PATH, "%s\\%s", dir->path, name);
-			wad->file = fopen(wad->path, "rb");
-			if (wad->file)
+			char path[_MAX_PATH];
+			safe_snprintf(path, _MAX_PATH, "%s\\%s", dir->path, name);
+			if (MapWadFile(wad->wad, path))
 			{
 				break;
 			}
@@ -83,46 +60,7 @@ void OpenWadFile(const char *name, bool fullpath = false)
 			return;
 		}
 	}
-	Log("Using Wadfile: %s\n", wad->path);
-	wad->filesize = q_filelength(wad->file);
-	struct
-	{
-		char identification[4];
-		int numlumps;
-		int infotableofs;
-	} wadinfo;
-
-	if (wad->filesize < (int)sizeof(wadinfo))
-	{
-		Error("Invalid wad file '%s'.", wad->path);
-	}
-	SafeRead(wad->file, &wadinfo, sizeof(wadinfo));
-	wadinfo.numlumps = LittleLong(wadinfo.numlumps);
-	wadinfo.infotableofs = LittleLong(wadinfo.infotableofs);
-	if (strncmp(wadinfo.identification, "WAD3", 4))
-		Error("%s isn't a Wadfile!", wad->path);
-	wad->numlumps = wadinfo.numlumps;
-	if (wad->numlumps < 0 || wadinfo.infotableofs < 0 || wadinfo.infotableofs + wad->numlumps * (int)sizeof(lumpinfo_t) > wad->filesize)
-	{
-		Error("Invalid wad file '%s'.", wad->path);
-	}
-	wad->lumpinfos = new lumpinfo_t[wad->numlumps];
-	hlassume(wad->lumpinfos != nullptr, assume_NoMemory);
-	if (fseek(wad->file, wadinfo.infotableofs, SEEK_SET))
-		Error("File read failure: %s", wad->path);
-	for (int i = 0; i < wad->numlumps; i++)
-	{
-		SafeRead(wad->file, &wad->lumpinfos[i], sizeof(lumpinfo_t));
-		if (!TerminatedString(wad->lumpinfos[i].name, 16))
-		{
-			wad->lumpinfos[i].name[16 - 1] = 0;
-			Warning("Unterminated texture name : wad[%s] texture[%d] name[%s]\n", wad->path, i, wad->lumpinfos[i].name);
-		}
-		wad->lumpinfos[i].filepos = LittleLong(wad->lumpinfos[i].filepos);
-		wad->lumpinfos[i].disksize = LittleLong(wad->lumpinfos[i].disksize);
-		wad->lumpinfos[i].size = LittleLong(wad->lumpinfos[i].size);
-	}
-	qsort(wad->lumpinfos, wad->numlumps, sizeof(lumpinfo_t), lump_sorter_by_name);
+	Log("Using Wadfile: %s\n", wad->wad.path);
 }
 
 void TryOpenWadFiles()
@@ -189,8 +127,7 @@ void TryCloseWadFiles()
 		for (wadfile = g_wadfiles; wadfile; wadfile = next)
 		{
 			next = wadfile->next;
-			delete[] wadfile->lumpinfos;
-			fclose(wadfile->file);
+			UnmapWadFile(wadfile->wad);
 			delete wadfile;
 		}
 		g_wadfiles = nullptr;
@@ -274,35 +211,28 @@ void LoadTextureFromWad(RADTexture *tex, const BSPLumpMiptex *header)
 	wadfile_t *wad;
 	for (wad = g_wadfiles; wad; wad = wad->next)
 	{
-		lumpinfo_t temp;
-		strcpy(temp.name, tex->name);
-		auto *found = (lumpinfo_t *)bsearch(&temp, wad->lumpinfos, wad->numlumps, sizeof(lumpinfo_t), lump_sorter_by_name);
-		if (found)
+		const WadLump *found;
+		if (FindWadLumps(wad->wad, tex->name, found))
 		{
 			if (found->type != 67 || found->compression != 0)
 				continue;
-			if (found->disksize < (int)sizeof(BSPLumpMiptex) || found->filepos < 0 || found->filepos + found->disksize > wad->filesize)
+			const byte *data = WadLumpData(wad->wad, found);
+			if (found->disksize < (int)sizeof(BSPLumpMiptex) || !data)
 			{
-				Warning("Texture '%s': invalid texture data in '%s'.", tex->name, wad->path);
+				Warning("Texture '%s': invalid texture data in '%s'.", tex->name, wad->wad.path);
 				continue;
 			}
-			auto *mt = new BSPLumpMiptex[found->disksize];
-			hlassume(mt != nullptr, assume_NoMemory);
-			if (fseek(wad->file, found->filepos, SEEK_SET))
-				Error("File read failure");
-			SafeRead(wad->file, mt, found->disksize);
+			auto *mt = (const BSPLumpMiptex *)data; // read in place from the mapped wad
 			if (!TerminatedString(mt->name, 16))
 			{
-				Warning("Texture '%s': invalid texture data in '%s'.", tex->name, wad->path);
-				delete mt;
+				Warning("Texture '%s': invalid texture data in '%s'.", tex->name, wad->wad.path);
 				continue;
 			}
 			if (strcasecmp(mt->name, tex->name))
 			{
-				Warning("Texture '%s': texture name '%s' differs from its reference name '%s' in '%s'.", tex->name, mt->name, tex->name, wad->path);
+				Warning("Texture '%s': texture name '%s' differs from its reference name '%s' in '%s'.", tex->name, mt->name, tex->name, wad->wad.path);
 			}
 			LoadTexture(tex, mt, found->disksize);
-			delete mt;
 			break;
 		}
 	}
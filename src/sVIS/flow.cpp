@@ -3,6 +3,7 @@
 #include "hlvis.h"
 #include "threads.h"
 #include "log.h"
+#include "planeside.h"
 
 // =====================================================================================
 //  AllocStackWinding
@@ -50,33 +51,14 @@ inline auto ChopWinding(WindingVIS *const in, pstackVIS *const stack, const Plan
     int i;
     vec3_t mid;
 
-    counts[0] = counts[1] = counts[2] = 0;
-
     if (in->numpoints > (sizeof(sides) / sizeof(*sides)))
     {
         Error("Winding with too many sides!");
     }
 
     // determine sides for each point
-    for (i = 0; i < in->numpoints; i++)
-    {
-        dot = DotProduct(in->points[i], split->normal);
-        dot -= split->dist;
-        dists[i] = dot;
-        if (dot > ON_EPSILON)
-        {
-            sides[i] = SIDE_FRONT;
-        }
-        else if (dot < -ON_EPSILON)
-        {
-            sides[i] = SIDE_BACK;
-        }
-        else
-        {
-            sides[i] = SIDE_ON;
-        }
-        counts[sides[i]]++;
-    }
+    ClassifyPoints(in->points, in->numpoints, split->normal, split->dist, ON_EPSILON, dists, sides, counts);
+    i = in->numpoints;
 
     if (!counts[1])
     {
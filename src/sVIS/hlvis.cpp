@@ -19,6 +19,8 @@
 #include "hlvis.h"
 #include "arguments.h"
 #include "threads.h"
+#include "metrics.h"
+#include "threadtrace.h"
 #include "filelib.h"
 
 /*
@@ -101,8 +103,9 @@ static auto NewWinding(const int points) -> WindingVIS *
 //  GetNextPortal
 //      Returns the next portal for a thread to work on
 //      Returns the portals from the least complex, so the later ones can reuse the earlier information.
+//      The trace gets the number of the portal rather than the GetThreadWork index.
 // =====================================================================================
-static auto GetNextPortal() -> PortalVIS *
+static auto GetNextPortal(int threadnum) -> PortalVIS *
 {
     int j;
     PortalVIS *p;
@@ -131,19 +134,23 @@ static auto GetNextPortal() -> PortalVIS *
         p->status = stat_working;
     }
     ThreadUnlock();
+    if (g_threadtrace)
+    {
+        ThreadTraceSetItem(threadnum, p ? (int)(p - g_portals) : -1);
+    }
     return p;
 }
 
 // =====================================================================================
 //  LeafThread
 // =====================================================================================
-static void LeafThread(int unused)
+static void LeafThread(int threadnum)
 {
     PortalVIS *p;
 
     while (true)
     {
-        if (!(p = GetNextPortal()))
+        if (!(p = GetNextPortal(threadnum)))
         {
             return;
         }
@@ -615,6 +622,30 @@ void HandleArgs(int argc, char **argv, const char *&mapname_from_arg)
                 Usage(ProgramType::PROGRAM_VIS);
             }
         }
+        else if (!strcasecmp(argv[i], "-threads"))
+        {
+            if (i + 1 < argc)
+            {
+                g_numthreads = atoi(argv[++i]);
+                if (g_numthreads < 1)
+                {
+                    Log("Expected value of at least 1 for '-threads'\n");
+                    Usage(ProgramType::PROGRAM_VIS);
+                }
+            }
+            else
+            {
+                Usage(ProgramType::PROGRAM_VIS);
+            }
+        }
+        else if (!strcasecmp(argv[i], "-pin"))
+        {
+            g_threadpin = true;
+        }
+        else if (!strcasecmp(argv[i], "-trace"))
+        {
+            g_threadtrace = true;
+        }
         else if (!mapname_from_arg)
         {
             mapname_from_arg = argv[i];
@@ -657,6 +688,9 @@ auto main(const int argc, char **argv) -> int
     StripExtension(g_Mapname);
 
     atexit(CloseLog);
+    MetricsStart();
+    atexit(MetricsWriteReport);
+    atexit(ThreadTraceWrite);
     ThreadSetDefault();
     ThreadSetPriority(g_threadpriority);
     LogArguments(argc, argv);